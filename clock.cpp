@@ -0,0 +1,4 @@
+#include "clock.h"
+#include "mbed.h"
+
+uint32_t clock_now_us(void) { return us_ticker_read(); }
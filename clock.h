@@ -0,0 +1,18 @@
+/*
+ * File Purpose: Single microsecond time source for event timestamps and pulse timing
+ *
+ * Subroutines:
+ * uint32_t clock_now_us(void) - Free running microsecond count, wraps every ~71 minutes
+ *
+ * Code that timestamps or measures intervals calls this instead of reading the ticker
+ * directly, so a build off the board can run the firmware from a virtual clock by linking
+ * its own clock_now_us().
+ */
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+
+uint32_t clock_now_us(void);
+
+#endif
@@ -0,0 +1,136 @@
+#include "display.h"
+#include "glyphs.h"
+#include "latency.h"
+#include "mbed.h"
+
+#define FLAG_SCREEN 0x1    // pending_screen holds a screen not drawn yet
+#define FLAG_BACKLIGHT 0x2 // pending_backlight holds a change not applied yet
+
+// Layout of a screen request: [7:0] screen, [15:8] digits entered, [23:16] zone
+
+static void display_handler(void); // Render thread callback
+static void render(uint32_t request); // Compose a screen into the frame buffer and flush it
+static void render_zone(int zone); // Name the tripped zone on the second row
+static void render_status(int locked); // Lock and zone activity icons at the end of the first row
+
+static LCD_EM *display_lcd;
+static Thread display_thread(osPriorityBelowNormal); // Below the mode thread so keypresses are handled first
+static EventFlags display_flags;
+
+static volatile uint32_t pending_screen; // Latest screen request, overwritten by newer posts
+static volatile uint32_t pending_backlight; // Latest backlight request
+
+void display_start(LCD_EM *lcd) {
+  display_lcd = lcd;
+  display_thread.start(display_handler);
+}
+
+void display_show(DisplayScreen screen, int digits, int zone) {
+  core_util_atomic_store_u32(&pending_screen, screen | (digits << 8) | (zone << 16));
+  display_flags.set(FLAG_SCREEN);
+}
+
+void display_backlight(int on) {
+  core_util_atomic_store_u32(&pending_backlight, on);
+  display_flags.set(FLAG_BACKLIGHT);
+}
+
+static void display_handler() {
+  display_lcd->begin(); // Slow LCD init runs here instead of blocking boot
+  glyphs_start(display_lcd);
+
+  uint32_t request = 0;
+  int backlight = 1;
+  while (1) {
+    uint32_t flags;
+    if (backlight) { // Status line is live, wake up to refresh it
+      flags = display_flags.wait_any_for(FLAG_SCREEN | FLAG_BACKLIGHT,
+                                         std::chrono::milliseconds(DISPLAY_STATUS_MS));
+    } else { // Nobody is looking, sleep until something is posted
+      flags = display_flags.wait_any(FLAG_SCREEN | FLAG_BACKLIGHT);
+    }
+    if (flags & osFlagsError) { // Timed out, redraw the same screen with fresh status
+      render(request);
+      continue;
+    }
+    if (flags & FLAG_BACKLIGHT) {
+      backlight = core_util_atomic_load_u32(&pending_backlight);
+      display_lcd->setBacklight(backlight);
+    }
+    if (flags & FLAG_SCREEN) {
+      request = core_util_atomic_load_u32(&pending_screen);
+      render(request);
+      latency_probe(LATENCY_KEY_TO_DISPLAY, STAGE_OUTPUT);
+    }
+  }
+}
+
+static void render(uint32_t request) {
+  int digits = (request >> 8) & 0xFF;
+  int zone = (request >> 16) & 0xFF;
+
+  glyphs_frame();
+  display_lcd->clear();
+  switch (request & 0xFF) {
+  case SCREEN_SET_PASSCODE:
+    display_lcd->print("Set Passcode: ");
+    break;
+  case SCREEN_UNARMED:
+    display_lcd->print("Unarmed");
+    render_status(0);
+    break;
+  case SCREEN_ARMED:
+    display_lcd->print("Armed");
+    render_status(1);
+    break;
+  case SCREEN_TRIGGERED:
+    display_lcd->print("Triggered");
+    render_status(1);
+    render_zone(zone);
+    break;
+  case SCREEN_ENTER_PASSCODE:
+    display_lcd->print("Enter Passcode: ");
+    break;
+  case SCREEN_INCORRECT_PASSCODE:
+    display_lcd->print("Incorrect");
+    display_lcd->setCursor(0, 1);
+    display_lcd->print("Passcode");
+    break;
+  case SCREEN_AUTHORITIES_ALERTED:
+    display_lcd->print("Police Alerted");
+    render_zone(zone);
+    break;
+  }
+
+  display_lcd->setCursor(0, 1); // Passcode digits are echoed on the second row
+  for (int i = 0; i < digits; i++) {
+    display_lcd->print("*");
+  }
+  display_lcd->flush(); // Only the cells that changed go out on the bus
+}
+
+static void render_zone(int zone) {
+  if (zone == ZONE_NONE) {
+    return;
+  }
+  display_lcd->setCursor(0, 1);
+  display_lcd->print("Zone: ");
+  display_lcd->print(zone_name(zone));
+}
+
+static void render_status(int locked) {
+  int zones = zone_count();
+  int shown = zones < (DISPLAY_COLS - 11) / 2 ? zones : (DISPLAY_COLS - 11) / 2; // Titles use up to 10 columns
+  display_lcd->setCursor(DISPLAY_COLS - 1 - 2 * shown, 0);
+  display_lcd->write(glyph_char(locked ? GLYPH_LOCKED : GLYPH_UNLOCKED));
+  for (int zone = 0; zone < shown; zone++) {
+    int ultrasonic = zone_type(zone) == ZONE_ULTRASONIC;
+    int level = zone_level(zone);
+    display_lcd->write(glyph_char(ultrasonic ? GLYPH_ULTRASONIC : GLYPH_MICROPHONE));
+    if (level) {
+      display_lcd->write(glyph_char((Glyph)((ultrasonic ? GLYPH_RANGE_1 : GLYPH_SIGNAL_1) + level - 1)));
+    } else {
+      display_lcd->write(' ');
+    }
+  }
+}
@@ -0,0 +1,40 @@
+/*
+ * File Purpose: Runs the LCD from its own thread so mode handlers never wait on I2C
+ *
+ * Subroutines:
+ * void display_start(LCD_EM *lcd) - Start the render thread, which initializes the LCD and draws posted screens
+ * void display_show(DisplayScreen screen, int digits, int zone) - Post the screen to draw, replacing any screen not drawn yet
+ * void display_backlight(int on) - Post a backlight change
+ *
+ * Posting never blocks: the latest request is kept in a single slot that the render
+ * thread picks up, so stale screens are dropped instead of queued.
+ *
+ * The mode screens end the top row with a status line: a lock icon and an icon plus activity
+ * glyph per zone. While the backlight is on the render thread redraws the current screen every
+ * DISPLAY_STATUS_MS; only cells that changed go out, so a refresh costs a few bytes of I2C.
+ */
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include "lcd.h"
+#include "zones.h"
+
+#define DISPLAY_BANNER_MS 2000 // How long banners such as "Incorrect Passcode" stay up before the caller reverts them
+#define DISPLAY_STATUS_MS 250 // Status line refresh period while the backlight is on
+#define DISPLAY_COLS 16
+
+enum DisplayScreen {
+  SCREEN_SET_PASSCODE,
+  SCREEN_UNARMED,
+  SCREEN_ARMED,
+  SCREEN_TRIGGERED,
+  SCREEN_ENTER_PASSCODE,
+  SCREEN_INCORRECT_PASSCODE,
+  SCREEN_AUTHORITIES_ALERTED
+};
+
+void display_start(LCD_EM *lcd);
+void display_show(DisplayScreen screen, int digits = 0, int zone = ZONE_NONE); // zone is named on alarm screens
+void display_backlight(int on);
+
+#endif
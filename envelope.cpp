@@ -0,0 +1,72 @@
+#include "envelope.h"
+
+static int loud_blocks = 0; // Consecutive blocks over the threshold
+static uint32_t floor_scaled = 0; // Noise floor << ENVELOPE_FLOOR_SHIFT
+
+static uint32_t isqrt(uint32_t value) { // Bitwise integer square root
+  uint32_t root = 0;
+  uint32_t bit = 1u << 30;
+  while (bit > value) {
+    bit >>= 2;
+  }
+  while (bit) {
+    if (value >= root + bit) {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+Envelope envelope_measure(const uint16_t *samples, int count) {
+  Envelope envelope = {0, 0};
+  if (count <= 0) {
+    return envelope;
+  }
+
+  uint32_t sum = 0; // First pass: mean, removes the microphone's DC bias
+  for (int i = 0; i < count; i++) {
+    sum += samples[i];
+  }
+  int32_t mean = sum / count;
+
+  // Second pass: 12 bit samples keep (x - mean)^2 under 2^24, so blocks of up
+  // to 256 samples can't overflow the 32 bit accumulator
+  uint32_t squares = 0;
+  int32_t peak = 0;
+  for (int i = 0; i < count; i++) {
+    int32_t deviation = (int32_t)samples[i] - mean;
+    squares += deviation * deviation;
+    int32_t magnitude = deviation < 0 ? -deviation : deviation;
+    peak = magnitude > peak ? magnitude : peak;
+  }
+
+  envelope.rms = isqrt(squares / count);
+  envelope.peak = peak;
+  return envelope;
+}
+
+int envelope_update(Envelope envelope) {
+  uint16_t threshold = envelope_threshold(); // Judge against the floor before this block
+  floor_scaled += envelope.rms - (floor_scaled >> ENVELOPE_FLOOR_SHIFT);
+  if (envelope.rms < threshold) {
+    loud_blocks = 0;
+    return 0;
+  }
+  loud_blocks++;
+  if (loud_blocks < ENVELOPE_SUSTAIN_BLOCKS) {
+    return 0;
+  }
+  loud_blocks = 0; // Report again if the sound carries on for another stretch
+  return 1;
+}
+
+uint16_t envelope_noise_floor(void) { return floor_scaled >> ENVELOPE_FLOOR_SHIFT; }
+
+uint16_t envelope_threshold(void) {
+  uint32_t threshold = envelope_noise_floor() * ENVELOPE_FLOOR_RATIO;
+  return threshold > ENVELOPE_RMS_THRESHOLD ? threshold : ENVELOPE_RMS_THRESHOLD;
+}
@@ -0,0 +1,38 @@
+/*
+ * File Purpose: Fixed point loudness envelope of microphone sample blocks
+ *
+ * Subroutines:
+ * Envelope envelope_measure(const uint16_t *samples, int count) - RMS and peak of a block around its own mean
+ * int envelope_update(Envelope envelope) - Track sustained loudness, returns 1 each time the threshold has held for another ENVELOPE_SUSTAIN_BLOCKS
+ * uint16_t envelope_noise_floor(void) - Running estimate of the room's background RMS
+ * uint16_t envelope_threshold(void) - RMS a block currently needs to count as loud
+ *
+ * Only integer arithmetic in straight loops over the block so the compiler can unroll and use
+ * the Cortex-M4 multiply-accumulate instructions. No mbed dependency.
+ *
+ * The noise floor follows every block's RMS with a time constant of 2^ENVELOPE_FLOOR_SHIFT blocks,
+ * slow enough that a short sound barely moves it while a fan or a running tap raises it within
+ * seconds. A block is loud when it is ENVELOPE_FLOOR_RATIO times the floor, and never below
+ * ENVELOPE_RMS_THRESHOLD.
+ */
+#ifndef ENVELOPE_H
+#define ENVELOPE_H
+
+#include <stdint.h>
+
+#define ENVELOPE_RMS_THRESHOLD 200 // Minimum ADC counts of RMS deviation from the block mean that count as loud
+#define ENVELOPE_FLOOR_SHIFT 8     // Floor time constant, 256 blocks is ~8s at 8kHz
+#define ENVELOPE_FLOOR_RATIO 3     // Loud means this many times the floor
+#define ENVELOPE_SUSTAIN_BLOCKS 3  // Consecutive loud blocks before the sound counts
+
+struct Envelope {
+  uint16_t rms;  // Root mean square deviation from the block mean
+  uint16_t peak; // Largest deviation from the block mean
+};
+
+Envelope envelope_measure(const uint16_t *samples, int count);
+int envelope_update(Envelope envelope);
+uint16_t envelope_noise_floor(void);
+uint16_t envelope_threshold(void);
+
+#endif
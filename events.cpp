@@ -0,0 +1,89 @@
+#include "events.h"
+#include "clock.h"
+#include "mbed.h"
+
+#define RING_MASK (EVENT_RING_SIZE - 1)
+
+MBED_STATIC_ASSERT((EVENT_RING_SIZE & RING_MASK) == 0,
+                   "EVENT_RING_SIZE must be a power of two");
+
+struct Slot {
+  volatile uint32_t sequence; // == position when free, position + 1 when published
+  IsrEvent event;
+};
+
+static int pop(IsrEvent *event); // Take the oldest published event if there is one
+
+static Slot ring[EVENT_RING_SIZE];
+static volatile uint32_t head = 0; // Next position producers claim
+static uint32_t tail = 0;          // Next position the consumer reads
+static volatile uint32_t lost = 0; // Events dropped because the ring was full
+
+static Semaphore event_ready(0, EVENT_RING_SIZE); // Wakes the consumer after a post
+
+void event_init(void) {
+  for (uint32_t i = 0; i < EVENT_RING_SIZE; i++) {
+    ring[i].sequence = i; // Slot i is free for position i on the first lap
+  }
+  head = 0;
+  tail = 0;
+}
+
+int event_post(EventType type, uint8_t source, uint16_t value) {
+  return event_post_at(type, source, value, clock_now_us());
+}
+
+int event_post_at(EventType type, uint8_t source, uint16_t value, uint32_t origin_us) {
+  uint32_t position = core_util_atomic_load_u32(&head);
+  Slot *slot;
+
+  while (1) {
+    slot = &ring[position & RING_MASK];
+    int32_t diff =
+        (int32_t)(core_util_atomic_load_u32(&slot->sequence) - position);
+    if (diff == 0) { // Slot is free, try to claim it
+      if (core_util_atomic_cas_u32(&head, &position, position + 1)) {
+        break;
+      } // position now holds the head another producer moved to
+    } else if (diff < 0) { // Consumer hasn't freed this slot yet, ring is full
+      core_util_atomic_incr_u32(&lost, 1);
+      return 0;
+    } else { // Another producer claimed this slot first
+      position = core_util_atomic_load_u32(&head);
+    }
+  }
+
+  slot->event.timestamp = origin_us;
+  slot->event.posted = clock_now_us();
+  slot->event.type = type;
+  slot->event.source = source;
+  slot->event.value = value;
+  core_util_atomic_store_u32(&slot->sequence, position + 1); // Publish to consumer
+  event_ready.release();
+  return 1;
+}
+
+int event_wait(IsrEvent *event, uint32_t timeout_ms) {
+  while (!pop(event)) {
+    if (!event_ready.try_acquire_for(
+            Kernel::Clock::duration_u32(timeout_ms))) {
+      return pop(event); // Timed out, take anything published meanwhile
+    }
+  }
+  return 1;
+}
+
+uint32_t event_lost_count(void) { return core_util_atomic_load_u32(&lost); }
+
+uint32_t event_pending(void) { return core_util_atomic_load_u32(&head) - tail; }
+
+static int pop(IsrEvent *event) {
+  Slot *slot = &ring[tail & RING_MASK];
+  if (core_util_atomic_load_u32(&slot->sequence) != tail + 1) {
+    return 0; // Empty, or the oldest claimed slot isn't published yet
+  }
+  *event = slot->event;
+  core_util_atomic_store_u32(&slot->sequence, tail + EVENT_RING_SIZE); // Free for the next lap
+  tail++;
+  return 1;
+}
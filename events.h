@@ -0,0 +1,45 @@
+/*
+ * File Purpose: Lock-free ring of timestamped events passed from ISRs to the mode thread
+ *
+ * Subroutines:
+ * void event_init(void) - Mark every ring slot free, call before any ISR can post
+ * int event_post(EventType type, uint8_t source, uint16_t value) - Queue an event, safe from any ISR or thread
+ * int event_post_at(EventType type, uint8_t source, uint16_t value, uint32_t origin_us) - Queue an event whose input was first seen before the post
+ * int event_wait(IsrEvent *event, uint32_t timeout_ms) - Block the consumer thread until an event is available
+ * uint32_t event_lost_count(void) - Number of events dropped because the ring was full
+ * uint32_t event_pending(void) - Events claimed but not yet consumed, consumer thread only
+ *
+ * Producers claim slots with a compare-and-swap on the head index and publish them through a
+ * per-slot sequence number, so ISRs of any priority can post without masking interrupts.
+ * There must be exactly one consumer.
+ */
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stdint.h>
+
+#define EVENT_RING_SIZE 32 // Must be a power of two
+
+enum EventType {
+  EVENT_KEY_DOWN,           // Debounced press, value = keypad index (row * 4 + column), timestamp = first raw sample
+  EVENT_KEY_UP,             // Debounced release, value = keypad index
+  EVENT_MIC,                // Microphone threshold crossed
+  EVENT_ECHO_PULSE          // Ultrasonic echo ended, value = pulse width in us
+};
+
+struct IsrEvent {
+  uint32_t timestamp; // clock_now_us() when the input was first seen, the post time unless given
+  uint32_t posted;    // clock_now_us() when the event was posted
+  uint8_t type;       // EventType
+  uint8_t source;     // Which input produced the event
+  uint16_t value;     // Event specific payload
+};
+
+void event_init(void);
+int event_post(EventType type, uint8_t source = 0, uint16_t value = 0);
+int event_post_at(EventType type, uint8_t source, uint16_t value, uint32_t origin_us);
+int event_wait(IsrEvent *event, uint32_t timeout_ms);
+uint32_t event_lost_count(void);
+uint32_t event_pending(void);
+
+#endif
@@ -0,0 +1,80 @@
+#include "glyphs.h"
+#include <string.h>
+
+#define SLOT_EMPTY 0xFF
+
+struct GlyphDef {
+  unsigned char rows[8]; // 5x8 bitmap, bit 4 is the leftmost dot
+  char fallback;         // Shown when no slot is free
+};
+
+static const GlyphDef glyphs[GLYPH_COUNT] = {
+    {{0x0E, 0x11, 0x11, 0x1F, 0x1B, 0x1B, 0x1F, 0x00}, 'L'}, // GLYPH_LOCKED
+    {{0x0E, 0x10, 0x10, 0x1F, 0x1B, 0x1B, 0x1F, 0x00}, 'U'}, // GLYPH_UNLOCKED
+    {{0x0E, 0x0E, 0x0E, 0x0E, 0x1F, 0x04, 0x0E, 0x00}, 'M'}, // GLYPH_MICROPHONE
+    {{0x02, 0x09, 0x05, 0x15, 0x05, 0x09, 0x02, 0x00}, 'S'}, // GLYPH_ULTRASONIC
+    {{0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x10}, '1'}, // GLYPH_SIGNAL_1
+    {{0x00, 0x00, 0x00, 0x00, 0x04, 0x04, 0x14, 0x14}, '2'}, // GLYPH_SIGNAL_2
+    {{0x00, 0x00, 0x01, 0x01, 0x05, 0x05, 0x15, 0x15}, '3'}, // GLYPH_SIGNAL_3
+    {{0x00, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00}, '1'}, // GLYPH_RANGE_1
+    {{0x00, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x00}, '2'}, // GLYPH_RANGE_2
+    {{0x00, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x00}, '3'}, // GLYPH_RANGE_3
+};
+
+static LCD_EM *glyph_lcd;
+static uint8_t slot_glyph[GLYPH_SLOTS]; // Glyph resident in each slot, SLOT_EMPTY if none
+static uint32_t slot_used[GLYPH_SLOTS]; // use_clock at the slot's last use
+static uint32_t use_clock = 0;
+static uint8_t frame_slots = 0; // Bit per slot placed in the frame being composed
+
+static uint32_t hits = 0;
+static uint32_t uploads = 0;
+static uint32_t fallbacks = 0;
+
+void glyphs_start(LCD_EM *lcd) {
+  glyph_lcd = lcd;
+  for (int slot = 0; slot < GLYPH_SLOTS; slot++) {
+    slot_glyph[slot] = SLOT_EMPTY; // CGRAM content is undefined after power up
+  }
+}
+
+void glyphs_frame(void) { frame_slots = 0; }
+
+unsigned char glyph_char(Glyph glyph) {
+  int victim = -1; // Free slot, or else the least recently used one not in this frame
+  uint32_t victim_used = 0;
+  for (int slot = 0; slot < GLYPH_SLOTS; slot++) {
+    if (slot_glyph[slot] == glyph) {
+      slot_used[slot] = ++use_clock;
+      frame_slots |= 1u << slot;
+      hits++;
+      return slot;
+    }
+    if (frame_slots & (1u << slot)) {
+      continue; // On screen in this frame, can't be reloaded
+    }
+    uint32_t used = slot_glyph[slot] == SLOT_EMPTY ? 0 : slot_used[slot];
+    if (victim < 0 || used < victim_used) {
+      victim = slot;
+      victim_used = used;
+    }
+  }
+  if (victim < 0) {
+    fallbacks++;
+    return glyphs[glyph].fallback;
+  }
+  unsigned char rows[8];
+  memcpy(rows, glyphs[glyph].rows, sizeof(rows)); // createChar takes a mutable array
+  glyph_lcd->createChar(victim, rows);
+  slot_glyph[victim] = glyph;
+  slot_used[victim] = ++use_clock;
+  frame_slots |= 1u << victim;
+  uploads++;
+  return victim;
+}
+
+void glyphs_report(void) {
+  printf("glyphs: hits=%lu uploads=%lu fallbacks=%lu lcd bytes=%u\r\n", (unsigned long)hits,
+         (unsigned long)uploads, (unsigned long)fallbacks,
+         glyph_lcd ? glyph_lcd->getBytesSent() : 0);
+}
@@ -0,0 +1,44 @@
+/*
+ * File Purpose: Map logical icons onto the LCD's eight CGRAM character slots
+ *
+ * Subroutines:
+ * void glyphs_start(LCD_EM *lcd) - Use the LCD's CGRAM, call after lcd->begin() from the render thread
+ * void glyphs_frame(void) - Start composing a new frame, every slot may be replaced again
+ * unsigned char glyph_char(Glyph glyph) - Character code that shows the glyph, uploading it if it isn't resident
+ * void glyphs_report(void) - Print cache hits, uploads, fallbacks and LCD bytes sent
+ *
+ * There are more glyphs than slots, so a glyph that isn't resident replaces the least recently
+ * used one. Slots already placed in the frame being composed are never replaced, since the new
+ * cells would change along with the old ones; when all eight are taken the glyph falls back to
+ * a plain character. Uploading costs 8 data bytes plus a command, a hit costs nothing, and a
+ * cell whose slot was reloaded changes on the panel without being rewritten.
+ *
+ * Only the render thread may call these, they talk to the LCD directly.
+ */
+#ifndef GLYPHS_H
+#define GLYPHS_H
+
+#include "lcd.h"
+
+#define GLYPH_SLOTS 8
+
+enum Glyph {
+  GLYPH_LOCKED,
+  GLYPH_UNLOCKED,
+  GLYPH_MICROPHONE,
+  GLYPH_ULTRASONIC,
+  GLYPH_SIGNAL_1, // Signal bars, sound level
+  GLYPH_SIGNAL_2,
+  GLYPH_SIGNAL_3,
+  GLYPH_RANGE_1,  // Horizontal bar graph, the closer the fuller
+  GLYPH_RANGE_2,
+  GLYPH_RANGE_3,
+  GLYPH_COUNT
+};
+
+void glyphs_start(LCD_EM *lcd);
+void glyphs_frame(void);
+unsigned char glyph_char(Glyph glyph);
+void glyphs_report(void);
+
+#endif
@@ -0,0 +1,7 @@
+// Single mbed.h on the host, the board build includes the real driver header
+#ifndef HOST_FAKES_FLASHIAPBLOCKDEVICE_H
+#define HOST_FAKES_FLASHIAPBLOCKDEVICE_H
+
+#include "mbed.h"
+
+#endif
@@ -0,0 +1,7 @@
+// Single mbed.h on the host, the board build includes the real driver header
+#ifndef HOST_FAKES_THISTHREAD_H
+#define HOST_FAKES_THISTHREAD_H
+
+#include "mbed.h"
+
+#endif
@@ -0,0 +1,642 @@
+#include "sim.h"
+#include <deque>
+#include <algorithm>
+#include <map>
+#include <unistd.h>
+#include <vector>
+
+#define PORTS 9 // GPIOA..GPIOI
+#define LCD_ADDRESS 0x4E
+#define LCD_EN 0x04
+#define LCD_RS 0x01
+#define LCD_BACKLIGHT 0x08
+#define LCD_COLS 16
+#define ECHO_DELAY_US 250    // HC-SR04 sends its burst before raising echo
+#define ECHO_NOTHING_US 38000 // Echo width when nothing is in range
+
+// ---- GPIO ----
+
+static uint16_t external[PORTS];  // Levels driven from outside the board
+static uint16_t driven[PORTS];    // Pins something outside drives, the rest rest at their pull
+static uint16_t pulled_up[PORTS];
+static uint16_t last_idr[PORTS];  // IDR when edges were last looked for
+
+static GPIO_TypeDef *gpio(int port) { return (GPIO_TypeDef *)(GPIOA_BASE + port * 0x400); }
+
+static std::vector<mbed::InterruptIn *> &inputs() {
+  static std::vector<mbed::InterruptIn *> list;
+  return list;
+}
+
+static int is_output(int port, int bit) { return ((gpio(port)->MODER >> (bit * 2)) & 3) == 1; }
+
+static int pin_level(int port, int bit) {
+  if (is_output(port, bit)) {
+    return (gpio(port)->ODR >> bit) & 1;
+  }
+  uint16_t source = (driven[port] >> bit) & 1 ? external[port] : pulled_up[port];
+  return (source >> bit) & 1;
+}
+
+static uint16_t port_levels(int port) {
+  uint16_t levels = 0;
+  for (int bit = 0; bit < 16; bit++) {
+    levels |= pin_level(port, bit) << bit;
+  }
+  return levels;
+}
+
+static void drive(PinName pin, int level) {
+  int port = pin >> 4, bit = pin & 15;
+  driven[port] |= 1u << bit;
+  external[port] = (external[port] & ~(1u << bit)) | (level ? 1u << bit : 0);
+}
+
+static void set_mode(PinName pin, uint32_t mode) {
+  GPIO_TypeDef *port = gpio(pin >> 4);
+  int shift = (pin & 15) * 2;
+  port->MODER = (port->MODER & ~(3u << shift)) | (mode << shift);
+}
+
+static void refresh_quietly(int port) { // Mode or pull change, not an edge
+  last_idr[port] = port_levels(port);
+  gpio(port)->IDR = last_idr[port];
+}
+
+void sim_pin_output(PinName pin, int level) {
+  GPIO_TypeDef *port = gpio(pin >> 4);
+  set_mode(pin, 1);
+  port->ODR = (port->ODR & ~(1u << (pin & 15))) | (level ? 1u << (pin & 15) : 0);
+  refresh_quietly(pin >> 4);
+}
+
+void sim_pin_pull(PinName pin, PinMode mode) {
+  int port = pin >> 4, bit = pin & 15;
+  set_mode(pin, 0);
+  pulled_up[port] = (pulled_up[port] & ~(1u << bit)) | (mode == PullUp ? 1u << bit : 0);
+  refresh_quietly(port);
+}
+
+int sim_pin_input(PinName pin) { return (gpio(pin >> 4)->IDR >> (pin & 15)) & 1; }
+
+int sim_pin_level(PinName pin) { return pin_level(pin >> 4, pin & 15); }
+
+void sim_interrupt_in_add(mbed::InterruptIn *input) { inputs().push_back(input); }
+
+void sim_interrupt_in_remove(mbed::InterruptIn *input) {
+  std::vector<mbed::InterruptIn *> &list = inputs();
+  for (size_t i = 0; i < list.size(); i++) {
+    if (list[i] == input) {
+      list.erase(list.begin() + i);
+      return;
+    }
+  }
+}
+
+static void settle_if_driver(void) {
+  if (!sim_in_thread() && !sim_in_isr()) {
+    sim_settle();
+  }
+}
+
+void sim_pin_drive(PinName pin, int level) {
+  drive(pin, level);
+  sim_sync();
+  settle_if_driver();
+}
+
+// ---- Keypad matrix ----
+
+static const PinName key_rows[4] = {PA_3, PC_0, PC_3, PC_1};
+static const PinName key_columns[4] = {PF_14, PE_11, PE_9, PF_13};
+static const char key_map[4][4] = {{'1', '2', '3', 'A'},
+                                   {'4', '5', '6', 'B'},
+                                   {'7', '8', '9', 'C'},
+                                   {'*', '0', '#', 'D'}};
+static uint16_t keys_closed = 0; // Bit per switch, row * 4 + column
+static int keypad_wired = 0;     // Columns follow the matrix once a test has used the keypad
+
+static void keypad_model(void) {
+  if (!keypad_wired) {
+    return;
+  }
+  for (int column = 0; column < 4; column++) {
+    int level = 0;
+    for (int row = 0; row < 4; row++) {
+      if ((keys_closed >> (row * 4 + column)) & 1 && sim_pin_level(key_rows[row])) {
+        level = 1; // Closed switch connects a powered row to the column
+      }
+    }
+    drive(key_columns[column], level);
+  }
+}
+
+void sim_key(char key, int down) {
+  for (int index = 0; index < 16; index++) {
+    if (key_map[index / 4][index % 4] == key) {
+      keys_closed = down ? keys_closed | 1u << index : keys_closed & ~(1u << index);
+    }
+  }
+  keypad_wired = 1;
+  sim_sync();
+  settle_if_driver();
+}
+
+void sim_press(char key, uint32_t hold_ms) {
+  sim_key(key, 1);
+  sim_advance_ms(hold_ms);
+  sim_key(key, 0);
+  sim_advance_ms(30); // Release debounce plus the post to the mode thread
+}
+
+// ---- HC-SR04 ----
+
+struct PinEvent : mbed::TimerEvent { // The world changing a pin, not an interrupt by itself
+  PinName pin;
+  int level;
+  void at(uint64_t delay_us) { schedule(delay_us); }
+  void sim_fire() override { drive(pin, level); }
+  bool sim_interrupt() const override { return false; }
+};
+
+struct Sensor {
+  PinName trigger;
+  PinName echo;
+  uint32_t mm;
+  int trigger_level;
+  PinEvent rise;
+  PinEvent fall;
+};
+
+static std::vector<Sensor *> sensors;
+
+static void ultrasonic_model(void) {
+  for (Sensor *sensor : sensors) {
+    int level = sim_pin_level(sensor->trigger);
+    if (sensor->trigger_level && !level && !sensor->rise.sim_armed && !sensor->fall.sim_armed) {
+      uint64_t width = sensor->mm ? (uint64_t)sensor->mm * 2000 / 343 : ECHO_NOTHING_US;
+      sensor->rise.at(ECHO_DELAY_US);
+      sensor->fall.at(ECHO_DELAY_US + width);
+    }
+    sensor->trigger_level = level;
+  }
+}
+
+void sim_ultrasonic(PinName trigger, PinName echo, uint32_t mm) {
+  for (Sensor *sensor : sensors) {
+    if (sensor->echo == echo) {
+      sensor->mm = mm;
+      return;
+    }
+  }
+  Sensor *sensor = new Sensor;
+  sensor->trigger = trigger;
+  sensor->echo = echo;
+  sensor->mm = mm;
+  sensor->trigger_level = sim_pin_level(trigger);
+  sensor->rise.pin = sensor->fall.pin = echo;
+  sensor->rise.level = 1;
+  sensor->fall.level = 0;
+  drive(echo, 0);
+  sensors.push_back(sensor);
+}
+
+// ---- Register side effects ----
+
+void sim_sync(void) {
+  for (int pass = 0; pass < 16; pass++) {
+    for (int port = 0; port < PORTS; port++) {
+      GPIO_TypeDef *regs = gpio(port);
+      uint32_t bsrr = regs->BSRR;
+      if (bsrr) { // Set wins over reset
+        regs->ODR = (regs->ODR & ~(bsrr >> 16)) | (bsrr & 0xFFFF);
+        regs->BSRR = 0;
+      }
+      if (regs->BRR) {
+        regs->ODR &= ~regs->BRR;
+        regs->BRR = 0;
+      }
+    }
+    uint32_t ifcr = DMA1->IFCR;
+    if (ifcr) {
+      DMA1->ISR &= ~(ifcr & DMA_IFCR_CGIF1 ? 0xFu : ifcr);
+      if (!(DMA1->ISR & (DMA_ISR_TCIF1 | DMA_ISR_HTIF1 | DMA_ISR_TEIF1))) {
+        DMA1->ISR &= ~DMA_ISR_GIF1;
+      }
+      DMA1->IFCR = 0;
+    }
+    keypad_model();
+    ultrasonic_model();
+
+    std::vector<std::pair<mbed::InterruptIn *, int>> edges;
+    for (int port = 0; port < PORTS; port++) {
+      uint16_t levels = port_levels(port);
+      uint16_t changed = levels ^ last_idr[port];
+      gpio(port)->IDR = levels;
+      last_idr[port] = levels;
+      if (!changed) {
+        continue;
+      }
+      for (mbed::InterruptIn *input : inputs()) {
+        PinName pin = input->sim_pin();
+        if (pin >> 4 == port && (changed >> (pin & 15)) & 1) {
+          edges.push_back(std::make_pair(input, (levels >> (pin & 15)) & 1));
+        }
+      }
+    }
+    if (edges.empty()) {
+      return;
+    }
+    for (auto &edge : edges) {
+      edge.first->sim_edge(edge.second);
+    }
+  }
+}
+
+// ---- LCD: HD44780 behind a PCF8574 ----
+
+static struct {
+  uint8_t last;          // Expander output latch
+  int four_bit;
+  int high_pending;      // High nibble received, low nibble to come
+  uint8_t high;
+  uint8_t ddram[128];
+  uint8_t cgram[64];
+  uint8_t address;
+  int in_cgram;
+  int increment;
+  char rows[4][LCD_COLS + 1];
+} lcd = {0, 0, 0, 0, {0}, {0}, 0, 0, 1, {{0}}};
+
+static std::map<int, uint32_t> i2c_bytes;
+static std::map<int, uint32_t> i2c_transactions;
+static uint32_t cgram_writes = 0;
+
+static void lcd_command(uint8_t command) {
+  if (command & 0x80) {
+    lcd.in_cgram = 0;
+    lcd.address = command & 0x7F;
+  } else if (command & 0x40) {
+    lcd.in_cgram = 1;
+    lcd.address = command & 0x3F;
+  } else if (command & 0x20) {
+    lcd.four_bit = !(command & 0x10);
+  } else if (command & 0x10) {
+    // Cursor or display shift, not modelled
+  } else if (command & 0x08) {
+    // Display on/off, cursor and blink, not modelled
+  } else if (command & 0x04) {
+    lcd.increment = (command & 0x02) != 0;
+  } else if (command & 0x02) {
+    lcd.in_cgram = 0;
+    lcd.address = 0;
+  } else if (command & 0x01) {
+    memset(lcd.ddram, ' ', sizeof(lcd.ddram));
+    lcd.in_cgram = 0;
+    lcd.address = 0;
+    lcd.increment = 1;
+  }
+}
+
+static void lcd_data(uint8_t data) {
+  if (lcd.in_cgram) {
+    lcd.cgram[lcd.address & 0x3F] = data;
+    cgram_writes++;
+    lcd.address = (lcd.address + 1) & 0x3F;
+  } else {
+    lcd.ddram[lcd.address & 0x7F] = data;
+    lcd.address = (lcd.address + (lcd.increment ? 1 : -1)) & 0x7F;
+  }
+}
+
+static void lcd_nibble(uint8_t nibble, int rs) {
+  if (!lcd.four_bit) { // 8 bit interface, D3..D0 are tied low
+    if (!rs) {
+      lcd_command(nibble << 4);
+    }
+    return;
+  }
+  if (!lcd.high_pending) {
+    lcd.high = nibble;
+    lcd.high_pending = 1;
+    return;
+  }
+  lcd.high_pending = 0;
+  uint8_t value = lcd.high << 4 | nibble;
+  if (rs) {
+    lcd_data(value);
+  } else {
+    lcd_command(value);
+  }
+}
+
+static void lcd_byte(uint8_t byte) {
+  if ((lcd.last & LCD_EN) && !(byte & LCD_EN)) { // Falling enable latches the nibble
+    lcd_nibble(lcd.last >> 4, lcd.last & LCD_RS);
+  }
+  lcd.last = byte;
+}
+
+int sim_i2c_write(int address, const char *data, int length, int hz) {
+  i2c_bytes[address] += length;
+  i2c_transactions[address]++;
+  if (address != LCD_ADDRESS) {
+    return 1; // Nobody acknowledges
+  }
+  for (int i = 0; i < length; i++) {
+    lcd_byte((uint8_t)data[i]);
+  }
+  return 0;
+}
+
+uint32_t sim_i2c_bytes(int address) { return i2c_bytes[address]; }
+
+uint32_t sim_i2c_transactions(int address) { return i2c_transactions[address]; }
+
+const char *sim_lcd_row(int row) {
+  static const uint8_t offsets[4] = {0x00, 0x40, 0x14, 0x54};
+  for (int column = 0; column < LCD_COLS; column++) {
+    uint8_t c = lcd.ddram[offsets[row & 3] + column];
+    lcd.rows[row & 3][column] = c ? c : ' ';
+  }
+  lcd.rows[row & 3][LCD_COLS] = 0;
+  return lcd.rows[row & 3];
+}
+
+int sim_lcd_char(int row, int column) {
+  static const uint8_t offsets[4] = {0x00, 0x40, 0x14, 0x54};
+  return lcd.ddram[offsets[row & 3] + column % LCD_COLS];
+}
+
+const uint8_t *sim_lcd_cgram(int code) { return lcd.cgram + (code & 7) * 8; }
+
+uint32_t sim_lcd_cgram_writes(void) { return cgram_writes; }
+
+int sim_lcd_backlight(void) { return (lcd.last & LCD_BACKLIGHT) != 0; }
+
+// ---- UARTs ----
+
+struct Uart {
+  mbed::SerialBase *serial;
+  std::string sent;
+  std::deque<uint8_t> received;
+};
+
+static std::vector<Uart *> &uarts() {
+  static std::vector<Uart *> list;
+  return list;
+}
+
+static Uart *uart_of(mbed::SerialBase *serial) {
+  for (Uart *uart : uarts()) {
+    if (uart->serial == serial) {
+      return uart;
+    }
+  }
+  return nullptr;
+}
+
+void sim_uart_add(mbed::SerialBase *serial) {
+  Uart *uart = new Uart;
+  uart->serial = serial;
+  uarts().push_back(uart);
+}
+
+void sim_uart_remove(mbed::SerialBase *serial) {
+  std::vector<Uart *> &list = uarts();
+  for (size_t i = 0; i < list.size(); i++) {
+    if (list[i]->serial == serial) {
+      delete list[i];
+      list.erase(list.begin() + i);
+      return;
+    }
+  }
+}
+
+void sim_uart_sent(mbed::SerialBase *serial, const uint8_t *data, int length) {
+  if (Uart *uart = uart_of(serial)) {
+    uart->sent.append((const char *)data, length);
+  }
+}
+
+int sim_uart_getc(mbed::SerialBase *serial) {
+  Uart *uart = uart_of(serial);
+  if (!uart || uart->received.empty()) {
+    return -1;
+  }
+  uint8_t byte = uart->received.front();
+  uart->received.pop_front();
+  return byte;
+}
+
+int sim_uart_readable(mbed::SerialBase *serial) {
+  Uart *uart = uart_of(serial);
+  return uart && !uart->received.empty();
+}
+
+std::string sim_uart_take(PinName tx) {
+  std::string bytes;
+  for (Uart *uart : uarts()) {
+    if (uart->serial->sim_tx() == tx) {
+      bytes += uart->sent;
+      uart->sent.clear();
+    }
+  }
+  return bytes;
+}
+
+void sim_uart_inject(PinName rx, const uint8_t *data, int length) {
+  for (Uart *uart : uarts()) {
+    if (uart->serial->sim_rx() != rx) {
+      continue;
+    }
+    uart->received.insert(uart->received.end(), data, data + length);
+    mbed::SerialBase *serial = uart->serial;
+    sim_interrupt(mbed::Callback<void()>([serial]() { serial->sim_rx_irq(); }));
+    sim_sync();
+    settle_if_driver();
+    return;
+  }
+}
+
+// ---- Microphone ADC, DMA half and full transfer interrupts ----
+
+static uint16_t *adc_buffer = nullptr;
+static uint32_t adc_length = 0;
+static uint32_t adc_rate_hz = 0;
+static int adc_half = 0; // Half the DMA fills next
+static uint16_t (*mic_source)(uint64_t t_us) = nullptr;
+
+static struct AdcBlock : mbed::TimerEvent {
+  void at(uint64_t delay_us) { schedule(delay_us); }
+  bool sim_interrupt() const override { return false; } // sim_irq counts the DMA interrupt
+  void sim_fire() override {
+    uint32_t count = adc_length / 2;
+    uint64_t period_us = (uint64_t)count * 1000000 / adc_rate_hz;
+    uint64_t start_us = sim_now_us() - period_us;
+    for (uint32_t i = 0; i < count; i++) {
+      uint64_t t_us = start_us + (uint64_t)i * 1000000 / adc_rate_hz;
+      adc_buffer[adc_half * count + i] = mic_source ? mic_source(t_us) : 2048;
+    }
+    DMA1->ISR |= DMA_ISR_GIF1 | (adc_half ? DMA_ISR_TCIF1 : DMA_ISR_HTIF1);
+    adc_half ^= 1;
+    at(period_us);
+    sim_irq(DMA1_Channel1_IRQn);
+  }
+} adc_block;
+
+void sim_adc_dma(uint16_t *buffer, uint32_t length) {
+  adc_buffer = buffer;
+  adc_length = length;
+  adc_half = 0;
+}
+
+void sim_adc_trigger(uint32_t rate_hz) {
+  adc_rate_hz = rate_hz;
+  if (adc_buffer && adc_length >= 2 && rate_hz) {
+    adc_block.at((uint64_t)adc_length / 2 * 1000000 / rate_hz);
+  }
+}
+
+void sim_mic_source(uint16_t (*sample)(uint64_t t_us)) { mic_source = sample; }
+
+// ---- Watchdog, reset reason, flash ----
+
+static uint32_t watchdog_timeout_ms = 0;
+static uint32_t watchdog_resets = 0;
+
+static struct WatchdogExpiry : mbed::TimerEvent {
+  void at(uint64_t delay_us) { schedule(delay_us); }
+  bool sim_interrupt() const override { return false; }
+  void sim_fire() override {
+    watchdog_resets++;
+    fprintf(stderr, "sim: watchdog reset at %lluus\n", (unsigned long long)sim_now_us());
+    at((uint64_t)watchdog_timeout_ms * 1000); // Keep running, the test decides what a reset means
+  }
+} watchdog_expiry;
+
+void sim_watchdog_start(uint32_t timeout_ms) {
+  watchdog_timeout_ms = timeout_ms;
+  watchdog_expiry.at((uint64_t)timeout_ms * 1000);
+}
+
+void sim_watchdog_kick(void) {
+  if (watchdog_timeout_ms) {
+    watchdog_expiry.at((uint64_t)watchdog_timeout_ms * 1000);
+  }
+}
+
+void sim_watchdog_stop(void) {
+  watchdog_timeout_ms = 0;
+  watchdog_expiry.detach();
+}
+
+uint32_t sim_watchdog_resets(void) { return watchdog_resets; }
+
+static reset_reason_t reset_reason = RESET_REASON_POWER_ON;
+
+void sim_set_reset_reason(reset_reason_t reason) { reset_reason = reason; }
+
+reset_reason_t sim_reset_reason(void) { return reset_reason; }
+
+uint8_t *sim_flash(void) {
+  static std::vector<uint8_t> store(SIM_FLASH_SIZE, 0xFF);
+  return store.data();
+}
+
+static std::vector<bool> &torn() { // Per double word, ECC doesn't match the data
+  static std::vector<bool> words(SIM_FLASH_SIZE / 8, false);
+  return words;
+}
+
+extern "C" void NMI_Handler(void) __attribute__((weak)); // Firmware's, if it has one
+
+void sim_flash_tear(uint32_t addr) {
+  uint32_t offset = (addr - SIM_FLASH_START) & ~7u;
+  memset(sim_flash() + offset, 0x00, 3); // Some bits made it, the rest stayed erased
+  torn()[offset / 8] = true;
+}
+
+void sim_flash_reading(uint32_t addr, uint32_t size) {
+  uint32_t offset = addr - SIM_FLASH_START;
+  for (uint32_t word = offset / 8; word <= (offset + size - 1) / 8; word++) {
+    if (!torn()[word]) {
+      continue;
+    }
+    uint32_t byte = word * 8;
+    FLASH->ECCR = FLASH_ECCR_ECCD | (byte >= FLASH_BANK_SIZE ? FLASH_ECCR_BK_ECC : 0) | (byte % FLASH_BANK_SIZE);
+    if (NMI_Handler) {
+      sim_interrupt(mbed::Callback<void()>(NMI_Handler));
+    }
+    if (torn()[word]) { // The load would fault again, forever
+      fprintf(stderr, "sim: unhandled flash ECC double error at 0x%08lx\n", (unsigned long)(SIM_FLASH_START + byte));
+      sim_exit(4);
+    }
+  }
+}
+
+void sim_flash_programmed(uint32_t addr, uint32_t size) {
+  uint32_t offset = addr - SIM_FLASH_START;
+  for (uint32_t word = offset / 8; word < (offset + size) / 8; word++) {
+    torn()[word] = false;
+  }
+}
+
+// What survives a reset travels to the next process in a file named by this variable
+#define RESET_STATE "SIM_RESET_STATE"
+
+static uint32_t resets = 0;
+
+struct ResetState {
+  reset_reason_t reason;
+  uint32_t resets;
+  uint32_t backup[8]; // RTC BKP0R..BKP7R, the backup domain keeps power
+};
+
+void sim_reset(reset_reason_t reason) {
+  ResetState state = {reason, resets + 1, {}};
+  memcpy(state.backup, (const void *)&RTC->BKP0R, sizeof(state.backup));
+  char path[] = "/tmp/sim_reset_XXXXXX";
+  int fd = mkstemp(path);
+  FILE *file = fd >= 0 ? fdopen(fd, "wb") : nullptr;
+  if (!file) {
+    fprintf(stderr, "sim: can't save state for reset\n");
+    sim_exit(2);
+  }
+  std::vector<uint8_t> torn_words(torn().begin(), torn().end());
+  fwrite(&state, sizeof(state), 1, file);
+  fwrite(sim_flash(), 1, SIM_FLASH_SIZE, file);
+  fwrite(torn_words.data(), 1, torn_words.size(), file);
+  fclose(file);
+  fflush(stdout);
+  fflush(stderr);
+  setenv(RESET_STATE, path, 1);
+  execl("/proc/self/exe", "/proc/self/exe", (char *)nullptr);
+  fprintf(stderr, "sim: can't restart for reset\n");
+  sim_exit(2);
+}
+
+uint32_t sim_resets(void) { return resets; }
+
+__attribute__((constructor(102))) static void restore_after_reset(void) { // After the registers are mapped
+  const char *path = getenv(RESET_STATE);
+  if (!path) {
+    return;
+  }
+  FILE *file = fopen(path, "rb");
+  ResetState state;
+  std::vector<uint8_t> torn_words(torn().size());
+  if (!file || fread(&state, sizeof(state), 1, file) != 1 ||
+      fread(sim_flash(), 1, SIM_FLASH_SIZE, file) != SIM_FLASH_SIZE ||
+      fread(torn_words.data(), 1, torn_words.size(), file) != torn_words.size()) {
+    fprintf(stderr, "sim: can't restore state after reset\n");
+    _Exit(2);
+  }
+  fclose(file);
+  unlink(path);
+  unsetenv(RESET_STATE);
+  reset_reason = state.reason;
+  resets = state.resets;
+  memcpy((void *)&RTC->BKP0R, state.backup, sizeof(state.backup));
+  std::copy(torn_words.begin(), torn_words.end(), torn().begin());
+}
@@ -0,0 +1,664 @@
+#include "sim.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+// ---- Pins ----
+
+DigitalIn::DigitalIn(PinName pin, PinMode mode) : _pin(pin) { sim_pin_pull(pin, mode); }
+
+int DigitalIn::read() { return sim_pin_input(_pin); }
+
+void DigitalIn::mode(PinMode pull) { sim_pin_pull(_pin, pull); }
+
+DigitalOut::DigitalOut(PinName pin, int value) : _pin(pin) { sim_pin_output(pin, value); }
+
+void DigitalOut::write(int value) {
+  sim_pin_output(_pin, value);
+  sim_sync();
+}
+
+int DigitalOut::read() { return sim_pin_level(_pin); }
+
+InterruptIn::InterruptIn(PinName pin, PinMode mode) : _pin(pin), _enabled(true) {
+  sim_pin_pull(pin, mode);
+  sim_interrupt_in_add(this);
+}
+
+InterruptIn::~InterruptIn() { sim_interrupt_in_remove(this); }
+
+int InterruptIn::read() { return sim_pin_input(_pin); }
+
+void InterruptIn::rise(Callback<void()> func) { _rise = func; }
+
+void InterruptIn::fall(Callback<void()> func) { _fall = func; }
+
+void InterruptIn::mode(PinMode pull) { sim_pin_pull(_pin, pull); }
+
+void InterruptIn::enable_irq() { _enabled = true; }
+
+void InterruptIn::disable_irq() { _enabled = false; }
+
+void InterruptIn::sim_edge(int level) {
+  const Callback<void()> &handler = level ? _rise : _fall;
+  if (_enabled && handler) {
+    sim_interrupt(handler);
+  }
+}
+
+// ---- I2C, blocking: the caller spins for the bus time ----
+
+I2C::I2C(PinName sda, PinName scl) : _hz(100000) {}
+
+void I2C::frequency(int hz) { _hz = hz; }
+
+int I2C::write(int address, const char *data, int length, bool repeated) {
+  int nack = sim_i2c_write(address, data, length, _hz);
+  sim_busy_us((uint64_t)(length + 1) * 9 * 1000000 / _hz); // Address and data bytes, 9 clocks each
+  return nack;
+}
+
+int I2C::read(int address, char *data, int length, bool repeated) {
+  memset(data, 0xFF, length);
+  sim_busy_us((uint64_t)(length + 1) * 9 * 1000000 / _hz);
+  return 1;
+}
+
+void I2C::start(void) {}
+
+void I2C::stop(void) {}
+
+// ---- Timers ----
+
+TimerEvent::TimerEvent() : sim_when(0), sim_order(0), sim_armed(false) { sim_timer_add(this); }
+
+TimerEvent::~TimerEvent() { sim_timer_remove(this); }
+
+void TimerEvent::detach() { sim_armed = false; }
+
+void TimerEvent::schedule(uint64_t delay_us) {
+  sim_when = sim_now_us() + delay_us;
+  sim_order = sim_timer_order();
+  sim_armed = true;
+}
+
+void Timeout::sim_fire() {
+  if (_func) {
+    _func();
+  }
+}
+
+void Ticker::sim_fire() {
+  sim_when += _period_us; // Rearm first so the callback may detach
+  sim_order = sim_timer_order();
+  sim_armed = true;
+  if (_func) {
+    _func();
+  }
+}
+
+Timer::Timer() : _start_us(0), _banked_us(0), _running(false) {}
+
+void Timer::start() {
+  if (!_running) {
+    _start_us = sim_now_us();
+    _running = true;
+  }
+}
+
+void Timer::stop() {
+  if (_running) {
+    _banked_us += sim_now_us() - _start_us;
+    _running = false;
+  }
+}
+
+void Timer::reset() {
+  _banked_us = 0;
+  _start_us = sim_now_us();
+}
+
+std::chrono::microseconds Timer::elapsed_time() const {
+  return std::chrono::microseconds(_banked_us + (_running ? sim_now_us() - _start_us : 0));
+}
+
+// ---- Watchdog, reset reason ----
+
+static uint32_t watchdog_timeout = 0;
+
+Watchdog &Watchdog::get_instance() {
+  static Watchdog watchdog;
+  return watchdog;
+}
+
+bool Watchdog::start(uint32_t timeout) {
+  watchdog_timeout = timeout;
+  sim_watchdog_start(timeout);
+  return true;
+}
+
+bool Watchdog::start() { return start(watchdog_timeout ? watchdog_timeout : 800); }
+
+bool Watchdog::stop() {
+  watchdog_timeout = 0;
+  sim_watchdog_stop();
+  return true;
+}
+
+void Watchdog::kick() { sim_watchdog_kick(); }
+
+uint32_t Watchdog::get_timeout() const { return watchdog_timeout; }
+
+bool Watchdog::is_running() const { return watchdog_timeout != 0; }
+
+reset_reason_t ResetReason::get() { return sim_reset_reason(); }
+
+uint32_t ResetReason::get_raw() { return (uint32_t)sim_reset_reason(); }
+
+// ---- Internal flash, program and erase busy times of the L4R5 datasheet ----
+
+#define FLASH_PROGRAM_US 82  // Per 64 bit double word
+#define FLASH_ERASE_US 22000 // Per page
+
+int FlashIAP::init() { return 0; }
+
+int FlashIAP::deinit() { return 0; }
+
+static int in_flash(uint32_t addr, uint32_t size) {
+  return addr >= SIM_FLASH_START && size <= SIM_FLASH_SIZE && addr - SIM_FLASH_START <= SIM_FLASH_SIZE - size;
+}
+
+int FlashIAP::read(void *buffer, uint32_t addr, uint32_t size) {
+  if (!in_flash(addr, size)) {
+    return -1;
+  }
+  sim_flash_reading(addr, size);
+  memcpy(buffer, sim_flash() + (addr - SIM_FLASH_START), size);
+  return 0;
+}
+
+int FlashIAP::program(const void *buffer, uint32_t addr, uint32_t size) {
+  if (!in_flash(addr, size) || addr % 8 || size % 8) {
+    return -1;
+  }
+  uint8_t *cells = sim_flash() + (addr - SIM_FLASH_START);
+  const uint8_t *bytes = (const uint8_t *)buffer;
+  for (uint32_t i = 0; i < size; i++) {
+    cells[i] &= bytes[i]; // Programming only clears bits
+  }
+  sim_flash_programmed(addr, size);
+  sim_busy_us((uint64_t)size / 8 * FLASH_PROGRAM_US);
+  return 0;
+}
+
+int FlashIAP::erase(uint32_t addr, uint32_t size) {
+  if (!in_flash(addr, size) || addr % SIM_FLASH_SECTOR || size % SIM_FLASH_SECTOR) {
+    return -1;
+  }
+  memset(sim_flash() + (addr - SIM_FLASH_START), 0xFF, size);
+  sim_flash_programmed(addr, size);
+  sim_busy_us((uint64_t)size / SIM_FLASH_SECTOR * FLASH_ERASE_US);
+  return 0;
+}
+
+uint32_t FlashIAP::get_sector_size(uint32_t addr) const { return SIM_FLASH_SECTOR; }
+
+uint32_t FlashIAP::get_flash_start() const { return SIM_FLASH_START; }
+
+uint32_t FlashIAP::get_flash_size() const { return SIM_FLASH_SIZE; }
+
+uint32_t FlashIAP::get_page_size() const { return 8; }
+
+uint8_t FlashIAP::get_erase_value() const { return 0xFF; }
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void) { return HAL_OK; }
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void) { return HAL_OK; }
+
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t type, uint32_t address, uint64_t data) {
+  if (type != FLASH_TYPEPROGRAM_DOUBLEWORD || !in_flash(address, 8) || address % 8) {
+    return HAL_ERROR;
+  }
+  uint8_t *cells = sim_flash() + (address - SIM_FLASH_START);
+  uint64_t erased = ~(uint64_t)0;
+  if (data != 0 && memcmp(cells, &erased, 8)) { // Only all zeros may go over a programmed double word
+    return HAL_ERROR;
+  }
+  for (int i = 0; i < 8; i++) {
+    cells[i] &= (uint8_t)(data >> (i * 8));
+  }
+  sim_flash_programmed(address, 8);
+  sim_busy_us(FLASH_PROGRAM_US);
+  return HAL_OK;
+}
+
+FlashIAPBlockDevice::FlashIAPBlockDevice(uint32_t address, uint32_t size)
+    : _base(address == 0xFFFFFFFF ? MBED_APP_START + MBED_APP_SIZE : address),
+      _size(size ? size : SIM_FLASH_START + SIM_FLASH_SIZE - _base) {}
+
+int FlashIAPBlockDevice::init() { return _flash.init(); }
+
+int FlashIAPBlockDevice::deinit() { return _flash.deinit(); }
+
+int FlashIAPBlockDevice::read(void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size) {
+  return addr + size > _size ? -1 : _flash.read(buffer, _base + (uint32_t)addr, (uint32_t)size);
+}
+
+int FlashIAPBlockDevice::program(const void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size) {
+  return addr + size > _size ? -1 : _flash.program(buffer, _base + (uint32_t)addr, (uint32_t)size);
+}
+
+int FlashIAPBlockDevice::erase(mbed::bd_addr_t addr, mbed::bd_size_t size) {
+  return addr + size > _size ? -1 : _flash.erase(_base + (uint32_t)addr, (uint32_t)size);
+}
+
+mbed::bd_size_t FlashIAPBlockDevice::get_erase_size() const { return SIM_FLASH_SECTOR; }
+
+// ---- Serial, interrupt driven asynchronous write ----
+
+SerialBase::SerialBase(PinName tx, PinName rx, int baud)
+    : _tx(tx), _rx(rx), _baud(baud), _tx_event(0), _tx_buffer(nullptr), _tx_length(0), _tx_busy(false) {
+  _tx_completion.owner = this;
+  sim_uart_add(this);
+}
+
+SerialBase::~SerialBase() { sim_uart_remove(this); }
+
+void SerialBase::baud(int baudrate) { _baud = baudrate; }
+
+int SerialBase::readable() { return sim_uart_readable(this); }
+
+int SerialBase::writeable() { return !_tx_busy; }
+
+void SerialBase::attach(Callback<void()> func, IrqType type) {
+  if (type == RxIrq) {
+    _rx_irq = func;
+  }
+}
+
+int SerialBase::write(const uint8_t *buffer, int length, const event_callback_t &callback, int event) {
+  if (_tx_busy) {
+    return -1;
+  }
+  _tx_busy = true;
+  _tx_buffer = buffer;
+  _tx_length = length;
+  _tx_callback = callback;
+  _tx_event = event;
+  _tx_completion.sim_when = sim_now_us() + (uint64_t)length * 10 * 1000000 / _baud; // 8N1
+  _tx_completion.sim_order = sim_timer_order();
+  _tx_completion.sim_armed = true;
+  return 0;
+}
+
+void SerialBase::abort_write() {
+  _tx_completion.detach();
+  _tx_busy = false;
+}
+
+void SerialBase::sim_tx_done() {
+  sim_uart_sent(this, _tx_buffer, _tx_length);
+  _tx_busy = false;
+  if (_tx_callback && (_tx_event & SERIAL_EVENT_TX_COMPLETE)) {
+    _tx_callback(SERIAL_EVENT_TX_COMPLETE);
+  }
+}
+
+void SerialBase::sim_rx_irq() {
+  if (_rx_irq) {
+    _rx_irq();
+  }
+}
+
+int SerialBase::_base_getc() {
+  int c;
+  while ((c = sim_uart_getc(this)) < 0) {
+    sim_busy_us(1000000 / _baud * 10);
+  }
+  return c;
+}
+
+int SerialBase::_base_putc(int c) {
+  uint8_t byte = (uint8_t)c;
+  sim_busy_us(1000000 / _baud * 10);
+  sim_uart_sent(this, &byte, 1);
+  return c;
+}
+
+// ---- HAL subset for the microphone and snapshot modules ----
+
+static uint16_t *adc_target = nullptr;
+static uint32_t adc_count = 0;
+
+void HAL_GPIO_Init(GPIO_TypeDef *port, GPIO_InitTypeDef *init) {
+  for (int bit = 0; bit < 16; bit++) {
+    if (init->Pin & (1u << bit)) {
+      port->MODER = (port->MODER & ~(3u << (bit * 2))) | ((init->Mode & 3) << (bit * 2));
+    }
+  }
+}
+
+HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef *adc) { return HAL_OK; }
+
+HAL_StatusTypeDef HAL_ADC_ConfigChannel(ADC_HandleTypeDef *adc, ADC_ChannelConfTypeDef *channel) { return HAL_OK; }
+
+HAL_StatusTypeDef HAL_ADCEx_Calibration_Start(ADC_HandleTypeDef *adc, uint32_t single_diff) { return HAL_OK; }
+
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef *adc, uint32_t *data, uint32_t length) {
+  adc_target = (uint16_t *)data;
+  adc_count = length;
+  sim_adc_dma(adc_target, adc_count);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *dma) { return HAL_OK; }
+
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef *timer) {
+  timer->Instance->PSC = timer->Init.Prescaler;
+  timer->Instance->ARR = timer->Init.Period;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef *timer) {
+  uint32_t timer_clock = HAL_RCC_GetPCLK1Freq();
+  if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_HCLK_DIV1) {
+    timer_clock *= 2;
+  }
+  timer->Instance->CR1 |= 1;
+  sim_adc_trigger(timer_clock / (timer->Init.Prescaler + 1) / (timer->Init.Period + 1));
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(TIM_HandleTypeDef *timer, TIM_MasterConfigTypeDef *config) {
+  return HAL_OK;
+}
+
+uint32_t HAL_RCC_GetPCLK1Freq(void) { return SystemCoreClock; }
+
+void HAL_PWR_EnableBkUpAccess(void) {}
+
+// ---- Event queue ----
+
+struct EventQueue::Queue {
+  struct Entry {
+    int id;
+    uint64_t when;
+    uint64_t period;
+    uint64_t order;
+    Callback<void()> work;
+  };
+  std::recursive_mutex lock;
+  std::vector<Entry> entries;
+  unsigned capacity;
+  int next_id = 1;
+  bool broken = false;
+
+  Entry *due(uint64_t now) { // Earliest entry due by now
+    Entry *earliest = nullptr;
+    for (Entry &entry : entries) {
+      if (entry.when <= now && (!earliest || entry.when < earliest->when ||
+                                (entry.when == earliest->when && entry.order < earliest->order))) {
+        earliest = &entry;
+      }
+    }
+    return earliest;
+  }
+
+  uint64_t next_when() {
+    uint64_t next = UINT64_MAX;
+    for (Entry &entry : entries) {
+      next = entry.when < next ? entry.when : next;
+    }
+    return next;
+  }
+
+  int run_one(uint64_t now) {
+    Callback<void()> work;
+    {
+      std::lock_guard<std::recursive_mutex> guard(lock);
+      Entry *entry = due(now);
+      if (!entry) {
+        return 0;
+      }
+      work = entry->work;
+      if (entry->period) {
+        entry->when += entry->period;
+        entry->order = sim_timer_order();
+      } else {
+        entries.erase(entries.begin() + (entry - entries.data()));
+      }
+    }
+    work();
+    return 1;
+  }
+};
+
+EventQueue::EventQueue(unsigned size, unsigned char *buffer) : _queue(new Queue) {
+  _queue->capacity = size / EVENTS_EVENT_SIZE;
+}
+
+EventQueue::~EventQueue() { delete _queue; }
+
+int EventQueue::post(Callback<void()> work, uint64_t delay_us, uint64_t period_us) {
+  std::lock_guard<std::recursive_mutex> guard(_queue->lock);
+  if (_queue->entries.size() >= _queue->capacity) {
+    return 0; // Out of event memory, as mbed reports it
+  }
+  int id = _queue->next_id++;
+  _queue->entries.push_back({id, sim_now_us() + delay_us, period_us, sim_timer_order(), work});
+  return id;
+}
+
+bool EventQueue::cancel(int id) {
+  std::lock_guard<std::recursive_mutex> guard(_queue->lock);
+  for (size_t i = 0; i < _queue->entries.size(); i++) {
+    if (_queue->entries[i].id == id) {
+      _queue->entries.erase(_queue->entries.begin() + i);
+      return true;
+    }
+  }
+  return false;
+}
+
+void EventQueue::dispatch_forever() {
+  if (!sim_in_thread()) {
+    dispatch_once();
+    return;
+  }
+  _queue->broken = false;
+  while (!_queue->broken) {
+    if (_queue->run_one(sim_now_us())) {
+      continue;
+    }
+    Queue *queue = _queue;
+    sim_block([queue] { return queue->broken || queue->next_when() <= sim_now_us(); }, _queue->next_when());
+  }
+}
+
+void EventQueue::dispatch_once() {
+  while (_queue->run_one(sim_now_us())) {
+  }
+}
+
+void EventQueue::break_dispatch() { _queue->broken = true; }
+
+unsigned EventQueue::sim_pending() const {
+  std::lock_guard<std::recursive_mutex> guard(_queue->lock);
+  return _queue->entries.size();
+}
+
+// ---- RTOS ----
+
+Kernel::Clock::time_point Kernel::Clock::now() {
+  return time_point(duration(sim_now_us() / 1000));
+}
+
+Thread::Thread(osPriority priority, uint32_t stack_size, unsigned char *stack_mem, const char *name)
+    : _priority(priority), _name(name), _thread(nullptr) {}
+
+osStatus Thread::start(Callback<void()> task) {
+  if (_thread) {
+    return osErrorResource;
+  }
+  _thread = sim_thread_create(task, _priority, _name);
+  return osOK;
+}
+
+osStatus Thread::set_priority(osPriority priority) {
+  _priority = priority;
+  if (_thread) {
+    sim_thread_set_priority(_thread, priority);
+  }
+  return osOK;
+}
+
+osPriority Thread::get_priority() const { return _thread ? sim_thread_priority(_thread) : _priority; }
+
+Mutex::Mutex() : _owner(nullptr), _count(0), _host(new std::recursive_mutex) {}
+
+Mutex::~Mutex() { delete (std::recursive_mutex *)_host; }
+
+void Mutex::lock() {
+  if (!sim_in_thread()) {
+    ((std::recursive_mutex *)_host)->lock();
+    return;
+  }
+  void *self = sim_thread_self();
+  if (_owner != self) {
+    sim_block([this] { return _owner == nullptr; }, UINT64_MAX);
+    _owner = self;
+  }
+  _count++;
+}
+
+bool Mutex::trylock() {
+  if (!sim_in_thread()) {
+    return ((std::recursive_mutex *)_host)->try_lock();
+  }
+  if (_owner && _owner != sim_thread_self()) {
+    return false;
+  }
+  _owner = sim_thread_self();
+  _count++;
+  return true;
+}
+
+void Mutex::unlock() {
+  if (!sim_in_thread()) {
+    ((std::recursive_mutex *)_host)->unlock();
+    return;
+  }
+  if (--_count == 0) {
+    _owner = nullptr;
+  }
+}
+
+// Host threads outside the simulation (stress tests) wait on this for a release
+static std::mutex semaphore_lock;
+static std::condition_variable semaphore_released;
+static std::atomic<int> host_waiters(0);
+
+Semaphore::Semaphore(int32_t count, uint16_t max_count) : _count(count), _max(max_count) {}
+
+bool Semaphore::take() {
+  int32_t count = __atomic_load_n(&_count, __ATOMIC_SEQ_CST);
+  while (count > 0) {
+    if (__atomic_compare_exchange_n(&_count, &count, count - 1, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Semaphore::acquire() { try_acquire_for(Kernel::wait_for_u32_forever); }
+
+bool Semaphore::try_acquire() { return take(); }
+
+bool Semaphore::try_acquire_for(Kernel::Clock::duration_u32 rel_time) {
+  if (take()) {
+    return true;
+  }
+  if (rel_time.count() == 0) {
+    return false;
+  }
+  if (sim_in_thread()) {
+    uint64_t deadline =
+        rel_time == Kernel::wait_for_u32_forever ? UINT64_MAX : sim_now_us() + (uint64_t)rel_time.count() * 1000;
+    return sim_block([this] { return take(); }, deadline);
+  }
+  std::unique_lock<std::mutex> lock(semaphore_lock);
+  host_waiters++;
+  bool taken = semaphore_released.wait_for(lock, std::chrono::milliseconds(rel_time.count()), [this] { return take(); });
+  host_waiters--;
+  return taken;
+}
+
+osStatus Semaphore::release() {
+  int32_t count = __atomic_load_n(&_count, __ATOMIC_SEQ_CST);
+  do {
+    if (count >= _max) {
+      return osErrorResource;
+    }
+  } while (!__atomic_compare_exchange_n(&_count, &count, count + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+  if (host_waiters) {
+    std::lock_guard<std::mutex> lock(semaphore_lock);
+    semaphore_released.notify_all();
+  }
+  return osOK;
+}
+
+EventFlags::EventFlags() : _flags(0) {}
+
+uint32_t EventFlags::set(uint32_t flags) { return __atomic_or_fetch(&_flags, flags, __ATOMIC_SEQ_CST); }
+
+uint32_t EventFlags::clear(uint32_t flags) { return __atomic_fetch_and(&_flags, ~flags, __ATOMIC_SEQ_CST); }
+
+uint32_t EventFlags::get() const { return __atomic_load_n(&_flags, __ATOMIC_SEQ_CST); }
+
+uint32_t EventFlags::wait(uint32_t flags, uint32_t millisec, bool clear, bool all) {
+  auto satisfied = [this, flags, all] {
+    uint32_t current = get();
+    return all ? (current & flags) == flags : (current & flags) != 0;
+  };
+  bool ready = satisfied();
+  if (!ready && millisec && sim_in_thread()) {
+    ready = sim_block(satisfied, millisec == osWaitForever ? UINT64_MAX : sim_now_us() + (uint64_t)millisec * 1000);
+  }
+  if (!ready) {
+    return osFlagsErrorTimeout;
+  }
+  uint32_t current = get();
+  if (clear) {
+    this->clear(flags);
+  }
+  return current;
+}
+
+uint32_t EventFlags::wait_any(uint32_t flags, uint32_t millisec, bool clear) {
+  return wait(flags, millisec, clear, false);
+}
+
+uint32_t EventFlags::wait_all(uint32_t flags, uint32_t millisec, bool clear) {
+  return wait(flags, millisec, clear, true);
+}
+
+uint32_t EventFlags::wait_any_for(uint32_t flags, Kernel::Clock::duration_u32 rel_time, bool clear) {
+  return wait(flags, rel_time.count(), clear, false);
+}
+
+uint32_t EventFlags::wait_all_for(uint32_t flags, Kernel::Clock::duration_u32 rel_time, bool clear) {
+  return wait(flags, rel_time.count(), clear, true);
+}
+
+void ThisThread::sleep_for(Kernel::Clock::duration_u32 rel_time) { thread_sleep_for(rel_time.count()); }
+
+void ThisThread::sleep_for(uint32_t millisec) { thread_sleep_for(millisec); }
+
+void ThisThread::yield() {
+  if (sim_in_thread()) {
+    sim_block(nullptr, sim_now_us() + 1); // Let equal priorities run, a tick later
+  }
+}
+
+osThreadId_t ThisThread::get_id() { return sim_thread_self(); }
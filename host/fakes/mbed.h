@@ -0,0 +1,806 @@
+/*
+ * File Purpose: Host stand-in for the parts of mbed OS 6 and the STM32L4 HAL the firmware uses
+ *
+ * Subroutines:
+ * Drivers (mbed::) - InterruptIn, DigitalIn, DigitalOut, I2C, Timeout, Ticker, Timer, Watchdog, FlashIAP, BlockDevice, SerialBase, ResetReason
+ * FlashIAPBlockDevice - Internal flash past the application image, as the FLASHIAP component provides it
+ * Events (events::) - EventQueue, plus the Event name so clashes with it show up on the host too
+ * RTOS (rtos::) - Thread, Mutex, Semaphore, EventFlags, ThisThread, Kernel::Clock
+ * Platform and CMSIS - atomics, critical sections, us_ticker_read, wait_us, NVIC vectors, cpu stats
+ * Registers - GPIO_TypeDef, RCC, FLASH, DMA1, RTC, DWT and CoreDebug at their real addresses
+ *
+ * Everything runs on the virtual clock in sim.h: time only moves when the test advances it,
+ * so a run is deterministic and as fast as the host can execute the firmware. Threads are real
+ * host threads but only one runs at a time, chosen by RTOS priority whenever the running one
+ * blocks, and interrupt callbacks run between them. The register blocks are host memory mapped
+ * at the STM32L4R5 addresses, so code that writes GPIOx->BSRR or RCC->AHB2ENR through a
+ * pointer built from the base address runs unchanged. The namespaces and using directives mirror
+ * mbed.h, so a firmware name that clashes with mbed, events or rtos fails here as on the board.
+ */
+#ifndef HOST_FAKES_MBED_H
+#define HOST_FAKES_MBED_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <type_traits>
+
+// ---- Platform ----
+
+#define MBED_CONF_PLATFORM_STDIO_BAUD_RATE 9600
+#define MBED_CONF_PLATFORM_DEFAULT_SERIAL_BAUD_RATE 9600
+#define MBED_CPU_STATS_ENABLED 1
+#define MBED_APP_START 0x08000000
+#define MBED_APP_SIZE 0x1FC000 // target.restrict_size in mbed_app.json
+
+void mbed_assert_internal(const char *expr, const char *file, int line);
+#define MBED_ASSERT(expr) ((expr) ? (void)0 : mbed_assert_internal(#expr, __FILE__, __LINE__))
+#define MBED_STATIC_ASSERT(expr, msg) static_assert(expr, msg)
+
+typedef enum {
+  PA_0 = 0x00, PA_1 = 0x01, PA_2 = 0x02, PA_3 = 0x03, PA_4 = 0x04, PA_5 = 0x05, PA_6 = 0x06, PA_7 = 0x07,
+  PA_8 = 0x08, PA_9 = 0x09, PA_10 = 0x0A, PA_11 = 0x0B, PA_12 = 0x0C, PA_13 = 0x0D, PA_14 = 0x0E, PA_15 = 0x0F,
+  PB_0 = 0x10, PB_1 = 0x11, PB_2 = 0x12, PB_3 = 0x13, PB_4 = 0x14, PB_5 = 0x15, PB_6 = 0x16, PB_7 = 0x17,
+  PB_8 = 0x18, PB_9 = 0x19, PB_10 = 0x1A, PB_11 = 0x1B, PB_12 = 0x1C, PB_13 = 0x1D, PB_14 = 0x1E, PB_15 = 0x1F,
+  PC_0 = 0x20, PC_1 = 0x21, PC_2 = 0x22, PC_3 = 0x23, PC_4 = 0x24, PC_5 = 0x25, PC_6 = 0x26, PC_7 = 0x27,
+  PC_8 = 0x28, PC_9 = 0x29, PC_10 = 0x2A, PC_11 = 0x2B, PC_12 = 0x2C, PC_13 = 0x2D, PC_14 = 0x2E, PC_15 = 0x2F,
+  PD_0 = 0x30, PD_1 = 0x31, PD_2 = 0x32, PD_3 = 0x33, PD_4 = 0x34, PD_5 = 0x35, PD_6 = 0x36, PD_7 = 0x37,
+  PD_8 = 0x38, PD_9 = 0x39, PD_10 = 0x3A, PD_11 = 0x3B, PD_12 = 0x3C, PD_13 = 0x3D, PD_14 = 0x3E, PD_15 = 0x3F,
+  PE_0 = 0x40, PE_1 = 0x41, PE_2 = 0x42, PE_3 = 0x43, PE_4 = 0x44, PE_5 = 0x45, PE_6 = 0x46, PE_7 = 0x47,
+  PE_8 = 0x48, PE_9 = 0x49, PE_10 = 0x4A, PE_11 = 0x4B, PE_12 = 0x4C, PE_13 = 0x4D, PE_14 = 0x4E, PE_15 = 0x4F,
+  PF_0 = 0x50, PF_1 = 0x51, PF_2 = 0x52, PF_3 = 0x53, PF_4 = 0x54, PF_5 = 0x55, PF_6 = 0x56, PF_7 = 0x57,
+  PF_8 = 0x58, PF_9 = 0x59, PF_10 = 0x5A, PF_11 = 0x5B, PF_12 = 0x5C, PF_13 = 0x5D, PF_14 = 0x5E, PF_15 = 0x5F,
+  PG_0 = 0x60, PG_1 = 0x61, PG_2 = 0x62, PG_3 = 0x63, PG_4 = 0x64, PG_5 = 0x65, PG_6 = 0x66, PG_7 = 0x67,
+  PG_8 = 0x68, PG_9 = 0x69, PG_10 = 0x6A, PG_11 = 0x6B, PG_12 = 0x6C, PG_13 = 0x6D, PG_14 = 0x6E, PG_15 = 0x6F,
+  PH_0 = 0x70, PH_1 = 0x71, PH_2 = 0x72, PH_3 = 0x73, PH_4 = 0x74, PH_5 = 0x75, PH_6 = 0x76, PH_7 = 0x77,
+  PH_8 = 0x78, PH_9 = 0x79, PH_10 = 0x7A, PH_11 = 0x7B, PH_12 = 0x7C, PH_13 = 0x7D, PH_14 = 0x7E, PH_15 = 0x7F,
+  PI_0 = 0x80, PI_1 = 0x81, PI_2 = 0x82, PI_3 = 0x83, PI_4 = 0x84, PI_5 = 0x85, PI_6 = 0x86, PI_7 = 0x87,
+  PI_8 = 0x88, PI_9 = 0x89, PI_10 = 0x8A, PI_11 = 0x8B, PI_12 = 0x8C, PI_13 = 0x8D, PI_14 = 0x8E, PI_15 = 0x8F,
+  NC = (int)0xFFFFFFFF,
+  USBTX = PG_7, // LPUART1 to the ST-LINK
+  USBRX = PG_8
+} PinName;
+
+enum PinMode { PullNone = 0, PullUp = 1, PullDown = 2, OpenDrain = 3, PullDefault = PullNone };
+
+uint32_t us_ticker_read(void);
+void wait_us(int us);
+void thread_sleep_for(uint32_t millisec);
+
+void core_util_critical_section_enter(void);
+void core_util_critical_section_exit(void);
+
+inline bool core_util_atomic_cas_u32(volatile uint32_t *ptr, uint32_t *expected, uint32_t desired) {
+  return __atomic_compare_exchange_n(ptr, expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+inline uint32_t core_util_atomic_load_u32(const volatile uint32_t *ptr) { return __atomic_load_n(ptr, __ATOMIC_SEQ_CST); }
+inline uint16_t core_util_atomic_load_u16(const volatile uint16_t *ptr) { return __atomic_load_n(ptr, __ATOMIC_SEQ_CST); }
+inline void core_util_atomic_store_u32(volatile uint32_t *ptr, uint32_t value) { __atomic_store_n(ptr, value, __ATOMIC_SEQ_CST); }
+inline uint32_t core_util_atomic_exchange_u32(volatile uint32_t *ptr, uint32_t value) {
+  return __atomic_exchange_n(ptr, value, __ATOMIC_SEQ_CST);
+}
+inline uint32_t core_util_atomic_incr_u32(volatile uint32_t *ptr, uint32_t delta) { return __atomic_add_fetch(ptr, delta, __ATOMIC_SEQ_CST); }
+inline uint32_t core_util_atomic_decr_u32(volatile uint32_t *ptr, uint32_t delta) { return __atomic_sub_fetch(ptr, delta, __ATOMIC_SEQ_CST); }
+inline uint32_t core_util_atomic_fetch_add_u32(volatile uint32_t *ptr, uint32_t arg) { return __atomic_fetch_add(ptr, arg, __ATOMIC_SEQ_CST); }
+inline uint32_t core_util_atomic_fetch_or_u32(volatile uint32_t *ptr, uint32_t arg) { return __atomic_fetch_or(ptr, arg, __ATOMIC_SEQ_CST); }
+inline uint32_t core_util_atomic_fetch_and_u32(volatile uint32_t *ptr, uint32_t arg) { return __atomic_fetch_and(ptr, arg, __ATOMIC_SEQ_CST); }
+
+struct mbed_stats_cpu_t {
+  uint64_t uptime;          // Time since the clock started, us
+  uint64_t idle_time;       // Time no thread or interrupt was running
+  uint64_t sleep_time;      // Idle time spent asleep, all of it on the host
+  uint64_t deep_sleep_time;
+};
+void mbed_stats_cpu_get(mbed_stats_cpu_t *stats);
+
+typedef enum {
+  RESET_REASON_POWER_ON,
+  RESET_REASON_PIN_RESET,
+  RESET_REASON_BROWN_OUT,
+  RESET_REASON_SOFTWARE,
+  RESET_REASON_WATCHDOG,
+  RESET_REASON_LOCKUP,
+  RESET_REASON_WAKE_LOW_POWER,
+  RESET_REASON_ACCESS_ERROR,
+  RESET_REASON_BOOT_ERROR,
+  RESET_REASON_MULTIPLE,
+  RESET_REASON_PLATFORM,
+  RESET_REASON_UNKNOWN
+} reset_reason_t;
+
+// ---- CMSIS-RTOS2 ----
+
+typedef enum {
+  osPriorityNone = 0,
+  osPriorityIdle = 1,
+  osPriorityLow = 8,
+  osPriorityBelowNormal = 16,
+  osPriorityNormal = 24,
+  osPriorityAboveNormal = 32,
+  osPriorityHigh = 40,
+  osPriorityRealtime = 48,
+  osPriorityISR = 56
+} osPriority_t;
+typedef osPriority_t osPriority;
+
+typedef enum { osOK = 0, osError = -1, osErrorTimeout = -2, osErrorResource = -3, osErrorParameter = -4 } osStatus_t;
+typedef osStatus_t osStatus;
+typedef void *osThreadId_t;
+
+#define osWaitForever 0xFFFFFFFFU
+#define osFlagsError 0x80000000U
+#define osFlagsErrorTimeout 0xFFFFFFFEU
+#define OS_STACK_SIZE 4096
+
+osThreadId_t osThreadGetId(void);
+osStatus_t osThreadSetPriority(osThreadId_t thread_id, osPriority_t priority);
+
+// ---- Registers, STM32L4R5 layouts and addresses ----
+
+typedef struct {
+  volatile uint32_t MODER;
+  volatile uint32_t OTYPER;
+  volatile uint32_t OSPEEDR;
+  volatile uint32_t PUPDR;
+  volatile uint32_t IDR;
+  volatile uint32_t ODR;
+  volatile uint32_t BSRR;
+  volatile uint32_t LCKR;
+  volatile uint32_t AFR[2];
+  volatile uint32_t BRR;
+} GPIO_TypeDef;
+
+typedef struct {
+  volatile uint32_t CR, ICSCR, CFGR, PLLCFGR, PLLSAI1CFGR, PLLSAI2CFGR, CIER, CIFR, CICR;
+  uint32_t RESERVED0;
+  volatile uint32_t AHB1RSTR, AHB2RSTR, AHB3RSTR;
+  uint32_t RESERVED1;
+  volatile uint32_t APB1RSTR1, APB1RSTR2, APB2RSTR;
+  uint32_t RESERVED2;
+  volatile uint32_t AHB1ENR, AHB2ENR, AHB3ENR;
+  uint32_t RESERVED3;
+  volatile uint32_t APB1ENR1, APB1ENR2, APB2ENR;
+  uint32_t RESERVED4;
+  volatile uint32_t AHB1SMENR, AHB2SMENR, AHB3SMENR;
+  uint32_t RESERVED5;
+  volatile uint32_t APB1SMENR1, APB1SMENR2, APB2SMENR;
+  uint32_t RESERVED6;
+  volatile uint32_t CCIPR;
+  uint32_t RESERVED7;
+  volatile uint32_t BDCR, CSR, CRRCR, CCIPR2;
+} RCC_TypeDef;
+
+typedef struct {
+  volatile uint32_t ISR;
+  volatile uint32_t IFCR;
+} DMA_TypeDef;
+
+typedef struct {
+  volatile uint32_t CCR, CNDTR, CPAR, CMAR;
+} DMA_Channel_TypeDef;
+
+typedef struct {
+  volatile uint32_t ISR, IER, CR, CFGR, CFGR2, SMPR1, SMPR2;
+} ADC_TypeDef;
+
+typedef struct {
+  volatile uint32_t CR1, CR2, SMCR, DIER, SR, EGR, CCMR1, CCMR2, CCER, CNT, PSC, ARR;
+} TIM_TypeDef;
+
+typedef struct {
+  volatile uint32_t TR, DR, CR, ISR, PRER, WUTR;
+  uint32_t RESERVED;
+  volatile uint32_t ALRMAR, ALRMBR, WPR, SSR, SHIFTR, TSTR, TSDR, TSSSR, CALR, TAMPCR, ALRMASSR, ALRMBSSR, OR;
+  volatile uint32_t BKP0R, BKP1R, BKP2R, BKP3R, BKP4R, BKP5R, BKP6R, BKP7R;
+} RTC_TypeDef;
+
+typedef struct {
+  volatile uint32_t ACR, PDKEYR, KEYR, OPTKEYR, SR, CR, ECCR;
+} FLASH_TypeDef;
+
+typedef struct {
+  volatile uint32_t CTRL, CYCCNT, CPICNT, EXCCNT, SLEEPCNT, LSUCNT, FOLDCNT, PCSR;
+} DWT_Type;
+
+typedef struct {
+  volatile uint32_t DHCSR, DCRSR, DCRDR, DEMCR;
+} CoreDebug_Type;
+
+#define TIM6_BASE 0x40001000UL
+#define RTC_BASE 0x40002800UL
+#define DMA1_BASE 0x40020000UL
+#define DMA1_Channel1_BASE 0x40020008UL
+#define RCC_BASE 0x40021000UL
+#define FLASH_R_BASE 0x40022000UL
+#define FLASH_BASE 0x08000000UL
+#define FLASH_BANK_SIZE 0x100000UL
+#define GPIOA_BASE 0x48000000UL
+#define GPIOB_BASE 0x48000400UL
+#define GPIOC_BASE 0x48000800UL
+#define GPIOD_BASE 0x48000C00UL
+#define GPIOE_BASE 0x48001000UL
+#define GPIOF_BASE 0x48001400UL
+#define GPIOG_BASE 0x48001800UL
+#define GPIOH_BASE 0x48001C00UL
+#define GPIOI_BASE 0x48002000UL
+#define ADC1_BASE 0x50040000UL
+#define DWT_BASE 0xE0001000UL
+#define CoreDebug_BASE 0xE000EDF0UL
+
+#define TIM6 ((TIM_TypeDef *)TIM6_BASE)
+#define RTC ((RTC_TypeDef *)RTC_BASE)
+#define DMA1 ((DMA_TypeDef *)DMA1_BASE)
+#define DMA1_Channel1 ((DMA_Channel_TypeDef *)DMA1_Channel1_BASE)
+#define RCC ((RCC_TypeDef *)RCC_BASE)
+#define FLASH ((FLASH_TypeDef *)FLASH_R_BASE)
+#define GPIOA ((GPIO_TypeDef *)GPIOA_BASE)
+#define GPIOB ((GPIO_TypeDef *)GPIOB_BASE)
+#define GPIOC ((GPIO_TypeDef *)GPIOC_BASE)
+#define GPIOD ((GPIO_TypeDef *)GPIOD_BASE)
+#define GPIOE ((GPIO_TypeDef *)GPIOE_BASE)
+#define GPIOF ((GPIO_TypeDef *)GPIOF_BASE)
+#define GPIOG ((GPIO_TypeDef *)GPIOG_BASE)
+#define GPIOH ((GPIO_TypeDef *)GPIOH_BASE)
+#define GPIOI ((GPIO_TypeDef *)GPIOI_BASE)
+#define ADC1 ((ADC_TypeDef *)ADC1_BASE)
+#define DWT ((DWT_Type *)DWT_BASE)
+#define CoreDebug ((CoreDebug_Type *)CoreDebug_BASE)
+
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+#define DWT_CTRL_CYCCNTENA_Msk (1UL << 0)
+#define RCC_CFGR_PPRE1 (0x7UL << 8)
+#define RCC_HCLK_DIV1 0x0UL
+#define FLASH_ECCR_ADDR_ECC 0x1FFFFFUL
+#define FLASH_ECCR_BK_ECC (1UL << 21)
+#define FLASH_ECCR_ECCD (1UL << 31)
+#define DMA_ISR_GIF1 (1UL << 0)
+#define DMA_ISR_TCIF1 (1UL << 1)
+#define DMA_ISR_HTIF1 (1UL << 2)
+#define DMA_ISR_TEIF1 (1UL << 3)
+#define DMA_IFCR_CGIF1 (1UL << 0)
+#define DMA_IFCR_CTCIF1 (1UL << 1)
+#define DMA_IFCR_CHTIF1 (1UL << 2)
+#define DMA_IFCR_CTEIF1 (1UL << 3)
+
+extern uint32_t SystemCoreClock;
+
+// ---- NVIC and HAL subset used by the microphone and snapshot modules ----
+
+typedef enum { DMA1_Channel1_IRQn = 11, TIM6_DAC_IRQn = 54, IRQ_COUNT = 112 } IRQn_Type;
+
+void NVIC_SetVector(IRQn_Type irq, uintptr_t vector); // uint32_t on the board, wide enough for a host pointer
+uintptr_t NVIC_GetVector(IRQn_Type irq);
+void HAL_NVIC_SetPriority(IRQn_Type irq, uint32_t preempt, uint32_t sub);
+void HAL_NVIC_EnableIRQ(IRQn_Type irq);
+
+typedef enum { HAL_OK = 0, HAL_ERROR, HAL_BUSY, HAL_TIMEOUT } HAL_StatusTypeDef;
+
+#define DISABLE 0
+#define ENABLE 1
+
+typedef struct {
+  uint32_t Pin, Mode, Pull, Speed, Alternate;
+} GPIO_InitTypeDef;
+
+typedef struct {
+  uint32_t ClockPrescaler, Resolution, DataAlign, ScanConvMode, EOCSelection, LowPowerAutoWait,
+      ContinuousConvMode, NbrOfConversion, DiscontinuousConvMode, NbrOfDiscConversion,
+      ExternalTrigConv, ExternalTrigConvEdge, DMAContinuousRequests, Overrun, OversamplingMode;
+} ADC_InitTypeDef;
+
+typedef struct {
+  uint32_t Request, Direction, PeriphInc, MemInc, PeriphDataAlignment, MemDataAlignment, Mode, Priority;
+} DMA_InitTypeDef;
+
+typedef struct {
+  DMA_Channel_TypeDef *Instance;
+  DMA_InitTypeDef Init;
+  void *Parent;
+} DMA_HandleTypeDef;
+
+typedef struct {
+  ADC_TypeDef *Instance;
+  ADC_InitTypeDef Init;
+  DMA_HandleTypeDef *DMA_Handle;
+} ADC_HandleTypeDef;
+
+typedef struct {
+  uint32_t Channel, Rank, SamplingTime, SingleDiff, OffsetNumber, Offset;
+} ADC_ChannelConfTypeDef;
+
+typedef struct {
+  uint32_t Prescaler, CounterMode, Period, ClockDivision, RepetitionCounter, AutoReloadPreload;
+} TIM_Base_InitTypeDef;
+
+typedef struct {
+  TIM_TypeDef *Instance;
+  TIM_Base_InitTypeDef Init;
+} TIM_HandleTypeDef;
+
+typedef struct {
+  uint32_t MasterOutputTrigger, MasterOutputTrigger2, MasterSlaveMode;
+} TIM_MasterConfigTypeDef;
+
+#define GPIO_PIN_4 ((uint16_t)0x0010)
+#define GPIO_MODE_ANALOG 0x3U
+#define GPIO_NOPULL 0x0U
+#define ADC_CLOCK_ASYNC_DIV4 0x2U
+#define ADC_RESOLUTION_12B 0x0U
+#define ADC_DATAALIGN_RIGHT 0x0U
+#define ADC_SCAN_DISABLE 0x0U
+#define ADC_EOC_SINGLE_CONV 0x4U
+#define ADC_EXTERNALTRIG_T6_TRGO 0x34U
+#define ADC_EXTERNALTRIGCONVEDGE_RISING 0x400U
+#define ADC_OVR_DATA_OVERWRITTEN 0x1000U
+#define ADC_CHANNEL_13 13U
+#define ADC_REGULAR_RANK_1 0x6U
+#define ADC_SAMPLETIME_47CYCLES_5 0x4U
+#define ADC_SINGLE_ENDED 0x7FU
+#define ADC_OFFSET_NONE 0x4U
+#define DMA_REQUEST_ADC1 5U
+#define DMA_PERIPH_TO_MEMORY 0x0U
+#define DMA_PINC_DISABLE 0x0U
+#define DMA_MINC_ENABLE 0x80U
+#define DMA_PDATAALIGN_HALFWORD 0x100U
+#define DMA_MDATAALIGN_HALFWORD 0x400U
+#define DMA_CIRCULAR 0x20U
+#define DMA_PRIORITY_MEDIUM 0x1000U
+#define TIM_COUNTERMODE_UP 0x0U
+#define TIM_AUTORELOAD_PRELOAD_DISABLE 0x0U
+#define TIM_TRGO_UPDATE 0x20U
+#define TIM_MASTERSLAVEMODE_DISABLE 0x0U
+#define RCC_ADCCLKSOURCE_SYSCLK (0x3UL << 28)
+
+#define __HAL_RCC_GPIOC_CLK_ENABLE() (RCC->AHB2ENR |= 1UL << 2)
+#define __HAL_RCC_ADC_CLK_ENABLE() (RCC->AHB2ENR |= 1UL << 13)
+#define __HAL_RCC_DMA1_CLK_ENABLE() (RCC->AHB1ENR |= 1UL << 0)
+#define __HAL_RCC_DMAMUX1_CLK_ENABLE() (RCC->AHB1ENR |= 1UL << 2)
+#define __HAL_RCC_TIM6_CLK_ENABLE() (RCC->APB1ENR1 |= 1UL << 4)
+#define __HAL_RCC_PWR_CLK_ENABLE() (RCC->APB1ENR1 |= 1UL << 28)
+#define __HAL_RCC_RTCAPB_CLK_ENABLE() (RCC->APB1ENR1 |= 1UL << 10)
+#define __HAL_RCC_ADC_CONFIG(source) (RCC->CCIPR = (RCC->CCIPR & ~(0x3UL << 28)) | (source))
+#define __HAL_LINKDMA(handle, field, dma) ((handle)->field = &(dma), (dma).Parent = (handle))
+
+void HAL_GPIO_Init(GPIO_TypeDef *port, GPIO_InitTypeDef *init);
+HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef *adc);
+HAL_StatusTypeDef HAL_ADC_ConfigChannel(ADC_HandleTypeDef *adc, ADC_ChannelConfTypeDef *channel);
+HAL_StatusTypeDef HAL_ADCEx_Calibration_Start(ADC_HandleTypeDef *adc, uint32_t single_diff);
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef *adc, uint32_t *data, uint32_t length);
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *dma);
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef *timer);
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef *timer);
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(TIM_HandleTypeDef *timer, TIM_MasterConfigTypeDef *config);
+uint32_t HAL_RCC_GetPCLK1Freq(void);
+void HAL_PWR_EnableBkUpAccess(void);
+
+#define FLASH_TYPEPROGRAM_DOUBLEWORD 0x0U
+HAL_StatusTypeDef HAL_FLASH_Unlock(void);
+HAL_StatusTypeDef HAL_FLASH_Lock(void);
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t type, uint32_t address, uint64_t data);
+
+// ---- mbed drivers ----
+
+namespace mbed {
+
+template <typename F> class Callback;
+
+template <typename R, typename... ArgTs> class Callback<R(ArgTs...)> {
+public:
+  Callback() {}
+  Callback(std::nullptr_t) {}
+  Callback(R (*func)(ArgTs...)) {
+    if (func) {
+      _f = func;
+    }
+  }
+  template <typename T, typename U>
+  Callback(U *obj, R (T::*method)(ArgTs...)) : _f([obj, method](ArgTs... args) { return (obj->*method)(args...); }) {}
+  template <typename T, typename U>
+  Callback(R (*func)(T *, ArgTs...), U *arg) : _f([func, arg](ArgTs... args) { return func(arg, args...); }) {}
+  template <typename F, typename = typename std::enable_if<
+                            !std::is_same<typename std::decay<F>::type, Callback>::value &&
+                            !std::is_pointer<typename std::decay<F>::type>::value>::type>
+  Callback(F func) : _f(std::move(func)) {}
+
+  R call(ArgTs... args) const { return _f(args...); }
+  R operator()(ArgTs... args) const { return _f(args...); }
+  explicit operator bool() const { return (bool)_f; }
+
+private:
+  std::function<R(ArgTs...)> _f;
+};
+
+template <typename R, typename... ArgTs> Callback<R(ArgTs...)> callback(R (*func)(ArgTs...)) {
+  return Callback<R(ArgTs...)>(func);
+}
+template <typename T, typename U, typename R, typename... ArgTs>
+Callback<R(ArgTs...)> callback(U *obj, R (T::*method)(ArgTs...)) {
+  return Callback<R(ArgTs...)>(obj, method);
+}
+template <typename T, typename U, typename R, typename... ArgTs>
+Callback<R(ArgTs...)> callback(R (*func)(T *, ArgTs...), U *arg) {
+  return Callback<R(ArgTs...)>(func, arg);
+}
+
+class DigitalIn {
+public:
+  DigitalIn(PinName pin, PinMode mode = PullDefault);
+  int read();
+  void mode(PinMode pull);
+  operator int() { return read(); }
+
+protected:
+  PinName _pin;
+};
+
+class DigitalOut {
+public:
+  DigitalOut(PinName pin, int value = 0);
+  void write(int value);
+  int read();
+  DigitalOut &operator=(int value) {
+    write(value);
+    return *this;
+  }
+  DigitalOut &operator=(DigitalOut &rhs) {
+    write(rhs.read());
+    return *this;
+  }
+  operator int() { return read(); }
+
+private:
+  PinName _pin;
+};
+
+class InterruptIn {
+public:
+  InterruptIn(PinName pin, PinMode mode = PullDefault);
+  ~InterruptIn();
+  int read();
+  operator int() { return read(); }
+  void rise(Callback<void()> func);
+  void fall(Callback<void()> func);
+  void mode(PinMode pull);
+  void enable_irq();
+  void disable_irq();
+
+  // Called by the simulator when the pin level changes, in interrupt context
+  void sim_edge(int level);
+  PinName sim_pin() const { return _pin; }
+
+private:
+  PinName _pin;
+  Callback<void()> _rise;
+  Callback<void()> _fall;
+  bool _enabled;
+};
+
+class I2C {
+public:
+  enum Acknowledge { NoACK = 0, ACK = 1 };
+  I2C(PinName sda, PinName scl);
+  void frequency(int hz);
+  int write(int address, const char *data, int length, bool repeated = false);
+  int read(int address, char *data, int length, bool repeated = false);
+  void start(void);
+  void stop(void);
+
+private:
+  int _hz;
+};
+
+// One-shot or periodic interrupt callback on the virtual clock
+class TimerEvent {
+public:
+  TimerEvent();
+  virtual ~TimerEvent();
+  void detach();
+
+  // Simulator bookkeeping
+  uint64_t sim_when;
+  uint64_t sim_order;
+  bool sim_armed;
+  virtual void sim_fire() = 0;
+  virtual bool sim_interrupt() const { return true; } // false for events of the world outside the MCU
+
+protected:
+  void schedule(uint64_t delay_us);
+};
+
+class Timeout : public TimerEvent {
+public:
+  void attach(Callback<void()> func, std::chrono::microseconds t) {
+    _func = func;
+    schedule(t.count());
+  }
+  void attach_us(Callback<void()> func, uint64_t t) { attach(func, std::chrono::microseconds(t)); }
+  void sim_fire() override;
+
+protected:
+  Callback<void()> _func;
+};
+
+class Ticker : public TimerEvent {
+public:
+  void attach(Callback<void()> func, std::chrono::microseconds t) {
+    _func = func;
+    _period_us = t.count();
+    schedule(_period_us);
+  }
+  void attach_us(Callback<void()> func, uint64_t t) { attach(func, std::chrono::microseconds(t)); }
+  void sim_fire() override;
+
+private:
+  Callback<void()> _func;
+  uint64_t _period_us;
+};
+
+class Timer { // Only here so a firmware Timer clashes on the host as it does on the board
+public:
+  Timer();
+  void start();
+  void stop();
+  void reset();
+  std::chrono::microseconds elapsed_time() const;
+
+private:
+  uint64_t _start_us;
+  uint64_t _banked_us;
+  bool _running;
+};
+
+class Watchdog {
+public:
+  static Watchdog &get_instance();
+  bool start(uint32_t timeout);
+  bool start();
+  bool stop();
+  void kick();
+  uint32_t get_timeout() const;
+  bool is_running() const;
+
+private:
+  Watchdog() {}
+};
+
+class ResetReason {
+public:
+  static reset_reason_t get();
+  static uint32_t get_raw();
+};
+
+class FlashIAP {
+public:
+  int init();
+  int deinit();
+  int read(void *buffer, uint32_t addr, uint32_t size);
+  int program(const void *buffer, uint32_t addr, uint32_t size);
+  int erase(uint32_t addr, uint32_t size);
+  uint32_t get_sector_size(uint32_t addr) const;
+  uint32_t get_flash_start() const;
+  uint32_t get_flash_size() const;
+  uint32_t get_page_size() const;
+  uint8_t get_erase_value() const;
+};
+
+typedef uint64_t bd_addr_t;
+typedef uint64_t bd_size_t;
+
+class BlockDevice {
+public:
+  virtual ~BlockDevice() {}
+  virtual int init() = 0;
+  virtual int deinit() = 0;
+  virtual int read(void *buffer, bd_addr_t addr, bd_size_t size) = 0;
+  virtual int program(const void *buffer, bd_addr_t addr, bd_size_t size) = 0;
+  virtual int erase(bd_addr_t addr, bd_size_t size) { return 0; }
+  virtual bd_size_t get_read_size() const = 0;
+  virtual bd_size_t get_program_size() const = 0;
+  virtual bd_size_t get_erase_size() const { return get_program_size(); }
+  virtual int get_erase_value() const { return -1; }
+  virtual bd_size_t size() const = 0;
+};
+
+typedef Callback<void(int)> event_callback_t;
+
+#define SERIAL_EVENT_TX_COMPLETE (1 << 1)
+#define SERIAL_EVENT_TX_ALL SERIAL_EVENT_TX_COMPLETE
+#define SERIAL_EVENT_RX_COMPLETE (1 << 8)
+
+class SerialBase {
+public:
+  enum IrqType { RxIrq = 0, TxIrq, IrqCnt };
+  void baud(int baudrate);
+  int readable();
+  int writeable();
+  void attach(Callback<void()> func, IrqType type = RxIrq);
+  int write(const uint8_t *buffer, int length, const event_callback_t &callback,
+            int event = SERIAL_EVENT_TX_COMPLETE);
+  void abort_write();
+
+  // Simulator side of the wire
+  PinName sim_tx() const { return _tx; }
+  PinName sim_rx() const { return _rx; }
+  int sim_baud() const { return _baud; }
+  void sim_rx_irq();
+  void sim_tx_done();
+
+protected:
+  SerialBase(PinName tx, PinName rx, int baud = MBED_CONF_PLATFORM_DEFAULT_SERIAL_BAUD_RATE);
+  virtual ~SerialBase();
+  int _base_getc();
+  int _base_putc(int c);
+
+private:
+  PinName _tx;
+  PinName _rx;
+  int _baud;
+  Callback<void()> _rx_irq;
+  event_callback_t _tx_callback;
+  int _tx_event;
+  const uint8_t *_tx_buffer;
+  int _tx_length;
+  bool _tx_busy;
+  struct Completion : TimerEvent {
+    SerialBase *owner;
+    void sim_fire() override { owner->sim_tx_done(); }
+  } _tx_completion;
+};
+
+} // namespace mbed
+
+// Internal flash from address on; the defaults cover the flash past the application image,
+// which target.restrict_size in mbed_app.json keeps free
+class FlashIAPBlockDevice : public mbed::BlockDevice {
+public:
+  FlashIAPBlockDevice(uint32_t address = 0xFFFFFFFF, uint32_t size = 0);
+  int init() override;
+  int deinit() override;
+  int read(void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size) override;
+  int program(const void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size) override;
+  int erase(mbed::bd_addr_t addr, mbed::bd_size_t size) override;
+  mbed::bd_size_t get_read_size() const override { return 1; }
+  mbed::bd_size_t get_program_size() const override { return 8; }
+  mbed::bd_size_t get_erase_size() const override;
+  int get_erase_value() const override { return 0xFF; }
+  mbed::bd_size_t size() const override { return _size; }
+
+private:
+  mbed::FlashIAP _flash;
+  uint32_t _base;
+  uint32_t _size;
+};
+
+// ---- mbed events ----
+
+#define EVENTS_EVENT_SIZE 64
+#define EVENTS_QUEUE_SIZE (32 * EVENTS_EVENT_SIZE)
+
+namespace events {
+
+template <typename F> class Event; // Declared so the name clashes as it does with mbed.h
+
+class EventQueue {
+public:
+  EventQueue(unsigned size = EVENTS_QUEUE_SIZE, unsigned char *buffer = NULL);
+  ~EventQueue();
+
+  template <typename F, typename... ArgTs> int call(F f, ArgTs... args) {
+    return post(mbed::Callback<void()>([=]() { f(args...); }), 0, 0);
+  }
+  template <typename F, typename... ArgTs> int call_in(std::chrono::milliseconds ms, F f, ArgTs... args) {
+    return post(mbed::Callback<void()>([=]() { f(args...); }), ms.count() * 1000, 0);
+  }
+  template <typename F, typename... ArgTs> int call_every(std::chrono::milliseconds ms, F f, ArgTs... args) {
+    return post(mbed::Callback<void()>([=]() { f(args...); }), ms.count() * 1000, ms.count() * 1000);
+  }
+  bool cancel(int id);
+  void dispatch_forever();
+  void dispatch_once(); // Run everything due now without blocking
+  void break_dispatch();
+  unsigned sim_pending() const;
+
+private:
+  int post(mbed::Callback<void()> work, uint64_t delay_us, uint64_t period_us);
+  struct Queue;
+  Queue *_queue;
+};
+
+} // namespace events
+
+// ---- mbed RTOS ----
+
+namespace rtos {
+
+namespace Kernel {
+struct Clock {
+  typedef std::chrono::milliseconds duration;
+  typedef duration::rep rep;
+  typedef duration::period period;
+  typedef std::chrono::time_point<Clock> time_point;
+  typedef std::chrono::duration<uint32_t, std::milli> duration_u32;
+  static constexpr bool is_steady = true;
+  static time_point now();
+};
+constexpr Clock::duration_u32 wait_for_u32_forever{osWaitForever};
+} // namespace Kernel
+
+class Thread {
+public:
+  Thread(osPriority priority = osPriorityNormal, uint32_t stack_size = OS_STACK_SIZE,
+         unsigned char *stack_mem = nullptr, const char *name = nullptr);
+  osStatus start(mbed::Callback<void()> task);
+  osStatus set_priority(osPriority priority);
+  osPriority get_priority() const;
+  osThreadId_t get_id() const { return _thread; }
+  const char *get_name() const { return _name; }
+
+private:
+  osPriority _priority;
+  const char *_name;
+  osThreadId_t _thread;
+};
+
+class Mutex {
+public:
+  Mutex();
+  ~Mutex();
+  void lock();
+  bool trylock();
+  void unlock();
+
+private:
+  osThreadId_t _owner;
+  uint32_t _count;
+  void *_host; // Lock for callers that aren't simulated threads
+};
+
+class Semaphore {
+public:
+  Semaphore(int32_t count = 0, uint16_t max_count = 0xFFFF);
+  void acquire();
+  bool try_acquire();
+  bool try_acquire_for(Kernel::Clock::duration_u32 rel_time);
+  osStatus release();
+
+private:
+  bool take();
+  volatile int32_t _count;
+  int32_t _max;
+};
+
+class EventFlags {
+public:
+  EventFlags();
+  uint32_t set(uint32_t flags);
+  uint32_t clear(uint32_t flags = 0x7fffffff);
+  uint32_t get() const;
+  uint32_t wait_any(uint32_t flags = 0, uint32_t millisec = osWaitForever, bool clear = true);
+  uint32_t wait_all(uint32_t flags = 0, uint32_t millisec = osWaitForever, bool clear = true);
+  uint32_t wait_any_for(uint32_t flags, Kernel::Clock::duration_u32 rel_time, bool clear = true);
+  uint32_t wait_all_for(uint32_t flags, Kernel::Clock::duration_u32 rel_time, bool clear = true);
+
+private:
+  uint32_t wait(uint32_t flags, uint32_t millisec, bool clear, bool all);
+  volatile uint32_t _flags;
+};
+
+namespace ThisThread {
+void sleep_for(Kernel::Clock::duration_u32 rel_time);
+void sleep_for(uint32_t millisec);
+void yield();
+osThreadId_t get_id();
+} // namespace ThisThread
+
+} // namespace rtos
+
+using namespace mbed;
+using namespace events;
+using namespace rtos;
+using namespace std;
+
+#endif
@@ -0,0 +1,366 @@
+#include "sim.h"
+#include <condition_variable>
+#include <mutex>
+#include <sys/mman.h>
+#include <thread>
+#include <vector>
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+struct SimThread {
+  mbed::Callback<void()> entry;
+  osPriority priority;
+  const char *name;
+  std::condition_variable wake;
+  bool resumed = false;  // Scheduler handed this thread the CPU
+  bool finished = false;
+  bool blocked = false;
+  bool spinning = false; // Busy waiting, only higher priorities may run meanwhile
+  bool woke_ready = false;
+  const std::function<bool()> *ready = nullptr;
+  uint64_t deadline = UINT64_MAX;
+  uint64_t last_run = 0; // Round robin among equal priorities
+};
+
+// Peripheral blocks the firmware reaches through fixed addresses
+static const struct {
+  uintptr_t start;
+  size_t length;
+} register_regions[] = {
+    {0x40000000, 0x30000},  // APB1, APB2, AHB1: TIM6, RTC, DMA1, RCC
+    {0x48000000, 0x3000},   // AHB2 GPIOA..GPIOI
+    {0x50040000, 0x1000},   // ADC1
+    {0xE0000000, 0x100000}, // Private peripheral bus: DWT, NVIC, CoreDebug
+};
+
+static std::mutex handoff;
+static std::condition_variable driver_wake;
+static bool driver_turn = true;
+static thread_local SimThread *self = nullptr;
+static uint64_t run_counter = 0;
+static uint64_t now_us = 0;
+static uint64_t busy_us = 0;
+static uint32_t wakeups = 0;
+static int isr_depth = 0;
+static uint64_t timer_counter = 0;
+static uintptr_t vectors[IRQ_COUNT];
+static std::recursive_mutex critical;
+
+uint32_t SystemCoreClock = SIM_CORE_HZ;
+
+static std::vector<SimThread *> &threads() {
+  static std::vector<SimThread *> list;
+  return list;
+}
+
+static std::vector<mbed::TimerEvent *> &timers() { // Constructed before any static Timeout
+  static std::vector<mbed::TimerEvent *> list;
+  return list;
+}
+
+__attribute__((constructor(101))) static void map_registers(void) {
+  for (const auto &region : register_regions) {
+    void *mapped = mmap((void *)region.start, region.length, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (mapped != (void *)region.start) {
+      fprintf(stderr, "sim: can't map registers at 0x%lx\n", (unsigned long)region.start);
+      _Exit(2);
+    }
+  }
+}
+
+static void set_now(uint64_t t) {
+  now_us = t;
+  DWT->CYCCNT = (uint32_t)(t * (SIM_CORE_HZ / 1000000));
+}
+
+// ---- Scheduler ----
+
+static bool runnable(const SimThread *thread) {
+  return !thread->blocked || thread->deadline <= now_us ||
+         (!thread->spinning && thread->ready && (*thread->ready)());
+}
+
+static SimThread *pick(void) {
+  int floor = -1; // Threads at or below a spinning thread's priority can't run
+  for (SimThread *thread : threads()) {
+    if (thread->spinning && !thread->finished && thread->priority > floor) {
+      floor = thread->priority;
+    }
+  }
+  SimThread *best = nullptr;
+  for (SimThread *thread : threads()) {
+    if (thread->finished || !runnable(thread)) {
+      continue;
+    }
+    if (thread->priority <= floor && !(thread->spinning && thread->deadline <= now_us)) {
+      continue;
+    }
+    if (!best || thread->priority > best->priority ||
+        (thread->priority == best->priority && thread->last_run < best->last_run)) {
+      best = thread;
+    }
+  }
+  return best;
+}
+
+static void run(SimThread *thread) {
+  thread->woke_ready = !thread->blocked || (!thread->spinning && thread->ready && (*thread->ready)());
+  if (thread->blocked && !thread->woke_ready && !thread->spinning) {
+    wakeups++; // Timed wake, the kernel's timer interrupt
+  }
+  thread->last_run = ++run_counter;
+  std::unique_lock<std::mutex> lock(handoff);
+  driver_turn = false;
+  thread->resumed = true;
+  thread->wake.notify_one();
+  driver_wake.wait(lock, [] { return driver_turn; });
+  lock.unlock();
+  sim_sync();
+}
+
+void sim_settle(void) {
+  while (SimThread *thread = pick()) {
+    run(thread);
+  }
+}
+
+static int give_up_cpu(SimThread *thread) {
+  std::unique_lock<std::mutex> lock(handoff);
+  driver_turn = true;
+  driver_wake.notify_one();
+  thread->wake.wait(lock, [thread] { return thread->resumed; });
+  thread->resumed = false;
+  thread->blocked = false;
+  thread->spinning = false;
+  thread->ready = nullptr;
+  thread->deadline = UINT64_MAX;
+  return thread->woke_ready;
+}
+
+int sim_block(const std::function<bool()> &ready, uint64_t deadline_us) {
+  SimThread *thread = self;
+  if (ready && ready()) {
+    return 1;
+  }
+  if (deadline_us <= now_us) {
+    return 0;
+  }
+  thread->ready = ready ? &ready : nullptr;
+  thread->deadline = deadline_us;
+  thread->blocked = true;
+  return give_up_cpu(thread);
+}
+
+void sim_busy_us(uint64_t us) {
+  busy_us += us;
+  if (isr_depth) {
+    set_now(now_us + us); // Timers due meanwhile fire once the interrupt returns
+  } else if (self) {
+    self->deadline = now_us + us;
+    self->blocked = true;
+    self->spinning = true;
+    give_up_cpu(self);
+  } else {
+    busy_us -= us; // Driver waiting, counted as spin only when firmware code does it
+    sim_advance_us(us);
+  }
+}
+
+void *sim_thread_create(mbed::Callback<void()> entry, osPriority priority, const char *name) {
+  SimThread *thread = new SimThread;
+  thread->entry = entry;
+  thread->priority = priority;
+  thread->name = name;
+  threads().push_back(thread);
+  std::thread([thread] {
+    {
+      std::unique_lock<std::mutex> lock(handoff);
+      thread->wake.wait(lock, [thread] { return thread->resumed; });
+      thread->resumed = false;
+    }
+    self = thread;
+    thread->entry();
+    std::unique_lock<std::mutex> lock(handoff);
+    thread->finished = true;
+    driver_turn = true;
+    driver_wake.notify_one();
+  }).detach();
+  return thread;
+}
+
+void sim_thread_set_priority(void *thread, osPriority priority) {
+  ((SimThread *)thread)->priority = priority;
+}
+
+osPriority sim_thread_priority(void *thread) { return ((SimThread *)thread)->priority; }
+
+void *sim_thread_self(void) { return self; }
+
+int sim_in_thread(void) { return self != nullptr; }
+
+int sim_in_isr(void) { return isr_depth > 0; }
+
+void sim_boot(void (*entry)(void)) {
+  sim_thread_create(entry, osPriorityNormal, "main");
+  sim_settle();
+}
+
+// ---- Virtual clock ----
+
+uint64_t sim_now_us(void) { return now_us; }
+
+void sim_timer_add(mbed::TimerEvent *event) { timers().push_back(event); }
+
+void sim_timer_remove(mbed::TimerEvent *event) {
+  std::vector<mbed::TimerEvent *> &list = timers();
+  for (size_t i = 0; i < list.size(); i++) {
+    if (list[i] == event) {
+      list.erase(list.begin() + i);
+      return;
+    }
+  }
+}
+
+uint64_t sim_timer_order(void) { return ++timer_counter; }
+
+static mbed::TimerEvent *earliest_timer(void) {
+  mbed::TimerEvent *earliest = nullptr;
+  for (mbed::TimerEvent *event : timers()) {
+    if (event->sim_armed &&
+        (!earliest || event->sim_when < earliest->sim_when ||
+         (event->sim_when == earliest->sim_when && event->sim_order < earliest->sim_order))) {
+      earliest = event;
+    }
+  }
+  return earliest;
+}
+
+static void fire_due(void) {
+  while (mbed::TimerEvent *event = earliest_timer()) {
+    if (event->sim_when > now_us) {
+      return;
+    }
+    event->sim_armed = false;
+    if (event->sim_interrupt()) {
+      wakeups++;
+      isr_depth++;
+      event->sim_fire();
+      isr_depth--;
+    } else {
+      event->sim_fire();
+    }
+    sim_sync();
+  }
+}
+
+static uint64_t next_event(void) {
+  uint64_t next = UINT64_MAX;
+  if (mbed::TimerEvent *event = earliest_timer()) {
+    next = event->sim_when > now_us ? event->sim_when : now_us;
+  }
+  for (SimThread *thread : threads()) {
+    if (!thread->finished && thread->blocked && thread->deadline > now_us && thread->deadline < next) {
+      next = thread->deadline;
+    }
+  }
+  return next;
+}
+
+void sim_advance_us(uint64_t us) {
+  uint64_t end = now_us + us;
+  while (1) {
+    sim_settle();
+    uint64_t next = next_event();
+    if (next > end) {
+      break;
+    }
+    set_now(next);
+    fire_due();
+  }
+  set_now(end);
+  sim_settle();
+}
+
+void sim_advance_ms(uint32_t ms) { sim_advance_us((uint64_t)ms * 1000); }
+
+uint32_t sim_wakeups(void) { return wakeups; }
+
+void sim_exit(int status) {
+  fflush(stdout);
+  fflush(stderr);
+  _Exit(status);
+}
+
+// ---- Interrupts ----
+
+void NVIC_SetVector(IRQn_Type irq, uintptr_t vector) { vectors[irq] = vector; }
+
+uintptr_t NVIC_GetVector(IRQn_Type irq) { return vectors[irq]; }
+
+void HAL_NVIC_SetPriority(IRQn_Type irq, uint32_t preempt, uint32_t sub) {}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type irq) {}
+
+void sim_irq(IRQn_Type irq) {
+  if (!vectors[irq]) {
+    return;
+  }
+  wakeups++;
+  isr_depth++;
+  ((void (*)(void))vectors[irq])();
+  isr_depth--;
+  sim_sync();
+  if (!self && !isr_depth) {
+    sim_settle();
+  }
+}
+
+void sim_interrupt(const mbed::Callback<void()> &handler) { // Pin edges and UART receive
+  wakeups++;
+  isr_depth++;
+  handler();
+  isr_depth--;
+}
+
+void core_util_critical_section_enter(void) { critical.lock(); }
+
+void core_util_critical_section_exit(void) { critical.unlock(); }
+
+// ---- Platform ----
+
+uint32_t us_ticker_read(void) { return (uint32_t)now_us; }
+
+void wait_us(int us) { sim_busy_us(us); }
+
+void thread_sleep_for(uint32_t millisec) {
+  if (self) {
+    sim_block(nullptr, now_us + (uint64_t)millisec * 1000);
+  } else {
+    sim_advance_us((uint64_t)millisec * 1000);
+  }
+}
+
+void mbed_assert_internal(const char *expr, const char *file, int line) {
+  fprintf(stderr, "mbed assertation failed: %s, file: %s, line %d\n", expr, file, line);
+  sim_exit(3);
+}
+
+void mbed_stats_cpu_get(mbed_stats_cpu_t *stats) {
+  stats->uptime = now_us;
+  stats->idle_time = now_us - busy_us;
+  stats->sleep_time = stats->idle_time;
+  stats->deep_sleep_time = 0;
+}
+
+osThreadId_t osThreadGetId(void) { return self; }
+
+osStatus_t osThreadSetPriority(osThreadId_t thread_id, osPriority_t priority) {
+  if (!thread_id) {
+    return osErrorParameter;
+  }
+  sim_thread_set_priority(thread_id, priority);
+  return osOK;
+}
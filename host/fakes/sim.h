@@ -0,0 +1,127 @@
+/*
+ * File Purpose: Virtual clock, scheduler and board model behind the host fakes, driven by tests
+ *
+ * Subroutines:
+ * uint64_t sim_now_us(void) - Virtual time since the simulation started
+ * void sim_settle(void) - Run every simulated thread that can run until all of them block, no time passes
+ * void sim_advance_us(uint64_t us) / sim_advance_ms(uint32_t ms) - Move the clock, firing timers and waking threads in time order
+ * void sim_boot(void (*entry)(void)) - Run entry as the main thread at osPriorityNormal, as the RTOS starts main()
+ * void sim_pin_drive(PinName pin, int level) - Drive an input from outside the board, firing edge interrupts
+ * int sim_pin_level(PinName pin) - Level of a pin as the board sees it, the output latch for outputs
+ * void sim_key(char key, int down) - Close or open a switch of the 4x4 keypad matrix
+ * void sim_press(char key, uint32_t hold_ms) - Press a key, hold it, release it and let the scan settle
+ * void sim_ultrasonic(PinName trigger, PinName echo, uint32_t mm) - HC-SR04 answering every trigger with the echo of an object mm away, 0 for nothing in range
+ * const char *sim_lcd_row(int row) - Text the HD44780 shows on a row, decoded from the PCF8574 bytes
+ * int sim_lcd_char(int row, int column) - Character code of one cell, 0..7 show the CGRAM glyphs
+ * const uint8_t *sim_lcd_cgram(int code) - The 8 pixel rows CGRAM holds for character code 0..7
+ * uint32_t sim_lcd_cgram_writes(void) - Data bytes written into CGRAM, 8 per glyph upload
+ * int sim_lcd_backlight(void) - 1 if the expander drives the backlight
+ * uint32_t sim_i2c_bytes(int address) - Bytes written to an I2C address, address byte excluded
+ * uint32_t sim_i2c_transactions(int address) - Writes addressed to an I2C address, one START to STOP each
+ * std::string sim_uart_take(PinName tx) - Bytes a UART finished sending since the last take
+ * void sim_uart_inject(PinName rx, const uint8_t *data, int length) - Bytes arriving at a UART's receive pin
+ * void sim_mic_source(uint16_t (*sample)(uint64_t t_us)) - Signal the ADC samples, 2048 (silence) when unset
+ * void sim_irq(IRQn_Type irq) - Run the vector installed for irq
+ * uint32_t sim_watchdog_resets(void) - Times the watchdog ran out without a kick
+ * void sim_set_reset_reason(reset_reason_t reason) - What ResetReason::get() returns
+ * void sim_reset(reset_reason_t reason) - Reset the board: the test starts over from main() in a fresh process at time 0, keeping only flash and the RTC backup registers
+ * uint32_t sim_resets(void) - Resets so far, 0 in the first run of the test
+ * void sim_flash_tear(uint32_t addr) - Leave the double word at addr half programmed, as a reset mid program does; reading it raises the ECC NMI
+ * uint32_t sim_wakeups(void) - Interrupts and thread wakeups since start, the host's view of leaving sleep
+ * void sim_exit(int status) - Flush output and end the process without unwinding blocked threads
+ *
+ * Only the test's own thread (the driver) may call these. Threads, interrupts and the driver
+ * never run at the same time: the driver hands the CPU to the highest priority ready thread and
+ * gets it back when that thread blocks; timers fire as interrupts from the driver in between.
+ * Code therefore takes no virtual time except where the fakes model it: blocking I2C transfers
+ * and wait_us() spin for their bus or delay time, and UART writes complete after their bytes'
+ * time on the wire. Those spins are the busy time mbed_stats_cpu_get() reports.
+ */
+#ifndef HOST_FAKES_SIM_H
+#define HOST_FAKES_SIM_H
+
+#include "mbed.h"
+#include <string>
+
+uint64_t sim_now_us(void);
+void sim_settle(void);
+void sim_advance_us(uint64_t us);
+void sim_advance_ms(uint32_t ms);
+void sim_boot(void (*entry)(void));
+
+void sim_pin_drive(PinName pin, int level);
+int sim_pin_level(PinName pin);
+void sim_key(char key, int down);
+void sim_press(char key, uint32_t hold_ms = 60);
+void sim_ultrasonic(PinName trigger, PinName echo, uint32_t mm);
+
+const char *sim_lcd_row(int row);
+int sim_lcd_char(int row, int column);
+const uint8_t *sim_lcd_cgram(int code);
+uint32_t sim_lcd_cgram_writes(void);
+int sim_lcd_backlight(void);
+uint32_t sim_i2c_bytes(int address);
+uint32_t sim_i2c_transactions(int address);
+
+std::string sim_uart_take(PinName tx);
+void sim_uart_inject(PinName rx, const uint8_t *data, int length);
+
+void sim_mic_source(uint16_t (*sample)(uint64_t t_us));
+void sim_irq(IRQn_Type irq);
+
+uint32_t sim_watchdog_resets(void);
+void sim_set_reset_reason(reset_reason_t reason);
+void sim_reset(reset_reason_t reason);
+uint32_t sim_resets(void);
+void sim_flash_tear(uint32_t addr);
+uint32_t sim_wakeups(void);
+void sim_exit(int status);
+
+// ---- Used by the fakes ----
+
+int sim_in_thread(void); // 1 when called from a simulated thread
+int sim_in_isr(void);    // 1 inside a timer, pin or IRQ callback
+// Block the calling simulated thread until ready() holds or the clock reaches deadline_us,
+// returns 1 if ready() held
+int sim_block(const std::function<bool()> &ready, uint64_t deadline_us);
+void sim_busy_us(uint64_t us); // Spin: time passes with the CPU held, interrupts still fire
+void sim_interrupt(const mbed::Callback<void()> &handler); // Run handler as an interrupt
+void *sim_thread_create(mbed::Callback<void()> entry, osPriority priority, const char *name);
+void sim_thread_set_priority(void *thread, osPriority priority);
+osPriority sim_thread_priority(void *thread);
+void *sim_thread_self(void);
+
+void sim_timer_add(mbed::TimerEvent *event);
+void sim_timer_remove(mbed::TimerEvent *event);
+uint64_t sim_timer_order(void); // Tie break, timers due together fire in the order they were set
+
+void sim_interrupt_in_add(mbed::InterruptIn *input);
+void sim_interrupt_in_remove(mbed::InterruptIn *input);
+void sim_pin_output(PinName pin, int level); // DigitalOut and HAL writes, through ODR
+void sim_pin_pull(PinName pin, PinMode mode);
+int sim_pin_input(PinName pin); // IDR bit
+void sim_sync(void); // Apply BSRR/IFCR writes and fire any edges they caused
+
+int sim_i2c_write(int address, const char *data, int length, int hz);
+void sim_uart_add(mbed::SerialBase *serial);
+void sim_uart_remove(mbed::SerialBase *serial);
+void sim_uart_sent(mbed::SerialBase *serial, const uint8_t *data, int length);
+int sim_uart_getc(mbed::SerialBase *serial); // -1 if nothing received
+int sim_uart_readable(mbed::SerialBase *serial);
+
+void sim_adc_dma(uint16_t *buffer, uint32_t length); // Circular DMA target of the ADC
+void sim_adc_trigger(uint32_t rate_hz); // Timer triggering conversions started
+void sim_watchdog_start(uint32_t timeout_ms);
+void sim_watchdog_kick(void);
+void sim_watchdog_stop(void);
+reset_reason_t sim_reset_reason(void);
+uint8_t *sim_flash(void); // Backing store of the internal flash, erased at start
+void sim_flash_reading(uint32_t addr, uint32_t size); // ECC check of a read, NMI for torn double words
+void sim_flash_programmed(uint32_t addr, uint32_t size); // Double words now hold valid ECC
+
+#define SIM_FLASH_START 0x08000000u
+#define SIM_FLASH_SIZE (2u * 1024 * 1024)
+#define SIM_FLASH_SECTOR 4096u // Dual bank pages
+#define SIM_CORE_HZ 120000000u
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * File Purpose: Block device kept in a file, with the program and erase rules of the board's flash
+ *
+ * Subroutines:
+ * FileBlockDevice(const char *path, bd_size_t size, bd_size_t erase_size) - Opens path, creating it erased
+ * uint32_t reads(void) - read() calls since construction, for boot scan cost
+ *
+ * Programming only clears bits and erase sets a whole sector to 0xFF, so a record can't be
+ * written twice without an erase, as on flash. The file outlives the device object, so
+ * constructing a second one over the same path is a reboot.
+ */
+#ifndef HOST_TESTS_FILEBLOCKDEVICE_H
+#define HOST_TESTS_FILEBLOCKDEVICE_H
+
+#include "mbed.h"
+#include <cstdio>
+#include <vector>
+
+class FileBlockDevice : public mbed::BlockDevice {
+public:
+  FileBlockDevice(const char *path, mbed::bd_size_t size, mbed::bd_size_t erase_size)
+      : _file(nullptr), _path(path), _size(size), _erase_size(erase_size), _reads(0) {}
+  ~FileBlockDevice() { deinit(); }
+
+  int init() override {
+    if (_file) {
+      return 0;
+    }
+    _file = fopen(_path, "r+b");
+    if (!_file) {
+      _file = fopen(_path, "w+b");
+      std::vector<uint8_t> erased(_size, 0xFF);
+      if (!_file || fwrite(erased.data(), 1, _size, _file) != _size) {
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+  int deinit() override {
+    if (_file) {
+      fclose(_file);
+      _file = nullptr;
+    }
+    return 0;
+  }
+
+  int read(void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size) override {
+    _reads++;
+    if (!_file || addr + size > _size || fseek(_file, addr, SEEK_SET)) {
+      return -1;
+    }
+    return fread(buffer, 1, size, _file) == size ? 0 : -1;
+  }
+
+  int program(const void *buffer, mbed::bd_addr_t addr, mbed::bd_size_t size) override {
+    if (!_file || addr % 8 || size % 8 || addr + size > _size) {
+      return -1;
+    }
+    std::vector<uint8_t> cells(size);
+    const uint8_t *bytes = (const uint8_t *)buffer;
+    if (fseek(_file, addr, SEEK_SET) || fread(cells.data(), 1, size, _file) != size) {
+      return -1;
+    }
+    for (mbed::bd_size_t i = 0; i < size; i++) {
+      cells[i] &= bytes[i]; // Programming only clears bits
+    }
+    return write(cells.data(), addr, size);
+  }
+
+  int erase(mbed::bd_addr_t addr, mbed::bd_size_t size) override {
+    if (!_file || addr % _erase_size || size % _erase_size || addr + size > _size) {
+      return -1;
+    }
+    std::vector<uint8_t> erased(size, 0xFF);
+    return write(erased.data(), addr, size);
+  }
+
+  mbed::bd_size_t get_read_size() const override { return 1; }
+  mbed::bd_size_t get_program_size() const override { return 8; }
+  mbed::bd_size_t get_erase_size() const override { return _erase_size; }
+  int get_erase_value() const override { return 0xFF; }
+  mbed::bd_size_t size() const override { return _size; }
+
+  uint32_t reads(void) const { return _reads; }
+
+private:
+  int write(const uint8_t *cells, mbed::bd_addr_t addr, mbed::bd_size_t size) {
+    if (fseek(_file, addr, SEEK_SET) || fwrite(cells, 1, size, _file) != size) {
+      return -1;
+    }
+    return fflush(_file) ? -1 : 0;
+  }
+
+  FILE *_file;
+  const char *_path;
+  mbed::bd_size_t _size;
+  mbed::bd_size_t _erase_size;
+  uint32_t _reads;
+};
+
+#endif
@@ -0,0 +1,55 @@
+/*
+ * File Purpose: Assertions for the host tests, counting failures instead of stopping at the first
+ *
+ * Subroutines:
+ * CHECK(cond) - Report cond with its line if it doesn't hold
+ * CHECK_EQ(actual, expected) - Report both integer values if they differ
+ * CHECK_STR(actual, expected) - Report both strings if they differ
+ * int check_done(void) - Print the summary, returns the exit status for sim_exit()
+ */
+#ifndef HOST_TESTS_CHECK_H
+#define HOST_TESTS_CHECK_H
+
+#include <cstdio>
+#include <cstring>
+
+static int check_failures = 0;
+static int check_count = 0;
+
+#define CHECK(cond)                                                                    \
+  do {                                                                                 \
+    check_count++;                                                                     \
+    if (!(cond)) {                                                                     \
+      check_failures++;                                                                \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);                  \
+    }                                                                                  \
+  } while (0)
+
+#define CHECK_EQ(actual, expected)                                                     \
+  do {                                                                                 \
+    long long check_a = (long long)(actual), check_e = (long long)(expected);          \
+    check_count++;                                                                     \
+    if (check_a != check_e) {                                                          \
+      check_failures++;                                                                \
+      printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, check_a, \
+             check_e);                                                                 \
+    }                                                                                  \
+  } while (0)
+
+#define CHECK_STR(actual, expected)                                                    \
+  do {                                                                                 \
+    const char *check_a = (actual), *check_e = (expected);                             \
+    check_count++;                                                                     \
+    if (strcmp(check_a, check_e) != 0) {                                               \
+      check_failures++;                                                                \
+      printf("%s:%d: %s is \"%s\", expected \"%s\"\n", __FILE__, __LINE__, #actual,     \
+             check_a, check_e);                                                        \
+    }                                                                                  \
+  } while (0)
+
+static inline int check_done(void) {
+  printf("%d checks, %d failed\n", check_count, check_failures);
+  return check_failures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,66 @@
+// Screens posted faster than the render thread runs collapse into the last one: several intents
+// posted back to back cost exactly the I2C traffic of drawing the final screen alone, and the
+// panel ends up showing it. The backlight is off so the status refresh doesn't redraw in between.
+#include "check.h"
+#include "display.h"
+#include "sim.h"
+
+static LCD_EM lcd(16, 2, LCD_5x8DOTS, PB_9, PB_8);
+
+struct Traffic {
+  uint32_t bytes, transactions;
+};
+
+static void row_is(int row, const char *text) {
+  char expected[17];
+  snprintf(expected, sizeof(expected), "%-16s", text);
+  CHECK_STR(sim_lcd_row(row), expected);
+}
+
+// Draws the starting screen, then runs post() before the render thread gets the CPU
+static Traffic redraw(void (*post)(void)) {
+  display_show(SCREEN_INCORRECT_PASSCODE);
+  sim_advance_ms(100);
+  row_is(0, "Incorrect");
+  uint32_t bytes = sim_i2c_bytes(LCD_ADDRESS_1602);
+  uint32_t transactions = sim_i2c_transactions(LCD_ADDRESS_1602);
+  post();
+  sim_advance_ms(100);
+  Traffic traffic = {sim_i2c_bytes(LCD_ADDRESS_1602) - bytes, sim_i2c_transactions(LCD_ADDRESS_1602) - transactions};
+  return traffic;
+}
+
+static void final_only(void) { display_show(SCREEN_SET_PASSCODE, 2); }
+
+static void superseded(void) {
+  display_show(SCREEN_ENTER_PASSCODE, 1);
+  display_show(SCREEN_ENTER_PASSCODE, 2);
+  display_show(SCREEN_ENTER_PASSCODE, 3);
+  display_show(SCREEN_SET_PASSCODE, 4);
+  display_show(SCREEN_SET_PASSCODE, 2);
+}
+
+int main() {
+  display_start(&lcd);
+  display_backlight(0);
+  sim_advance_ms(1500); // LCD power up wait and initialization
+
+  Traffic alone = redraw(final_only);
+  row_is(0, "Set Passcode:");
+  row_is(1, "**");
+  Traffic collapsed = redraw(superseded);
+  row_is(0, "Set Passcode:");
+  row_is(1, "**");
+  CHECK(alone.bytes > 0);
+  CHECK_EQ(collapsed.bytes, alone.bytes);
+  CHECK_EQ(collapsed.transactions, alone.transactions);
+  printf("5 intents drawn as 1: %lu bytes in %lu transactions\n", (unsigned long)collapsed.bytes,
+         (unsigned long)collapsed.transactions);
+
+  // Once the thread has drawn, the next post is drawn too
+  display_show(SCREEN_ENTER_PASSCODE, 1);
+  sim_advance_ms(100);
+  row_is(0, "Enter Passcode:");
+  row_is(1, "*");
+  sim_exit(check_done());
+}
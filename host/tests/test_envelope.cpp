@@ -0,0 +1,130 @@
+// Runs the envelope kernel over WAV files block by block as the DMA would hand them over,
+// checking which recordings count as sustained sound and timing the kernel per block.
+// Synthetic recordings are written first; pass more 16 bit mono WAV paths to benchmark those.
+#include "check.h"
+#include "envelope.h"
+#include "microphone.h"
+#include "sim.h"
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+struct WavHeader { // Canonical 44 byte PCM header
+  char riff[4];
+  uint32_t size;
+  char wave[4];
+  char fmt[4];
+  uint32_t fmt_size;
+  uint16_t format, channels;
+  uint32_t rate, byte_rate;
+  uint16_t align, bits;
+  char data[4];
+  uint32_t data_size;
+};
+
+static void write_wav(const char *path, const std::vector<int16_t> &pcm) {
+  WavHeader header = {{'R', 'I', 'F', 'F'}, 0, {'W', 'A', 'V', 'E'}, {'f', 'm', 't', ' '}, 16, 1, 1,
+                      MICROPHONE_SAMPLE_RATE_HZ, MICROPHONE_SAMPLE_RATE_HZ * 2, 2, 16, {'d', 'a', 't', 'a'}, 0};
+  header.data_size = pcm.size() * 2;
+  header.size = 36 + header.data_size;
+  FILE *file = fopen(path, "wb");
+  fwrite(&header, sizeof(header), 1, file);
+  fwrite(pcm.data(), 2, pcm.size(), file);
+  fclose(file);
+}
+
+// 12 bit ADC counts around the 1.65V bias, as the microphone module delivers them
+static std::vector<uint16_t> read_wav(const char *path) {
+  std::vector<uint16_t> samples;
+  WavHeader header;
+  FILE *file = fopen(path, "rb");
+  if (!file || fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.riff, "RIFF", 4) ||
+      header.format != 1 || header.bits != 16 || header.channels != 1) {
+    printf("%s: not a 16 bit mono PCM WAV\n", path);
+    if (file) {
+      fclose(file);
+    }
+    return samples;
+  }
+  int16_t pcm;
+  while (fread(&pcm, 2, 1, file) == 1) {
+    samples.push_back((uint16_t)(2048 + (pcm >> 4)));
+  }
+  fclose(file);
+  return samples;
+}
+
+static std::vector<int16_t> synth(double seconds, double hum, double tone, double tone_start, double tone_end) {
+  std::vector<int16_t> pcm;
+  uint32_t seed = 7;
+  for (int i = 0; i < seconds * MICROPHONE_SAMPLE_RATE_HZ; i++) {
+    double t = (double)i / MICROPHONE_SAMPLE_RATE_HZ;
+    seed = seed * 1664525 + 1013904223;
+    double value = hum * ((int32_t)(seed >> 16) % 2000 - 1000) / 1000.0; // Broadband noise
+    if (t >= tone_start && t < tone_end) {
+      value += tone * sin(2 * M_PI * 1000 * t);
+    }
+    pcm.push_back((int16_t)value);
+  }
+  return pcm;
+}
+
+struct Result {
+  int reports;
+  int blocks;
+  double ns_per_block;
+};
+
+static Result run(const char *path) {
+  std::vector<uint16_t> samples = read_wav(path);
+  Result result = {0, 0, 0};
+  auto start = std::chrono::steady_clock::now();
+  for (size_t at = 0; at + MICROPHONE_BLOCK_SAMPLES <= samples.size(); at += MICROPHONE_BLOCK_SAMPLES) {
+    result.reports += envelope_update(envelope_measure(&samples[at], MICROPHONE_BLOCK_SAMPLES));
+    result.blocks++;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  result.ns_per_block = result.blocks ? seconds * 1e9 / result.blocks : 0;
+  printf("%-22s %5d blocks, %3d reports, floor %4u, %6.0f ns per block\n", path, result.blocks, result.reports,
+         envelope_noise_floor(), result.ns_per_block);
+  return result;
+}
+
+int main(int argc, char **argv) {
+  // Kernel basics
+  uint16_t flat[MICROPHONE_BLOCK_SAMPLES];
+  for (int i = 0; i < MICROPHONE_BLOCK_SAMPLES; i++) {
+    flat[i] = 2048;
+  }
+  Envelope envelope = envelope_measure(flat, MICROPHONE_BLOCK_SAMPLES);
+  CHECK_EQ(envelope.rms, 0);
+  CHECK_EQ(envelope.peak, 0);
+  for (int i = 0; i < MICROPHONE_BLOCK_SAMPLES; i++) {
+    flat[i] = i % 2 ? 4095 : 0; // Full scale square wave, the accumulator's worst case
+  }
+  envelope = envelope_measure(flat, MICROPHONE_BLOCK_SAMPLES);
+  CHECK_EQ(envelope.rms, 2047);
+  CHECK_EQ(envelope.peak, 2048);
+
+  // Played in order, the floor carries from one recording to the next as in a room
+  write_wav("envelope_quiet.wav", synth(10, 400, 0, 0, 0));
+  write_wav("envelope_clap.wav", synth(4, 400, 20000, 1.0, 1.05)); // Under the sustain time
+  write_wav("envelope_alarm.wav", synth(4, 400, 12000, 1.0, 2.0));
+  write_wav("envelope_fan.wav", synth(30, 3000, 0, 0, 0));
+  write_wav("envelope_voice.wav", synth(4, 3000, 12000, 1.0, 2.0));
+
+  Result result = run("envelope_quiet.wav");
+  CHECK_EQ(result.reports, 0);
+  CHECK(envelope_threshold() == ENVELOPE_RMS_THRESHOLD);
+  CHECK_EQ(run("envelope_clap.wav").reports, 0);
+  CHECK(run("envelope_alarm.wav").reports > 0);
+  result = run("envelope_fan.wav");
+  CHECK(result.reports <= 1); // Loud at first, until the floor catches up
+  CHECK(envelope_threshold() > ENVELOPE_RMS_THRESHOLD);
+  CHECK(run("envelope_voice.wav").reports > 0); // Still heard over the fan
+
+  for (int i = 1; i < argc; i++) {
+    run(argv[i]);
+  }
+  sim_exit(check_done());
+}
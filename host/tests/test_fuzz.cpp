@@ -0,0 +1,388 @@
+// Random and replayed input traces against the whole firmware on the virtual board. Keys, microphone
+// events and echo pulses go into the event ring as the ISRs post them, so handle_event and
+// sm_dispatch take them on the mode thread, and a model kept here, written apart from the
+// transition table, says what must be seen after every step: the mode only changes on the stored
+// passcode or on a sensor trip once the exit delay is over, the alarm outputs are off outside
+// triggered and the buzzer waits out the entry delay, no event is lost and the watchdog never
+// resets. Workers are forked before boot, one board each with its own seed, and a failing trace is
+// written to fuzz_<seed>.trace for -r.
+//
+// Usage: test_fuzz [-w workers] [-n steps] [-s seed] [-r trace]
+//   Trace lines: <ms> key <c> | <ms> mic | <ms> echo <width us>, ms from the end of boot
+#include "check.h"
+#include "events.h"
+#include "sim.h"
+#include "state_machine.h"
+#include <chrono>
+#include <random>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+int firmware_main();
+
+// The firmware's timing, copied rather than shared so the model doesn't trust main.cpp
+#define IDLE_MS 10000
+#define EXIT_DELAY_MS 10000
+#define ENTRY_DELAY_MS 5000
+#define SOUND_EVENTS 3
+#define SOUND_WINDOW_US 3000000u
+#define GUARD_MS 100 // Steps keep this far from a timer expiry, the model can't say which came first
+#define HOLD_MS 40   // Key down to key up
+#define ECHO_NOTHING_US 38000
+
+#define ALARM_LEDS PD_15
+#define BUZZER PD_4
+#define ZONE_ECHO 0
+#define ZONE_MIC 1
+
+static const char keys[] = "123A456B789C*0#D"; // Keypad index order
+
+struct Step {
+  uint32_t ms;
+  char kind; // 'k'ey, 'm'ic or 'e'cho
+  char key;
+  uint32_t width_us;
+};
+
+struct Model {
+  int mode = 0;
+  int entering = 0;
+  std::string digits; // Passcode being set or entered
+  std::string passcode;
+  int display_on = 1;
+  uint64_t last_key_us = 0; // Idle timer start
+  uint64_t armed_us = 0;    // Exit delay start
+  uint64_t tripped_us = 0;  // Entry delay start
+  uint64_t echo_us = 0;     // Echo pulses that may trip, unresolved until the next check
+  std::vector<uint32_t> sounds; // Microphone events since the last sound trip
+};
+
+struct Result {
+  uint32_t steps, events, failed;
+  double virtual_s, host_s;
+};
+
+static Model model;
+static uint64_t start_us;
+static uint32_t posted; // Events into the ring
+static std::string failure;
+static FILE *out; // The firmware's periodic reports go to stdout, the harness writes here
+
+static void boot(void) { firmware_main(); }
+
+static uint64_t at_us(uint32_t ms) { return start_us + (uint64_t)ms * 1000; }
+
+static int key_index(char key) { return (int)(strchr(keys, key) - keys); }
+
+static void expect(int holds, const char *what) {
+  if (!holds && failure.empty()) {
+    failure = what;
+  }
+}
+
+static int sensor_trips(uint64_t now_us) { return model.mode == 2 && now_us >= model.armed_us + EXIT_DELAY_MS * 1000ull; }
+
+static void model_idle(uint64_t now_us) {
+  if (model.display_on && now_us >= model.last_key_us + IDLE_MS * 1000ull) {
+    model.display_on = 0;
+    model.entering = 0; // Entry and a half set passcode are dropped
+    model.digits.clear();
+  }
+}
+
+static void model_trip(uint64_t now_us) {
+  model.mode = 3;
+  model.entering = 0;
+  model.digits.clear();
+  model.tripped_us = now_us;
+}
+
+static void model_key(char key, uint64_t now_us) {
+  int digit = key >= '0' && key <= '9';
+  model.display_on = 1;
+  model.last_key_us = now_us;
+  if (model.mode == 0) {
+    if (digit) {
+      model.digits += key;
+    }
+    if (model.digits.size() == 4) {
+      model.passcode = model.digits;
+      model.digits.clear();
+      model.mode = 1;
+    }
+  } else if (!model.entering) {
+    model.entering = key == 'A';
+    model.digits.clear();
+  } else if (digit) {
+    model.digits += key;
+    if (model.digits.size() == 4) {
+      if (model.digits == model.passcode) {
+        model.mode = model.mode == 1 ? 2 : 1;
+        model.armed_us = now_us;
+      }
+      model.entering = 0;
+      model.digits.clear();
+    }
+  }
+}
+
+static void model_mic(uint64_t now_us) {
+  std::vector<uint32_t> &sounds = model.sounds;
+  sounds.push_back((uint32_t)now_us);
+  if (sounds.size() > SOUND_EVENTS) {
+    sounds.erase(sounds.begin());
+  }
+  if (sounds.size() == SOUND_EVENTS && (uint32_t)now_us - sounds[0] <= SOUND_WINDOW_US) {
+    sounds.clear(); // Counts afresh whether or not the zone is armed
+    if (sensor_trips(now_us)) {
+      model_trip(now_us);
+    }
+  }
+}
+
+// Outputs and mode seen on the board against the model, before each step and at the end
+static void check_board(void) {
+  uint64_t now_us = sim_now_us();
+  model_idle(now_us);
+  int mode = sm_mode();
+  if (model.echo_us && mode == 3 && model.mode == 2) { // Whether pulses trip depends on the learned scene
+    model_trip(model.echo_us);
+  }
+  model.echo_us = 0;
+  expect(mode == model.mode, "mode");
+  if (model.mode != 3) {
+    expect(!sim_pin_level(ALARM_LEDS) && !sim_pin_level(BUZZER), "outputs on outside triggered");
+  } else if (now_us + GUARD_MS * 1000 < model.tripped_us + ENTRY_DELAY_MS * 1000ull) {
+    expect(!sim_pin_level(BUZZER), "buzzer inside the entry delay");
+  } else if (now_us > model.tripped_us + (ENTRY_DELAY_MS + GUARD_MS) * 1000ull) {
+    expect(sim_pin_level(BUZZER), "buzzer silent after the entry delay");
+  }
+  expect(event_lost_count() == 0, "event lost");
+  expect(sim_watchdog_resets() == 0, "watchdog reset");
+}
+
+static void post(EventType type, uint8_t source, uint16_t value) {
+  event_post(type, source, value);
+  posted++;
+}
+
+static void run_step(const Step &step) {
+  uint64_t now_us = sim_now_us();
+  switch (step.kind) {
+  case 'k':
+    post(EVENT_KEY_DOWN, key_index(step.key) / 4, key_index(step.key));
+    model_key(step.key, now_us);
+    sim_advance_ms(HOLD_MS);
+    post(EVENT_KEY_UP, key_index(step.key) / 4, key_index(step.key));
+    break;
+  case 'm':
+    post(EVENT_MIC, ZONE_MIC, 0);
+    model_mic(now_us);
+    break;
+  case 'e': // A full median window, then nothing in range again so later pings can't trip on it
+    for (int i = 0; i < 6; i++) {
+      post(EVENT_ECHO_PULSE, ZONE_ECHO, i < 3 ? step.width_us : ECHO_NOTHING_US);
+    }
+    model.echo_us = sensor_trips(now_us) ? now_us : 0;
+    break;
+  }
+}
+
+// Moves a step off the idle and exit delay expiries
+static uint64_t clear_of_timers(uint64_t when_us) {
+  uint64_t expiries[2] = {model.last_key_us + IDLE_MS * 1000ull, model.armed_us + EXIT_DELAY_MS * 1000ull};
+  for (int pass = 0; pass < 2; pass++) {
+    for (uint64_t expiry : expiries) {
+      if (when_us + GUARD_MS * 1000 > expiry && when_us < expiry + GUARD_MS * 1000) {
+        when_us = expiry + GUARD_MS * 1000;
+      }
+    }
+  }
+  return when_us;
+}
+
+static Step generate(std::mt19937 &random, uint64_t after_us) {
+  Step step = {0, 'k', 0, 0};
+  int roll = random() % 100;
+  uint64_t gap_ms = roll < 70 ? 20 + random() % 280 : roll < 95 ? 300 + random() % 2700 : 5000 + random() % 7000;
+  step.ms = (uint32_t)((clear_of_timers(after_us + gap_ms * 1000) - start_us + 999) / 1000);
+
+  roll = random() % 100;
+  if (roll < 60) {
+    int pick = random() % 100;
+    if (model.mode == 0) {
+      step.key = pick < 80 ? '0' + random() % 10 : keys[random() % 16];
+    } else if (!model.entering) {
+      step.key = pick < 40 ? 'A' : keys[random() % 16];
+    } else if (pick < 70) { // Mostly the right code, sometimes a slip
+      step.key = model.passcode[model.digits.size()];
+    } else {
+      step.key = pick < 90 ? '0' + random() % 10 : keys[random() % 16];
+    }
+  } else if (roll < 85) {
+    step.kind = 'm';
+  } else {
+    step.kind = 'e';
+    step.width_us = 200 + random() % 1000; // 34 to 206 mm, either side of the trip distance
+  }
+  return step;
+}
+
+static void write_trace(const std::vector<Step> &steps, uint32_t seed) {
+  char path[64];
+  snprintf(path, sizeof(path), "fuzz_%lu.trace", (unsigned long)seed);
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    return;
+  }
+  fprintf(file, "# test_fuzz seed %lu\n# <ms> key <c> | <ms> mic | <ms> echo <width us>\n", (unsigned long)seed);
+  for (const Step &step : steps) {
+    if (step.kind == 'k') {
+      fprintf(file, "%lu key %c\n", (unsigned long)step.ms, step.key);
+    } else if (step.kind == 'm') {
+      fprintf(file, "%lu mic\n", (unsigned long)step.ms);
+    } else {
+      fprintf(file, "%lu echo %lu\n", (unsigned long)step.ms, (unsigned long)step.width_us);
+    }
+  }
+  fclose(file);
+  fprintf(out, "trace written to %s\n", path);
+}
+
+static int read_trace(const char *path, std::vector<Step> *steps) {
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    printf("test_fuzz: can't open %s\n", path);
+    return 0;
+  }
+  char line[128], kind[8];
+  while (fgets(line, sizeof(line), file)) {
+    Step step = {0, 0, 0, 0};
+    unsigned long ms, width;
+    char key;
+    if (line[0] == '#' || line[0] == '\n') {
+      continue;
+    }
+    if (sscanf(line, "%lu %7s", &ms, kind) != 2) {
+      break;
+    }
+    step.ms = ms;
+    step.kind = kind[0];
+    if ((step.kind == 'k' && sscanf(line, "%*u %*s %c", &key) != 1) ||
+        (step.kind == 'e' && sscanf(line, "%*u %*s %lu", &width) != 1)) {
+      break;
+    }
+    step.key = step.kind == 'k' ? key : 0;
+    step.width_us = step.kind == 'e' ? width : 0;
+    steps->push_back(step);
+  }
+  int complete = feof(file);
+  fclose(file);
+  if (!complete) {
+    printf("test_fuzz: %s: bad line %s", path, line);
+  }
+  return complete;
+}
+
+// Boots a board and runs count generated steps, or the replayed ones if count is 0
+static Result run(uint32_t seed, uint32_t count, std::vector<Step> steps) {
+  auto host_start = std::chrono::steady_clock::now();
+  std::mt19937 random(seed);
+  out = fdopen(dup(fileno(stdout)), "w");
+  CHECK(freopen("/dev/null", "w", stdout) != nullptr);
+  sim_ultrasonic(PD_6, PD_5, 0); // Nothing in range, the injected pulses are all the zone sees
+  model.last_key_us = sim_now_us(); // Mode thread starts the idle timer at boot
+  sim_boot(&boot);
+  sim_advance_ms(1500); // LCD power up wait and initialization
+  start_us = sim_now_us();
+  count = count ? count : (uint32_t)steps.size();
+
+  uint32_t done = 0;
+  for (; done < count && failure.empty(); done++) {
+    if (done == steps.size()) {
+      steps.push_back(generate(random, sim_now_us()));
+    }
+    sim_advance_us(at_us(steps[done].ms) > sim_now_us() ? at_us(steps[done].ms) - sim_now_us() : 0);
+    check_board();
+    if (failure.empty()) {
+      run_step(steps[done]);
+    }
+  }
+  sim_advance_ms(1000);
+  check_board();
+
+  Result result = {done, posted, !failure.empty(), (sim_now_us() - start_us) / 1e6,
+                   std::chrono::duration<double>(std::chrono::steady_clock::now() - host_start).count()};
+  if (result.failed) {
+    fprintf(out, "seed %lu: %s after step %lu at %lu ms (mode %d, model %d)\n", (unsigned long)seed, failure.c_str(),
+           (unsigned long)done, (unsigned long)(done ? steps[done - 1].ms : 0), sm_mode(), model.mode);
+    steps.resize(done);
+    write_trace(steps, seed);
+  }
+  fflush(stdout);
+  fflush(out);
+  dup2(fileno(out), fileno(stdout)); // Reports from here on are the harness's
+  fclose(out);
+  return result;
+}
+
+int main(int argc, char **argv) {
+  uint32_t workers = 4, count = 5000, seed = 1;
+  const char *replay = nullptr;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "-w") == 0) {
+      workers = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "-n") == 0) {
+      count = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "-s") == 0) {
+      seed = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "-r") == 0) {
+      replay = argv[i + 1];
+    }
+  }
+
+  if (replay) { // One board, in this process
+    std::vector<Step> steps;
+    CHECK(read_trace(replay, &steps));
+    Result result = run(seed, 0, steps);
+    printf("%s: %lu steps replayed\n", replay, (unsigned long)result.steps);
+    CHECK_EQ(result.failed, 0);
+    sim_exit(check_done());
+  }
+
+  // Fork before anything boots, the simulated threads don't survive a fork
+  auto host_start = std::chrono::steady_clock::now();
+  std::vector<int> pipes;
+  for (uint32_t i = 0; i < workers; i++) {
+    int ends[2];
+    CHECK(pipe(ends) == 0);
+    if (fork() == 0) {
+      close(ends[0]);
+      Result result = run(seed + i, count, std::vector<Step>());
+      CHECK(write(ends[1], &result, sizeof(result)) == sizeof(result));
+      sim_exit(0);
+    }
+    close(ends[1]);
+    pipes.push_back(ends[0]);
+  }
+  Result total = {0, 0, 0, 0, 0};
+  for (int end : pipes) {
+    Result result;
+    CHECK(read(end, &result, sizeof(result)) == sizeof(result));
+    total.steps += result.steps;
+    total.events += result.events;
+    total.failed += result.failed;
+    total.virtual_s += result.virtual_s;
+    close(end);
+  }
+  while (wait(nullptr) > 0) {
+  }
+  double host_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - host_start).count();
+  printf("%lu workers, %lu steps, %lu events, %.1f h of board time in %.2f s: %.0f events/s, %.0fx real time\n",
+         (unsigned long)workers, (unsigned long)total.steps, (unsigned long)total.events, total.virtual_s / 3600,
+         host_s, total.events / host_s, total.virtual_s / host_s);
+  CHECK_EQ(total.failed, 0);
+  sim_exit(check_done());
+}
@@ -0,0 +1,115 @@
+// The CGRAM glyph cache against the sim's HD44780, which keeps what is uploaded into CGRAM. First
+// through the display thread: a status icon is uploaded once and status refreshes and screen
+// changes between resident icons upload nothing. Then frames are composed directly: a glyph is
+// uploaded only when it isn't resident, a frame needing more than eight glyphs shows the rest
+// as plain characters, and a glyph already placed in the frame is never evicted, even when its
+// slot is the least recently used. Every glyph cell must show its bitmap when the frame is done.
+#include "check.h"
+#include "display.h"
+#include "glyphs.h"
+#include "sim.h"
+
+static LCD_EM lcd(16, 2, LCD_5x8DOTS, PB_9, PB_8);
+
+static const unsigned char bitmaps[GLYPH_COUNT][8] = { // As drawn in glyphs.cpp
+    {0x0E, 0x11, 0x11, 0x1F, 0x1B, 0x1B, 0x1F, 0x00}, // GLYPH_LOCKED
+    {0x0E, 0x10, 0x10, 0x1F, 0x1B, 0x1B, 0x1F, 0x00}, // GLYPH_UNLOCKED
+    {0x0E, 0x0E, 0x0E, 0x0E, 0x1F, 0x04, 0x0E, 0x00}, // GLYPH_MICROPHONE
+    {0x02, 0x09, 0x05, 0x15, 0x05, 0x09, 0x02, 0x00}, // GLYPH_ULTRASONIC
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x10}, // GLYPH_SIGNAL_1
+    {0x00, 0x00, 0x00, 0x00, 0x04, 0x04, 0x14, 0x14}, // GLYPH_SIGNAL_2
+    {0x00, 0x00, 0x01, 0x01, 0x05, 0x05, 0x15, 0x15}, // GLYPH_SIGNAL_3
+    {0x00, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00}, // GLYPH_RANGE_1
+    {0x00, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x00}, // GLYPH_RANGE_2
+    {0x00, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x00}, // GLYPH_RANGE_3
+};
+
+#define LENGTH(list) (int)(sizeof(list) / sizeof(list[0]))
+
+static void shows(int row, int column, Glyph glyph) {
+  int code = sim_lcd_char(row, column);
+  CHECK(code < GLYPH_SLOTS);
+  CHECK(memcmp(sim_lcd_cgram(code), bitmaps[glyph], 8) == 0);
+}
+
+// CGRAM bytes uploaded while the display thread draws screen and refreshes it for ms
+static uint32_t screen(DisplayScreen which, uint32_t ms) {
+  uint32_t before = sim_lcd_cgram_writes();
+  display_show(which);
+  sim_advance_ms(ms);
+  return sim_lcd_cgram_writes() - before;
+}
+
+// Composes one frame of glyphs from the start of row 0 as render() would, returns the CGRAM bytes
+static uint32_t frame(const Glyph *list, int length) {
+  uint32_t before = sim_lcd_cgram_writes();
+  glyphs_frame();
+  lcd.clear();
+  for (int i = 0; i < length; i++) {
+    lcd.write(glyph_char(list[i]));
+  }
+  lcd.flush();
+  return sim_lcd_cgram_writes() - before;
+}
+
+int main() {
+  display_start(&lcd);
+  sim_advance_ms(1500); // LCD power up wait and initialization
+
+  // No zones registered, so the status line is the lock icon alone in the last column
+  CHECK_EQ(screen(SCREEN_ARMED, 100), 8);
+  shows(0, 15, GLYPH_LOCKED);
+  CHECK_EQ(screen(SCREEN_ARMED, 10 * DISPLAY_STATUS_MS), 0); // Ten status refreshes
+  CHECK_EQ(screen(SCREEN_UNARMED, 100), 8);
+  shows(0, 15, GLYPH_UNLOCKED);
+  CHECK_EQ(screen(SCREEN_ARMED, 100), 0); // Both icons resident from here on
+  shows(0, 15, GLYPH_LOCKED);
+  CHECK_EQ(screen(SCREEN_UNARMED, 100), 0);
+  shows(0, 15, GLYPH_UNLOCKED);
+
+  // The display thread sleeps with the backlight off, the test composes frames in its place
+  display_backlight(0);
+  sim_advance_ms(100);
+  glyphs_start(&lcd);
+
+  const Glyph first[] = {GLYPH_LOCKED, GLYPH_MICROPHONE, GLYPH_SIGNAL_1};
+  CHECK_EQ(frame(first, LENGTH(first)), 3 * 8);
+  CHECK_EQ(frame(first, LENGTH(first)), 0); // All resident, a redraw uploads nothing
+
+  const Glyph second[] = {GLYPH_UNLOCKED, GLYPH_MICROPHONE, GLYPH_SIGNAL_2};
+  CHECK_EQ(frame(second, LENGTH(second)), 2 * 8); // Only the two new ones, into empty slots
+  for (int i = 0; i < LENGTH(second); i++) {
+    shows(0, i, second[i]);
+  }
+
+  // Every glyph in one frame: three more fit into the empty slots, the last two fall back
+  const Glyph every[] = {GLYPH_LOCKED,   GLYPH_UNLOCKED, GLYPH_MICROPHONE, GLYPH_ULTRASONIC, GLYPH_SIGNAL_1,
+                         GLYPH_SIGNAL_2, GLYPH_SIGNAL_3, GLYPH_RANGE_1,    GLYPH_RANGE_2,    GLYPH_RANGE_3};
+  CHECK_EQ(frame(every, LENGTH(every)), 3 * 8);
+  for (int i = 0; i < GLYPH_SLOTS; i++) {
+    shows(0, i, every[i]); // None reloaded under an earlier cell
+  }
+  CHECK_EQ(sim_lcd_char(0, 8), '2');
+  CHECK_EQ(sim_lcd_char(0, 9), '3');
+
+  // Next frame the slots are free again: GLYPH_LOCKED was used longest ago and goes
+  const Glyph range[] = {GLYPH_RANGE_2};
+  CHECK_EQ(frame(range, LENGTH(range)), 8);
+  shows(0, 0, GLYPH_RANGE_2);
+  const Glyph locked[] = {GLYPH_LOCKED};
+  CHECK_EQ(frame(locked, LENGTH(locked)), 8); // Evicted, so uploaded again over GLYPH_UNLOCKED
+  shows(0, 0, GLYPH_LOCKED);
+
+  // GLYPH_MICROPHONE is now least recently used, but placed first in this frame it must stay;
+  // the upload takes the next oldest, GLYPH_ULTRASONIC, instead
+  const Glyph kept[] = {GLYPH_MICROPHONE, GLYPH_UNLOCKED};
+  CHECK_EQ(frame(kept, LENGTH(kept)), 8);
+  shows(0, 0, GLYPH_MICROPHONE);
+  shows(0, 1, GLYPH_UNLOCKED);
+  const Glyph evicted[] = {GLYPH_ULTRASONIC, GLYPH_MICROPHONE, GLYPH_UNLOCKED};
+  CHECK_EQ(frame(evicted, LENGTH(evicted)), 8); // Only GLYPH_ULTRASONIC was gone
+  for (int i = 0; i < LENGTH(evicted); i++) {
+    shows(0, i, evicted[i]);
+  }
+  sim_exit(check_done());
+}
@@ -0,0 +1,168 @@
+// Runs the journal over a file backed block device: records survive a reboot, sequences stay
+// contiguous across sector rotation, and a full log is found again by the boot scan. Then the
+// same on the simulated internal flash, where a double word torn by a reset mid program raises
+// the ECC NMI the journal has to recover from. Prints records/s and boot scan cost for both.
+#include "FileBlockDevice.h"
+#include "FlashIAPBlockDevice.h"
+#include "check.h"
+#include "journal.h"
+#include "sim.h"
+#include <chrono>
+#include <cstddef>
+
+#define LOG_PATH "journal_log.bin"
+#define SECTOR_SIZE 4096
+#define SECTORS 4 // Same as the 16 KB target.restrict_size leaves free
+#define SLOTS (SECTOR_SIZE / sizeof(JournalRecord))
+
+// Mirror of journal.cpp's record_check
+static int record_valid(const JournalRecord &record) {
+  const uint16_t *words = (const uint16_t *)&record;
+  uint32_t sum = 0x5A5A;
+  for (uint32_t i = 0; i < offsetof(JournalRecord, check) / 2; i++) {
+    sum = ((sum << 1 | sum >> 15) + words[i]) & 0xFFFF;
+  }
+  return record.sequence != 0xFFFFFFFF && record.check == sum;
+}
+
+struct Contents {
+  uint32_t valid;
+  uint32_t lowest;
+  uint32_t highest;
+  int contiguous; // Every sequence from lowest to highest present once
+};
+
+static Contents contents(mbed::BlockDevice &device) {
+  std::vector<uint8_t> seen;
+  Contents result = {0, 0xFFFFFFFF, 0, 1};
+  std::vector<uint32_t> sequences;
+  for (uint32_t slot = 0; slot < device.size() / sizeof(JournalRecord); slot++) {
+    JournalRecord record;
+    device.read(&record, slot * sizeof(JournalRecord), sizeof(record));
+    if (record_valid(record)) {
+      sequences.push_back(record.sequence);
+      result.lowest = record.sequence < result.lowest ? record.sequence : result.lowest;
+      result.highest = record.sequence > result.highest ? record.sequence : result.highest;
+    }
+  }
+  result.valid = sequences.size();
+  if (sequences.empty()) {
+    return result;
+  }
+  seen.assign(result.highest - result.lowest + 1, 0);
+  for (uint32_t sequence : sequences) {
+    result.contiguous &= !seen[sequence - result.lowest]++;
+  }
+  result.contiguous &= sequences.size() == seen.size();
+  return result;
+}
+
+static void log_records(uint32_t count) { // As the mode thread does, flushing every batch
+  for (uint32_t i = 0; i < count; i++) {
+    journal_log(JOURNAL_TRIGGER, i % 4, 1, i);
+    if ((i + 1) % JOURNAL_BATCH == 0) {
+      journal_flush();
+    }
+  }
+  journal_flush();
+}
+
+static void file_device(void) {
+  remove(LOG_PATH);
+  {
+    FileBlockDevice device(LOG_PATH, SECTORS * SECTOR_SIZE, SECTOR_SIZE);
+    journal_init(&device);
+    log_records(100);
+  }
+  FileBlockDevice rebooted(LOG_PATH, SECTORS * SECTOR_SIZE, SECTOR_SIZE);
+  journal_init(&rebooted);
+  log_records(1);
+  Contents after = contents(rebooted);
+  CHECK_EQ(after.valid, 101);
+  CHECK_EQ(after.lowest, 0);
+  CHECK_EQ(after.highest, 100);
+  CHECK(after.contiguous);
+
+  // Several laps of the sectors: the oldest sector goes each rotation, the rest stays in order
+  log_records(SECTORS * SLOTS * 3 + 37);
+  Contents wrapped = contents(rebooted);
+  CHECK_EQ(wrapped.highest, 101 + SECTORS * SLOTS * 3 + 37 - 1);
+  CHECK(wrapped.contiguous);
+  CHECK(wrapped.valid > (SECTORS - 1) * SLOTS);
+  CHECK(wrapped.valid <= SECTORS * SLOTS);
+}
+
+// Full log on the file device: wall clock records/s through journal_log and journal_flush, and
+// what the boot scan costs in reads and time
+static void file_benchmark(void) {
+  remove(LOG_PATH);
+  FileBlockDevice device(LOG_PATH, SECTORS * SECTOR_SIZE, SECTOR_SIZE);
+  journal_init(&device);
+  uint32_t count = SECTORS * SLOTS * 4;
+  auto start = std::chrono::steady_clock::now();
+  log_records(count);
+  double log_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  FileBlockDevice rebooted(LOG_PATH, SECTORS * SECTOR_SIZE, SECTOR_SIZE);
+  start = std::chrono::steady_clock::now();
+  journal_init(&rebooted);
+  double scan_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  uint32_t scan_reads = rebooted.reads();
+  log_records(1);
+  CHECK_EQ(contents(rebooted).highest, count);
+  CHECK(scan_reads <= SECTORS + 10); // First record of each sector, then a binary search of one
+  printf("file device: %.0f records/s, boot scan of a full log %u reads, %.1f us\n", count / log_seconds,
+         (unsigned)scan_reads, scan_seconds * 1e6);
+  remove(LOG_PATH);
+}
+
+// Internal flash on the virtual clock: program and erase times as on the L4R5. Reads cost no
+// virtual time, the file device's read count stands for the boot scan.
+static void internal_flash(void) {
+  FlashIAPBlockDevice device;
+  CHECK_EQ(device.size(), SECTORS * SECTOR_SIZE);
+  journal_init(&device);
+  uint32_t count = SECTORS * SLOTS * 2;
+  uint64_t start = sim_now_us();
+  log_records(count);
+  uint64_t log_us = sim_now_us() - start;
+  journal_init(&device);
+  log_records(1);
+  CHECK_EQ(contents(device).highest, count);
+  printf("internal flash: %.0f records/s (virtual, programs and erases)\n", count * 1e6 / log_us);
+}
+
+// A reset while the next batch was programming: slot 10's first double word is torn. The boot
+// scan reads it, the NMI zeroes it, and logging continues past it.
+static void torn_record(void) {
+  FlashIAPBlockDevice device;
+  uint32_t base = MBED_APP_START + MBED_APP_SIZE;
+  uint8_t *cells = sim_flash() + (base - SIM_FLASH_START);
+  memset(cells, 0xFF, SECTORS * SECTOR_SIZE); // Blank journal
+  journal_init(&device);
+  log_records(10);
+  sim_flash_tear(base + 10 * sizeof(JournalRecord));
+
+  uint32_t wakeups = sim_wakeups();
+  journal_init(&device);
+  CHECK(sim_wakeups() > wakeups); // The NMI ran
+  static const uint8_t zeros[8] = {0};
+  CHECK(memcmp(cells + 10 * sizeof(JournalRecord), zeros, 8) == 0);
+
+  log_records(5);
+  Contents after = contents(device);
+  CHECK_EQ(after.valid, 15);
+  CHECK_EQ(after.highest, 15); // Sequence 10 went with the torn record
+  JournalRecord record;
+  device.read(&record, 11 * sizeof(JournalRecord), sizeof(record));
+  CHECK_EQ(record.sequence, 11);
+  CHECK(record_valid(record));
+}
+
+int main() {
+  file_device();
+  file_benchmark();
+  internal_flash();
+  torn_record();
+  sim_exit(check_done());
+}
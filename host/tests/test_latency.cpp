@@ -0,0 +1,97 @@
+// The latency probes on the virtual clock: the firmware boots, then keys and sensor trips are
+// timed through the real keypad scan, event ring, mode thread and render thread. Worst cases are
+// provoked rather than waited for: a key is accepted while the incorrect passcode banner is
+// still going out on the I2C bus, and a trip lands while a screen for the key before it is being
+// flushed. The histograms are read back and the p99 and max of key->display and sensor->leds
+// held to bounds, and only readings that tripped may be counted on sensor->leds.
+#include "check.h"
+#include "latency.h"
+#include "sim.h"
+
+int firmware_main();
+
+#define KEY_P99_US 25000  // Debounce plus waiting out a banner flush plus the screen's own flush
+#define KEY_MAX_US 30000
+#define LEDS_P99_US 1000  // The mode thread preempts the render thread, even mid transfer
+#define LEDS_MAX_US 2000
+#define EXIT_DELAY_MS 11000
+
+static void boot(void) { firmware_main(); }
+
+static void enter(const char *keys) {
+  for (const char *key = keys; *key; key++) {
+    sim_press(*key);
+  }
+}
+
+// second goes down delta_ms after first, so it is accepted while first's screen is drawn
+static void overlapped(char first, char second, uint32_t delta_ms) {
+  sim_key(first, 1);
+  sim_advance_ms(delta_ms);
+  sim_key(second, 1);
+  sim_advance_ms(60);
+  sim_key(first, 0);
+  sim_key(second, 0);
+  sim_advance_ms(100);
+}
+
+static uint16_t loud(uint64_t t_us) { return (t_us / 125) % 2 ? 3048 : 1048; } // 4kHz square, far over the floor
+
+static uint16_t silent(uint64_t t_us) { return 2048; }
+
+static void check_path(const char *name, LatencyPath path, uint32_t p99_us, uint32_t max_us) {
+  LatencyStats stats = latency_stats(path, STAGE_OUTPUT);
+  printf("%s: n=%lu p50=%luus p99=%luus max=%luus\n", name, (unsigned long)stats.count,
+         (unsigned long)stats.p50_us, (unsigned long)stats.p99_us, (unsigned long)stats.max_us);
+  CHECK(stats.count > 0);
+  CHECK(stats.p99_us <= p99_us);
+  CHECK(stats.max_us <= max_us);
+}
+
+int main() {
+  sim_ultrasonic(PD_6, PD_5, 0); // Nothing in range
+  sim_boot(&boot);
+  sim_advance_ms(1500);
+  enter("1234");
+
+  // Wrong codes: the last digit puts up the banner and 'A' is accepted while it goes out,
+  // at every offset into the banner's flush and the status line refresh
+  enter("A");
+  for (uint32_t i = 0; i < 48; i++) {
+    sim_advance_ms(i * 37 % 250);
+    enter("129");
+    overlapped('9', 'A', i % 16);
+  }
+
+  // Trips while the screen of the key just pressed is being flushed, half by the ultrasonic
+  // zone and half by the microphone
+  uint32_t trips = 0;
+  enter("1234"); // Entry begun by the last 'A' above, arms
+  for (uint32_t i = 0; i < 12; i++) {
+    sim_advance_ms(EXIT_DELAY_MS);
+    sim_press('A', 20);
+    if (i % 2) {
+      sim_mic_source(loud);
+    } else {
+      sim_ultrasonic(PD_6, PD_5, 100);
+    }
+    for (uint32_t ms = 0; ms < 4000 && !sim_pin_level(PD_15); ms++) {
+      sim_advance_ms(1);
+    }
+    CHECK_EQ(sim_pin_level(PD_15), 1);
+    trips += sim_pin_level(PD_15);
+    sim_mic_source(silent);
+    sim_ultrasonic(PD_6, PD_5, 0);
+    sim_advance_ms(500);
+    enter("A1234"); // Disarm
+    CHECK_EQ(sim_pin_level(PD_15), 0);
+    enter("A1234"); // Arm again
+  }
+
+  check_path("key->display", LATENCY_KEY_TO_DISPLAY, KEY_P99_US, KEY_MAX_US);
+  check_path("sensor->leds", LATENCY_SENSOR_TO_LEDS, LEDS_P99_US, LEDS_MAX_US);
+  CHECK_EQ(latency_stats(LATENCY_SENSOR_TO_LEDS, STAGE_DISPATCH).count, trips); // Echoes that didn't trip aren't timed
+  CHECK_EQ(latency_stats(LATENCY_SENSOR_TO_LEDS, STAGE_OUTPUT).count, trips);
+  CHECK_EQ(sim_watchdog_resets(), 0);
+  sim_exit(check_done());
+}
@@ -0,0 +1,71 @@
+// Checks the Port/Pin templates against the fake register file: which bits each call leaves in
+// RCC, MODER and BSRR, and what the port shows once the writes have taken effect.
+#include "check.h"
+#include "methods.h"
+#include "sim.h"
+
+typedef Port<GPIOC_BASE> PortC;
+typedef Port<GPIOE_BASE> PortE;
+typedef Pin<GPIOD_BASE, 15> Led;
+
+MBED_STATIC_ASSERT(Port<GPIOA_BASE>::rcc_bit == 1u << 0, "GPIOA is AHB2ENR bit 0");
+MBED_STATIC_ASSERT(Port<GPIOI_BASE>::rcc_bit == 1u << 8, "GPIOI is AHB2ENR bit 8");
+MBED_STATIC_ASSERT(moder_spread(0x8009, 1) == 0x40000041, "pins 0, 3 and 15 as outputs");
+MBED_STATIC_ASSERT(Led::mask == 0x8000, "pin mask is resolved at compile time");
+
+int main() {
+  RCC->AHB2ENR = 1u << 13; // ADC clock already on, must survive
+  PortC::enable_rcc();
+  PortE::enable_rcc();
+  CHECK_EQ(RCC->AHB2ENR, (1u << 13) | (1u << 2) | (1u << 4));
+
+  // configure_group: one MODER store, pins outside the mask keep their mode
+  GPIOC->MODER = 0xFFFFFFFF; // Reset state, everything analog
+  PortC::configure_group<(1u << 0) | (1u << 1) | (1u << 3)>(PIN_MODE_OUTPUT);
+  CHECK_EQ(GPIOC->MODER, 0xFFFFFF75);
+  PortC::configure_group<(1u << 1)>(PIN_MODE_INPUT);
+  CHECK_EQ(GPIOC->MODER, 0xFFFFFF71);
+  PortC::configure_group<(1u << 4)>(PIN_MODE_ANALOG);
+  CHECK_EQ(GPIOC->MODER, 0xFFFFFF71);
+
+  // write_port: one BSRR store, resets in the upper half, sets in the lower
+  GPIOC->ODR = 0x0002;
+  PortC::write_port(0x000B, 0x0009);
+  CHECK_EQ(GPIOC->BSRR, 0x00020009);
+  sim_sync();
+  CHECK_EQ(GPIOC->ODR, 0x0009);
+  CHECK_EQ(GPIOC->BSRR, 0);
+  PortC::write_port(0x0009, 0);
+  sim_sync();
+  CHECK_EQ(GPIOC->ODR, 0);
+
+  // Row driving as the keypad does it, exactly one row high after every step
+  for (int row = 0; row < 3; row++) {
+    PortC::write_port(0x000B, 1u << (row == 0 ? 0 : row == 1 ? 3 : 1));
+    sim_sync();
+    CHECK_EQ(__builtin_popcount(GPIOC->ODR & 0x000B), 1);
+  }
+
+  // Single pin forms
+  Led::set_mode(PIN_MODE_OUTPUT);
+  CHECK_EQ((GPIOD->MODER >> 30) & 3, PIN_MODE_OUTPUT);
+  Led::write(1);
+  CHECK_EQ(GPIOD->BSRR, 0x8000);
+  sim_sync();
+  CHECK_EQ(sim_pin_level(PD_15), 1);
+  CHECK_EQ(Led::read(), 1); // Output pins read back their latch through IDR
+  Led::write(0);
+  CHECK_EQ(GPIOD->BSRR, 0x80000000);
+  sim_sync();
+  CHECK_EQ(Led::read(), 0);
+
+  // Inputs: IDR follows what drives the pin, read_port gets every pin in one load
+  PortE::configure_group<(1u << 9) | (1u << 11)>(PIN_MODE_INPUT);
+  sim_pin_drive(PE_9, 1);
+  CHECK_EQ(PortE::read_port() & 0x0A00, 0x0200);
+  sim_pin_drive(PE_11, 1);
+  CHECK_EQ(PortE::read_port() & 0x0A00, 0x0A00);
+  CHECK_EQ((Pin<GPIOE_BASE, 11>::read()), 1);
+
+  sim_exit(check_done());
+}
@@ -0,0 +1,241 @@
+// Notification channel against a receiver stand-in on the simulated UART5: frames are flagged,
+// escaped and carry a CRC-16/CCITT the receiver checks on its own, acknowledgements stop the
+// retries, corrupt ones don't, status notifications are given up after NOTIFY_TRIES but alarms
+// are sent until acknowledged and evict status notifications from a full queue. A late
+// acknowledgement from 256 frames back, where an 8 bit sequence would have come round, must not
+// retire the alarm now outstanding. Then a sustained run reports delivery latency and throughput
+// on the virtual clock.
+#include "check.h"
+#include "notify.h"
+#include "sim.h"
+#include <deque>
+#include <vector>
+
+#define TX PC_12
+#define RX PD_2
+
+static uint16_t crc16(const uint8_t *data, int length) { // CRC-16/CCITT-FALSE, written apart from notify.cpp's
+  uint16_t crc = 0xFFFF;
+  for (int i = 0; i < length; i++) {
+    for (int bit = 7; bit >= 0; bit--) {
+      int feedback = ((crc >> 15) ^ (data[i] >> bit)) & 1;
+      crc = (uint16_t)(crc << 1) ^ (feedback ? 0x1021 : 0);
+    }
+  }
+  return crc;
+}
+
+struct Frame {
+  uint16_t sequence;
+  uint8_t type, zone, mode;
+  uint32_t timestamp_us;
+  uint64_t received_us;
+};
+
+struct Receiver { // What sits on the other end of the cable
+  bool acking = true;
+  bool corrupt_acks = false;
+  std::vector<Frame> frames;
+  std::string raw; // Every byte received, for the escaping checks
+  uint32_t bad = 0;
+  std::vector<uint8_t> body;
+  bool escape = false;
+  std::deque<std::pair<uint64_t, std::vector<uint8_t>>> acks; // Due time, wire bytes
+
+  void poll(void) {
+    std::string bytes = sim_uart_take(TX);
+    raw += bytes;
+    for (char c : bytes) {
+      uint8_t byte = (uint8_t)c;
+      if (byte == 0x7E) {
+        end_frame();
+      } else if (byte == 0x7D) {
+        escape = true;
+      } else {
+        body.push_back(escape ? byte ^ 0x20 : byte);
+        escape = false;
+      }
+    }
+    while (!acks.empty() && acks.front().first <= sim_now_us()) {
+      sim_uart_inject(RX, acks.front().second.data(), acks.front().second.size());
+      acks.pop_front();
+    }
+  }
+
+  void end_frame(void) {
+    if (body.size() == 11 && crc16(body.data(), 9) == (body[9] << 8 | body[10])) {
+      Frame frame = {(uint16_t)(body[0] | body[1] << 8), body[2], body[3], body[4],
+                     (uint32_t)(body[5] | body[6] << 8 | body[7] << 16 | (uint32_t)body[8] << 24), sim_now_us()};
+      frames.push_back(frame);
+      if (acking) {
+        ack(frame.sequence);
+      }
+    } else if (!body.empty()) {
+      bad++;
+    }
+    body.clear();
+    escape = false;
+  }
+
+  void ack(uint16_t sequence) {
+    uint8_t plain[11] = {(uint8_t)sequence, (uint8_t)(sequence >> 8), NOTIFY_ACK};
+    uint16_t check = crc16(plain, 9) ^ (corrupt_acks ? 1 : 0);
+    plain[9] = check >> 8;
+    plain[10] = (uint8_t)check;
+    std::vector<uint8_t> wire = {0x7E};
+    for (uint8_t byte : plain) {
+      if (byte == 0x7E || byte == 0x7D) {
+        wire.push_back(0x7D);
+        byte ^= 0x20;
+      }
+      wire.push_back(byte);
+    }
+    wire.push_back(0x7E);
+    uint64_t due = sim_now_us() + wire.size() * 10 * 1000000 / NOTIFY_BAUD;
+    acks.push_back(std::make_pair(due, wire));
+  }
+
+  int sends_of(uint16_t sequence) const {
+    int count = 0;
+    for (const Frame &frame : frames) {
+      count += frame.sequence == sequence;
+    }
+    return count;
+  }
+};
+
+static Receiver receiver;
+
+static void run_ms(uint32_t ms) {
+  for (uint32_t i = 0; i < ms * 10; i++) {
+    sim_advance_us(100);
+    receiver.poll();
+  }
+}
+
+static void framing(void) {
+  // Known answer for the receiver's own CRC
+  CHECK_EQ(crc16((const uint8_t *)"123456789", 9), 0x29B1);
+
+  notify_send(NOTIFY_TRIP, 0x7E, 0x7D); // Both special bytes in the body
+  run_ms(20);
+  CHECK_EQ(receiver.frames.size(), 1);
+  CHECK_EQ(receiver.bad, 0);
+  CHECK_EQ(receiver.frames[0].type, NOTIFY_TRIP);
+  CHECK_EQ(receiver.frames[0].zone, 0x7E);
+  CHECK_EQ(receiver.frames[0].mode, 0x7D);
+  CHECK(receiver.raw.find("\x7D\x5E") != std::string::npos);
+  CHECK(receiver.raw.find("\x7D\x5D") != std::string::npos);
+  CHECK_EQ((uint8_t)receiver.raw[0], 0x7E);
+  CHECK_EQ((uint8_t)receiver.raw.back(), 0x7E);
+  printf("single notification received %luus after notify_send\n",
+         (unsigned long)((uint32_t)receiver.frames[0].received_us - receiver.frames[0].timestamp_us));
+  run_ms(2000);
+  CHECK_EQ(receiver.frames.size(), 1); // Acknowledged, never resent
+}
+
+static void retries(void) {
+  // Corrupt acknowledgements are ignored, the frame keeps coming
+  receiver.frames.clear();
+  receiver.corrupt_acks = true;
+  notify_send(NOTIFY_DISARM, 0xF, 0);
+  run_ms(1200);
+  uint16_t disarm = receiver.frames[0].sequence;
+  CHECK(receiver.sends_of(disarm) >= 2);
+
+  // Nobody answering: the disarm gives up at NOTIFY_TRIES, an escalation doesn't
+  receiver.acking = false;
+  notify_send(NOTIFY_ESCALATE, 2, 3);
+  run_ms(20000);
+  CHECK_EQ(receiver.sends_of(disarm), NOTIFY_TRIES);
+  uint16_t escalate = receiver.frames.back().sequence;
+  CHECK_EQ(receiver.frames.back().type, NOTIFY_ESCALATE);
+  CHECK(receiver.sends_of(escalate) > 3 * NOTIFY_TRIES);
+
+  // A full queue of status notifications still takes an alarm
+  for (int i = 0; i < NOTIFY_QUEUE_SIZE - 1; i++) {
+    CHECK(notify_send(NOTIFY_ARM, 0xF, 3));
+  }
+  CHECK_EQ(notify_send(NOTIFY_DISARM, 0xF, 0), 0);
+  CHECK_EQ(notify_send(NOTIFY_TRIP, 5, 3), 1);
+
+  // Receiver back: every alarm arrives and is acknowledged
+  receiver.acking = true;
+  receiver.corrupt_acks = false;
+  receiver.frames.clear();
+  run_ms(5000);
+  int trips = 0, escalations = 0;
+  for (const Frame &frame : receiver.frames) {
+    trips += frame.type == NOTIFY_TRIP && frame.zone == 5;
+    escalations += frame.type == NOTIFY_ESCALATE;
+  }
+  CHECK(trips >= 1);
+  CHECK(escalations >= 1);
+  receiver.frames.clear();
+  run_ms(3000);
+  CHECK_EQ(receiver.frames.size(), 0); // Nothing left unacknowledged
+}
+
+// The receiver acknowledges a frame, then that acknowledgement turns up again a lap of an 8 bit
+// sequence later while an alarm is waiting for its own
+static void sequence_wrap(void) {
+  receiver.frames.clear();
+  notify_send(NOTIFY_ARM, 0xF, 2);
+  run_ms(20);
+  uint16_t stale = receiver.frames[0].sequence;
+  for (int i = 1; i < 256; i++) { // Numbers stale + 1 .. stale + 255, all acknowledged
+    notify_send(NOTIFY_DISARM, 0xF, 1);
+    run_ms(5);
+  }
+  receiver.acking = false;
+  notify_send(NOTIFY_TRIP, 3, 2);
+  run_ms(20);
+  uint16_t trip = receiver.frames.back().sequence;
+  CHECK_EQ(receiver.frames.back().type, NOTIFY_TRIP);
+  CHECK_EQ((uint8_t)trip, (uint8_t)stale); // Where the low byte has come round
+  CHECK(trip != stale);
+  receiver.ack(stale); // Late duplicate of the first acknowledgement
+  run_ms(1200);
+  CHECK(receiver.sends_of(trip) >= 2); // Still unacknowledged, still resent
+  receiver.acking = true;
+  run_ms(1000);
+  int sends = receiver.sends_of(trip);
+  run_ms(2000);
+  CHECK_EQ(receiver.sends_of(trip), sends); // Its own acknowledgement retired it
+}
+
+// Notifications offered as fast as the queue takes them for ten seconds
+static void sustained(void) {
+  receiver.frames.clear();
+  uint64_t start = sim_now_us();
+  uint32_t offered = 0, refused = 0;
+  while (sim_now_us() - start < 10000000) {
+    if (notify_send(NOTIFY_TRIP, offered % 14, 3)) {
+      offered++;
+    } else {
+      refused++;
+    }
+    run_ms(1);
+  }
+  run_ms(1000);
+  uint64_t total = 0, worst = 0;
+  for (const Frame &frame : receiver.frames) {
+    uint64_t latency = (uint32_t)frame.received_us - frame.timestamp_us; // Queued to fully received
+    total += latency;
+    worst = latency > worst ? latency : worst;
+  }
+  CHECK_EQ(receiver.frames.size(), offered);
+  CHECK_EQ(receiver.bad, 0);
+  printf("%lu notifications in 10s, %.0f/s, queue full %lu times, latency avg %lluus max %lluus\n",
+         (unsigned long)offered, offered / 10.0, (unsigned long)refused,
+         (unsigned long long)(receiver.frames.empty() ? 0 : total / receiver.frames.size()), (unsigned long long)worst);
+}
+
+int main() {
+  notify_start(TX, RX);
+  framing();
+  retries();
+  sequence_wrap();
+  sustained();
+  sim_exit(check_done());
+}
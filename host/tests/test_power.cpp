@@ -0,0 +1,72 @@
+// What wakes the board while nothing happens: the firmware boots, a passcode is set and the
+// display is left to go dark, then a minute of quiet is counted per wake source and against the
+// sim's own count of interrupts and thread wakeups. Printed for the record and checked against
+// what should remain: the microphone DMA, the ultrasonic pings, the watchdog kick and the slow
+// periodic timers, with no keypad scan and no flush on an empty telemetry stream.
+#include "check.h"
+#include "mbed.h"
+#include "power.h"
+#include "sim.h"
+
+int firmware_main();
+
+static void boot(void) { firmware_main(); }
+
+struct Window {
+  uint32_t wakeups;
+  uint32_t sources[WAKE_SOURCE_COUNT];
+  uint64_t busy_us;
+};
+
+static Window snapshot(void) {
+  Window window;
+  window.wakeups = sim_wakeups();
+  for (int i = 0; i < WAKE_SOURCE_COUNT; i++) {
+    window.sources[i] = power_wakeups[i];
+  }
+  mbed_stats_cpu_t stats;
+  mbed_stats_cpu_get(&stats);
+  window.busy_us = stats.uptime - stats.idle_time;
+  return window;
+}
+
+// Per second rates over seconds of quiet
+static Window measure(const char *name, uint32_t seconds) {
+  Window start = snapshot();
+  sim_advance_ms(seconds * 1000);
+  Window end = snapshot();
+  Window rate;
+  rate.wakeups = (end.wakeups - start.wakeups) / seconds;
+  for (int i = 0; i < WAKE_SOURCE_COUNT; i++) {
+    rate.sources[i] = (end.sources[i] - start.sources[i]) / seconds;
+  }
+  rate.busy_us = (end.busy_us - start.busy_us) / seconds;
+  printf("%s: %lu wakeups/s, busy %lu us/s (keypad edge=%lu scan=%lu ultrasonic=%lu microphone=%lu timer=%lu)\n",
+         name, (unsigned long)rate.wakeups, (unsigned long)rate.busy_us, (unsigned long)rate.sources[WAKE_KEYPAD_EDGE],
+         (unsigned long)rate.sources[WAKE_KEYPAD_SCAN], (unsigned long)rate.sources[WAKE_ULTRASONIC],
+         (unsigned long)rate.sources[WAKE_MICROPHONE], (unsigned long)rate.sources[WAKE_TIMER]);
+  return rate;
+}
+
+int main() {
+  sim_ultrasonic(PD_6, PD_5, 0); // Nothing in range
+  sim_boot(&boot);
+  sim_advance_ms(1500);
+  for (const char *key = "1234"; *key; key++) {
+    sim_press(*key);
+  }
+
+  Window lit = measure("unarmed, display lit", 5);
+  sim_advance_ms(10000); // Idle timeout turns the backlight off
+  CHECK_EQ(sim_lcd_backlight(), 0);
+  Window dark = measure("unarmed, display dark", 60);
+
+  CHECK_EQ(dark.sources[WAKE_KEYPAD_SCAN], 0);
+  CHECK_EQ(dark.sources[WAKE_KEYPAD_EDGE], 0);
+  CHECK(dark.sources[WAKE_MICROPHONE] >= 30 && dark.sources[WAKE_MICROPHONE] <= 32); // Half and full DMA blocks
+  CHECK(dark.sources[WAKE_TIMER] <= 1); // Watchdog kick, the journal and report timers are slower
+  CHECK(dark.wakeups < lit.wakeups);    // Status line redraws stop with the backlight
+  CHECK(dark.wakeups <= 60);
+  CHECK_EQ(sim_watchdog_resets(), 0);
+  sim_exit(check_done());
+}
@@ -0,0 +1,81 @@
+// Token bucket refill, burst and suppression counting, including across the 32 bit microsecond
+// wrap, then the microphone path: admitted events stay at the bucket's rate whatever the edge
+// rate, and sound_event only trips on SOUND_TRIP_EVENTS within SOUND_WINDOW_MS.
+#include "check.h"
+#include "ratelimit.h"
+#include "sim.h"
+#include "sound.h"
+
+static uint32_t take_all(RateLimit *limit, uint32_t now_us) {
+  uint32_t taken = 0;
+  while (rate_limit_take(limit, now_us)) {
+    taken++;
+  }
+  return taken;
+}
+
+static void bucket(void) {
+  RateLimit limit = RATE_LIMIT_INIT(10, 4); // A token every 100ms, 4 back to back
+  CHECK_EQ(limit.interval_us, 100000);
+  CHECK_EQ(take_all(&limit, 0), 4);
+  CHECK_EQ(limit.suppressed, 1);
+  CHECK_EQ(rate_limit_take(&limit, 99999), 0); // Not a whole interval yet
+  CHECK_EQ(rate_limit_take(&limit, 100000), 1);
+  CHECK_EQ(rate_limit_take(&limit, 150000), 0);
+  CHECK_EQ(take_all(&limit, 350000), 2); // 200000 and 300000 earned, the part interval carries over
+  CHECK_EQ(rate_limit_take(&limit, 400000), 1);
+  CHECK_EQ(take_all(&limit, 10000000), 4); // Long quiet refills to the burst, no more
+  CHECK_EQ(limit.suppressed, 5);
+
+  // A full bucket earns nothing, so the first token after a quiet spell still takes an interval
+  RateLimit idle = RATE_LIMIT_INIT(10, 1);
+  CHECK_EQ(rate_limit_take(&idle, 5000000), 1);
+  CHECK_EQ(rate_limit_take(&idle, 5050000), 0);
+  CHECK_EQ(rate_limit_take(&idle, 5100000), 1);
+
+  // us_ticker_read wraps every 71 minutes
+  RateLimit wrap = RATE_LIMIT_INIT(10, 2);
+  CHECK_EQ(take_all(&wrap, 0xFFFF0000u), 2);
+  CHECK_EQ(rate_limit_take(&wrap, 0xFFFF0000u + 100000), 1); // 0x000076A0 after the wrap
+  CHECK_EQ(rate_limit_take(&wrap, 0xFFFF0000u + 150000), 0);
+}
+
+// Edges at rate_per_s for a second, as isr_microphone calls sound_admit; returns admitted
+static uint32_t storm(uint32_t rate_per_s) {
+  sim_advance_ms(10000); // Bucket refills to the burst in between
+  uint32_t admitted = 0;
+  uint64_t gap_us = 1000000 / rate_per_s;
+  for (uint32_t i = 0; i < rate_per_s; i++) {
+    admitted += sound_admit();
+    sim_advance_us(gap_us);
+  }
+  return admitted;
+}
+
+static void microphone(void) {
+  uint32_t slow = storm(5);
+  CHECK_EQ(slow, 5); // Under the rate everything passes
+  uint32_t rates[] = {100, 1000, 10000, 100000};
+  for (uint32_t rate : rates) {
+    uint32_t admitted = storm(rate);
+    CHECK(admitted <= SOUND_BURST + SOUND_RATE_PER_S);
+    CHECK(admitted >= SOUND_RATE_PER_S);
+    printf("%6lu edges/s: %2lu admitted\n", (unsigned long)rate, (unsigned long)admitted);
+  }
+
+  // Trip confirmation: three events within the window, then counting starts afresh
+  CHECK_EQ(sound_event(1000000), 0);
+  CHECK_EQ(sound_event(2000000), 0);
+  CHECK_EQ(sound_event(3900000), 1); // 2.9s after the first
+  CHECK_EQ(sound_event(4000000), 0);
+  CHECK_EQ(sound_event(5000000), 0);
+  CHECK_EQ(sound_event(9000000), 0); // 5s after the oldest of the three
+  CHECK_EQ(sound_event(9500000), 0); // 4.5s
+  CHECK_EQ(sound_event(9600000), 1); // 0.6s
+}
+
+int main() {
+  bucket();
+  microphone();
+  sim_exit(check_done());
+}
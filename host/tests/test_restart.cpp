@@ -0,0 +1,90 @@
+// Boot to armed after a reset: the firmware is armed and reset, then tripped and reset again,
+// and each time it comes back it must already be in the saved mode with the alarm outputs on
+// before the LCD has finished initializing. sim_reset() starts this test over in a new process
+// with only flash and the RTC backup registers kept, so each run picks its part by sim_resets().
+// The sim charges no time for code, only for the fakes' modelled waits, so the restore lands at
+// reset plus register reads; the bound is what the snapshot path may cost on the board.
+#include "check.h"
+#include "sim.h"
+#include "state_machine.h"
+
+int firmware_main();
+
+extern uint32_t restored_at_us;
+
+#define RESTORE_BOUND_US 1000 // Three backup register reads and a few assignments before any thread starts
+#define EXIT_DELAY_MS 11000
+#define ENTRY_DELAY_MS 6000
+
+static void boot(void) { firmware_main(); }
+
+static void enter(const char *keys) {
+  for (const char *key = keys; *key; key++) {
+    sim_press(*key);
+  }
+}
+
+static int lcd_blank(void) {
+  for (int row = 0; row < 2; row++) {
+    for (const char *c = sim_lcd_row(row); *c; c++) {
+      if (*c != ' ') {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+// Restored as soon as main() has run, while the LCD is still in its power up wait
+static void check_restored(int mode, int outputs) {
+  CHECK_EQ(sm_mode(), mode);
+  CHECK_EQ(sim_pin_level(PD_15), outputs);
+  CHECK_EQ(sim_pin_level(PD_4), outputs);
+  CHECK(restored_at_us <= RESTORE_BOUND_US);
+  CHECK(lcd_blank());
+  printf("reset %lu: mode %d restored %luus after reset, LCD not yet initialized\n",
+         (unsigned long)sim_resets(), sm_mode(), (unsigned long)restored_at_us);
+}
+
+int main() {
+  sim_ultrasonic(PD_6, PD_5, 0); // Nothing in range
+  sim_boot(&boot);
+
+  switch (sim_resets()) {
+  case 0: // Cold start, set a passcode and arm
+    CHECK_EQ(sm_mode(), 0);
+    sim_advance_ms(1500);
+    enter("1234");
+    enter("A1234");
+    sim_advance_ms(EXIT_DELAY_MS);
+    CHECK_EQ(sm_mode(), 2);
+    if (check_failures) { // Stop here, the next run would start from a wrong state
+      break;
+    }
+    sim_reset(RESET_REASON_WATCHDOG);
+    break;
+
+  case 1: // Armed with no exit delay, a trip goes straight to the alarm
+    check_restored(2, 0);
+    sim_ultrasonic(PD_6, PD_5, 100);
+    sim_advance_ms(ENTRY_DELAY_MS); // Buzzer sounds once the entry delay runs out
+    CHECK_EQ(sm_mode(), 3);
+    CHECK_EQ(sim_pin_level(PD_4), 1);
+    if (check_failures) { // Stop here, the next run would start from a wrong state
+      break;
+    }
+    sim_reset(RESET_REASON_SOFTWARE);
+    break;
+
+  case 2: // Alarm sounding again at once, the LCD catches up later
+    check_restored(3, 1);
+    sim_advance_ms(1500);
+    CHECK(!lcd_blank());
+    enter("A1234");
+    CHECK_EQ(sm_mode(), 1);
+    CHECK_EQ(sim_pin_level(PD_4), 0);
+    break;
+  }
+  CHECK_EQ(sim_watchdog_resets(), 0);
+  sim_exit(check_done());
+}
@@ -0,0 +1,76 @@
+// Boots the firmware on the virtual board and walks it through setting a passcode, arming,
+// an intrusion seen by the ultrasonic zone and disarming, checking the LCD, LEDs and buzzer.
+#include "check.h"
+#include "sim.h"
+#include <cstring>
+
+int firmware_main();
+
+static void boot(void) { firmware_main(); }
+
+static void enter(const char *keys) {
+  for (const char *key = keys; *key; key++) {
+    sim_press(*key);
+  }
+}
+
+static int shows(int row, const char *text) { return strstr(sim_lcd_row(row), text) != nullptr; }
+
+int main() {
+  sim_ultrasonic(PD_6, PD_5, 0); // Nothing in range
+  sim_boot(&boot);
+  sim_advance_ms(1500); // LCD power up wait and initialization
+  CHECK(shows(0, "Set Passcode"));
+  CHECK(sim_lcd_backlight());
+
+  enter("1234");
+  sim_advance_ms(100);
+  CHECK(shows(0, "Unarmed"));
+
+  enter("A1234");
+  sim_advance_ms(100);
+  CHECK(shows(0, "Armed"));
+  CHECK_EQ(sim_pin_level(PD_15), 0);
+  CHECK_EQ(sim_pin_level(PD_4), 0);
+
+  sim_advance_ms(11000); // Exit delay
+  CHECK(shows(0, "Armed"));
+  CHECK_EQ(sim_pin_level(PD_15), 0);
+
+  uint64_t trip_us = sim_now_us();
+  sim_ultrasonic(PD_6, PD_5, 100); // Someone walks in
+  while (!sim_pin_level(PD_15) && sim_now_us() - trip_us < 2000000) {
+    sim_advance_ms(1);
+  }
+  uint64_t leds_us = sim_now_us();
+  CHECK_EQ(sim_pin_level(PD_15), 1);
+  CHECK(leds_us - trip_us < 500000);
+  CHECK_EQ(sim_pin_level(PD_4), 0); // Entry delay before the buzzer
+
+  int toggles = 0, last = 1;
+  while (sim_now_us() - leds_us < 4900000) {
+    sim_advance_ms(10);
+    if (sim_pin_level(PD_15) != last) {
+      last = !last;
+      toggles++;
+    }
+    CHECK_EQ(sim_pin_level(PD_4), 0);
+  }
+  CHECK(toggles >= 8); // 500 ms blink
+  CHECK(shows(0, "Triggered"));
+  CHECK(shows(1, "Zone: Ultrasonic"));
+  sim_advance_ms(200);
+  CHECK_EQ(sim_pin_level(PD_4), 1);
+
+  sim_ultrasonic(PD_6, PD_5, 0);
+  enter("A1234");
+  sim_advance_ms(100);
+  CHECK(shows(0, "Unarmed"));
+  CHECK_EQ(sim_pin_level(PD_15), 0);
+  CHECK_EQ(sim_pin_level(PD_4), 0);
+  sim_advance_ms(2000);
+  CHECK_EQ(sim_pin_level(PD_15), 0);
+  CHECK_EQ(sim_watchdog_resets(), 0);
+
+  sim_exit(check_done());
+}
@@ -0,0 +1,119 @@
+// Walks the transition table through the arm, trip and disarm paths, then pushes millions of
+// synthetic key and sensor inputs through sm_dispatch to measure the cost per event.
+#include "check.h"
+#include "sim.h"
+#include "state_machine.h"
+#include <chrono>
+
+#define BENCH_EVENTS 5000000
+
+static char stored[4];
+static char entered[4];
+static int position = 0;
+static uint32_t actions[ACTION_COUNT];
+
+// Application side of the table, the passcode handling of main.cpp without the outputs
+int sm_run_action(SecurityAction action, char key) {
+  actions[action]++;
+  switch (action) {
+  case ACTION_STORE_DIGIT:
+    stored[position++] = key;
+    if (position == 4) {
+      position = 0;
+      return INPUT_CODE_COMPLETE;
+    }
+    break;
+  case ACTION_BEGIN_ENTRY:
+  case ACTION_IDLE:
+    position = 0;
+    break;
+  case ACTION_ENTRY_DIGIT:
+    entered[position++] = key;
+    if (position == 4) {
+      position = 0;
+      return memcmp(stored, entered, 4) == 0 ? INPUT_CODE_MATCH : INPUT_CODE_MISMATCH;
+    }
+    break;
+  default:
+    break;
+  }
+  return -1;
+}
+
+static SecurityAction press(char key) { return sm_dispatch(sm_key_input(key), key); }
+
+static SecurityAction keys(const char *text) {
+  SecurityAction last = ACTION_NONE;
+  for (const char *key = text; *key; key++) {
+    last = press(*key);
+  }
+  return last;
+}
+
+int main() {
+  CHECK_EQ(sm_state(), STATE_SET_PASSCODE);
+  CHECK_EQ(press('A'), ACTION_NONE);
+  CHECK_EQ(sm_dispatch(INPUT_SENSOR_TRIP), ACTION_NONE); // Nothing to trip before a passcode
+  CHECK_EQ(keys("1234"), ACTION_PASSCODE_SET);
+  CHECK_EQ(sm_state(), STATE_UNARMED);
+  CHECK_EQ(sm_mode(), 1);
+
+  CHECK_EQ(keys("A1111"), ACTION_REJECT_CODE);
+  CHECK_EQ(sm_state(), STATE_UNARMED);
+  CHECK_EQ(keys("A12"), ACTION_ENTRY_DIGIT);
+  CHECK_EQ(sm_dispatch(INPUT_IDLE), ACTION_IDLE); // Idle drops a partial entry
+  CHECK_EQ(sm_state(), STATE_UNARMED);
+  CHECK_EQ(keys("A1234"), ACTION_ARM);
+  CHECK_EQ(sm_mode(), 2);
+
+  CHECK_EQ(press('#'), ACTION_NONE);
+  CHECK_EQ(keys("A12"), ACTION_ENTRY_DIGIT);
+  CHECK_EQ(sm_dispatch(INPUT_SENSOR_TRIP), ACTION_TRIGGER); // Trips while the code is half entered
+  CHECK_EQ(sm_state(), STATE_TRIGGERED);
+  CHECK_EQ(sm_dispatch(INPUT_SENSOR_TRIP), ACTION_NONE);
+  CHECK_EQ(keys("A9999"), ACTION_REJECT_CODE);
+  CHECK_EQ(sm_mode(), 3);
+  CHECK_EQ(keys("A1234"), ACTION_DISARM);
+  CHECK_EQ(sm_state(), STATE_UNARMED);
+
+  sm_restore_mode(3);
+  CHECK_EQ(sm_state(), STATE_TRIGGERED);
+  sm_restore_mode(2);
+  CHECK_EQ(sm_state(), STATE_ARMED);
+  CHECK_EQ(sm_key_input('0'), INPUT_DIGIT);
+  CHECK_EQ(sm_key_input('A'), INPUT_ARM_KEY);
+  CHECK_EQ(sm_key_input('D'), INPUT_OTHER_KEY);
+
+  // Benchmark: random keys with the odd sensor trip and idle, mostly the real code so the
+  // table keeps cycling through every mode
+  static const char code_keys[] = "A1234";
+  static const char noise_keys[] = "0123456789ABCD*#";
+  uint32_t seed = 1;
+  memset(actions, 0, sizeof(actions));
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < BENCH_EVENTS; i++) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    uint32_t pick = seed % 64;
+    if (pick == 0) {
+      sm_dispatch(INPUT_SENSOR_TRIP);
+    } else if (pick == 1) {
+      sm_dispatch(INPUT_IDLE);
+    } else if (pick < 48) {
+      press(code_keys[i % 5]);
+    } else {
+      press(noise_keys[seed >> 28]);
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  CHECK(actions[ACTION_ARM] > 0);
+  CHECK(actions[ACTION_TRIGGER] > 0);
+  CHECK(actions[ACTION_DISARM] > 0);
+  CHECK_EQ(actions[ACTION_MISSING], 0);
+  printf("%d events in %.3fs, %.1f ns per dispatch (%lu arms, %lu trips, %lu disarms)\n", BENCH_EVENTS,
+         seconds, seconds * 1e9 / BENCH_EVENTS, (unsigned long)actions[ACTION_ARM],
+         (unsigned long)actions[ACTION_TRIGGER], (unsigned long)actions[ACTION_DISARM]);
+
+  sim_exit(check_done());
+}
@@ -0,0 +1,160 @@
+// Telemetry packets off the simulated USART3, decoded here without telemetry.cpp's help: varint
+// times and zigzag value deltas round trip at their extremes, deltas restart in every packet,
+// a burst that outruns the UART loses whole samples, never corrupts one, and a stream sends its
+// own packets, waking nothing once it is empty. The capture is written out for the
+// telemetry_decode test.
+#include "check.h"
+#include "sim.h"
+#include "telemetry.h"
+#include <vector>
+
+#define TX PD_8
+#define CAPTURE_PATH "telemetry_capture.bin"
+
+struct Decoded {
+  uint32_t time_us;
+  int source;
+  int channel;
+  uint32_t value;
+};
+
+static std::string capture; // Everything the UART sent
+
+static uint32_t varint(const uint8_t *bytes, size_t *at) {
+  uint32_t value = 0;
+  for (int shift = 0;; shift += 7) {
+    uint8_t byte = bytes[(*at)++];
+    value |= (uint32_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return value;
+    }
+  }
+}
+
+static std::vector<Decoded> take(int *packets) {
+  std::string bytes = sim_uart_take(TX);
+  capture += bytes;
+  const uint8_t *data = (const uint8_t *)bytes.data();
+  std::vector<Decoded> samples;
+  *packets = 0;
+  for (size_t at = 0; at + 8 <= bytes.size();) {
+    CHECK(data[at] == 0xA5 && data[at + 1] == 0x5A);
+    size_t end = at + 8 + data[at + 3];
+    uint32_t time_us = data[at + 4] | data[at + 5] << 8 | data[at + 6] << 16 | (uint32_t)data[at + 7] << 24;
+    uint32_t last[TELEMETRY_SOURCE_COUNT][16] = {};
+    for (at += 8; at < end;) {
+      Decoded sample;
+      sample.source = data[at] >> 4;
+      sample.channel = data[at++] & 0xF;
+      time_us += varint(data, &at);
+      uint32_t zigzag = varint(data, &at);
+      last[sample.source][sample.channel] += (zigzag >> 1) ^ (0u - (zigzag & 1));
+      sample.time_us = time_us;
+      sample.value = last[sample.source][sample.channel];
+      samples.push_back(sample);
+    }
+    CHECK_EQ(at, end); // Samples fill the length exactly
+    (*packets)++;
+  }
+  return samples;
+}
+
+static void extremes(void) {
+  sim_advance_ms(1000);
+  telemetry_sample(TELEMETRY_ECHO, 0, 5831);
+  sim_advance_us(100);
+  telemetry_sample(TELEMETRY_ECHO, 0, 5000); // Negative delta
+  telemetry_sample(TELEMETRY_KEY, 3, 1);     // Same microsecond, other tag
+  sim_advance_us(200000);                    // Three byte time varint, inside TELEMETRY_FLUSH_MS
+  telemetry_sample(TELEMETRY_MIC_LEVEL, 1, 0xFFFFFFFF);
+  telemetry_sample(TELEMETRY_MIC_LEVEL, 1, 0); // Five byte value varint after the zigzag
+  telemetry_sample(TELEMETRY_KEY, 3, 0);
+  telemetry_flush();
+  sim_advance_ms(10);
+
+  int packets;
+  std::vector<Decoded> samples = take(&packets);
+  CHECK_EQ(packets, 1);
+  CHECK_EQ(samples.size(), 6);
+  if (samples.size() == 6) {
+    const Decoded expected[6] = {{1000000, TELEMETRY_ECHO, 0, 5831},
+                                 {1000100, TELEMETRY_ECHO, 0, 5000},
+                                 {1000100, TELEMETRY_KEY, 3, 1},
+                                 {1200100, TELEMETRY_MIC_LEVEL, 1, 0xFFFFFFFF},
+                                 {1200100, TELEMETRY_MIC_LEVEL, 1, 0},
+                                 {1200100, TELEMETRY_KEY, 3, 0}};
+    for (int i = 0; i < 6; i++) {
+      CHECK_EQ(samples[i].time_us, expected[i].time_us);
+      CHECK_EQ(samples[i].source, expected[i].source);
+      CHECK_EQ(samples[i].channel, expected[i].channel);
+      CHECK_EQ(samples[i].value, expected[i].value);
+    }
+  }
+
+  // The next packet starts its deltas from 0 again
+  telemetry_sample(TELEMETRY_ECHO, 0, 5010);
+  telemetry_flush();
+  sim_advance_ms(10);
+  samples = take(&packets);
+  CHECK_EQ(samples.size(), 1);
+  CHECK_EQ(samples.empty() ? 0 : samples[0].value, 5010);
+}
+
+// More samples at once than two packets hold: the first fills and goes out, the second fills
+// while it is on the wire, the rest are lost until a packet is free again
+static void burst(void) {
+  const int count = 200;
+  for (int i = 0; i < count; i++) {
+    telemetry_sample(TELEMETRY_ECHO, i % 4, 3000 + i * 7);
+  }
+  sim_advance_ms(10);
+  telemetry_flush();
+  sim_advance_ms(10);
+  int packets;
+  std::vector<Decoded> samples = take(&packets);
+  CHECK_EQ(packets, 2);
+  CHECK(samples.size() > 60 && samples.size() < count);
+  for (size_t i = 0; i < samples.size(); i++) {
+    CHECK_EQ(samples[i].value, 3000 + i * 7); // An unbroken prefix, nothing corrupted
+    CHECK_EQ(samples[i].channel, i % 4);
+  }
+  printf("burst of %d samples: %lu sent in %d packets, the rest lost\n", count, (unsigned long)samples.size(),
+         packets);
+}
+
+// Nobody calls telemetry_flush: a steady stream goes out packet by packet as it ages, the tail of
+// a stream that stops goes out on the quiet timeout, and after that nothing wakes
+static void self_flushing(void) {
+  sim_advance_ms(1000);
+  uint32_t wakeups = sim_wakeups();
+  for (int i = 0; i < 100; i++) { // 32 ms apart, one sample a microphone block
+    telemetry_sample(TELEMETRY_MIC_LEVEL, 1, 100 + i);
+    sim_advance_ms(32);
+  }
+  int packets;
+  std::vector<Decoded> samples = take(&packets);
+  CHECK_EQ(packets, 12); // 8 samples, 256 ms, to a packet
+  CHECK_EQ(samples.size(), 96);
+  CHECK_EQ(sim_wakeups() - wakeups, 12); // Each write's completion interrupt, no flush timer
+
+  sim_advance_ms(2 * TELEMETRY_FLUSH_MS);
+  samples = take(&packets);
+  CHECK_EQ(packets, 1); // The last 4 samples, sent by the quiet timeout
+  CHECK_EQ(samples.size(), 4);
+  wakeups = sim_wakeups();
+  sim_advance_ms(10000);
+  CHECK_EQ(sim_wakeups() - wakeups, 0);
+}
+
+int main() {
+  telemetry_start(TX);
+  extremes();
+  burst();
+  self_flushing();
+  FILE *file = fopen(CAPTURE_PATH, "wb");
+  CHECK(file && fwrite(capture.data(), 1, capture.size(), file) == capture.size());
+  if (file) {
+    fclose(file);
+  }
+  sim_exit(check_done());
+}
@@ -0,0 +1,143 @@
+// Runs the timer wheel on the virtual clock the way the mode thread does, sleeping for what
+// timer_advance() returns, and checks every timer fires on its tick: level 0, cascaded from
+// level 1, parked beyond the wheel, restarted and cancelled from callbacks.
+#include "check.h"
+#include "clock.h"
+#include "sim.h"
+#include "timers.h"
+#include <array>
+#include <utility>
+
+#define RANDOM_TIMERS 256
+
+static WheelTimer timers[RANDOM_TIMERS];
+static uint64_t due_us[RANDOM_TIMERS]; // 0 when the timer isn't expected to fire
+static uint32_t fired[RANDOM_TIMERS];
+static uint32_t late[RANDOM_TIMERS]; // Worst lateness past the due time, us
+static int early = 0;
+static uint32_t seed = 12345;
+
+static uint32_t random_below(uint32_t limit) {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed % limit;
+}
+
+template <int N> static void fire(void) {
+  fired[N]++;
+  uint64_t now = sim_now_us();
+  if (now < due_us[N]) {
+    early++;
+  } else if (now - due_us[N] > late[N]) {
+    late[N] = now - due_us[N];
+  }
+}
+
+template <int... N> static constexpr std::array<void (*)(void), sizeof...(N)> callbacks(std::integer_sequence<int, N...>) {
+  return {{&fire<N>...}};
+}
+static const std::array<void (*)(void), RANDOM_TIMERS> fire_of = callbacks(std::make_integer_sequence<int, RANDOM_TIMERS>());
+
+static void start(int n, uint32_t delay_ms) {
+  uint32_t ticks = (delay_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+  due_us[n] = sim_now_us() + (uint64_t)(ticks ? ticks : 1) * TIMER_TICK_MS * 1000 - TIMER_TICK_MS * 1000;
+  timer_start(&timers[n], delay_ms, fire_of[n]);
+}
+
+// Mode thread loop without events: run what's due, sleep as told, capped like the watchdog kick
+static void run_for(uint32_t ms) {
+  uint64_t end = sim_now_us() + (uint64_t)ms * 1000;
+  while (sim_now_us() < end) {
+    uint32_t sleep_ms = timer_advance();
+    sleep_ms = sleep_ms > 1000 ? 1000 : sleep_ms;
+    uint64_t wake = sim_now_us() + (uint64_t)sleep_ms * 1000;
+    sim_advance_us((wake < end ? wake : end) - sim_now_us());
+  }
+  timer_advance();
+}
+
+static WheelTimer periodic, victim;
+static int periodic_runs = 0;
+static void victim_fired(void) { CHECK(0); }
+static void periodic_fired(void) {
+  periodic_runs++;
+  timer_cancel(&victim); // Callbacks may cancel other timers
+  if (periodic_runs < 5) {
+    timer_start(&periodic, 500, &periodic_fired);
+  }
+}
+
+int main() {
+  sim_advance_us(3333); // Start mid tick
+  timer_init();
+  CHECK_EQ(timer_advance(), osWaitForever);
+
+  start(0, 25); // Level 0
+  start(1, 0);  // Next tick, never the one being processed
+  start(2, 5000); // Level 1, cascades
+  start(3, 60000); // Beyond the 40.96s the two levels span, parked and re-inserted
+  start(4, 700);
+  CHECK_EQ(timer_active(&timers[0]), 1);
+  uint32_t sleep_ms = timer_advance();
+  CHECK(sleep_ms >= 1 && sleep_ms <= TIMER_TICK_MS);
+  timer_cancel(&timers[4]);
+  due_us[4] = 0;
+  CHECK_EQ(timer_active(&timers[4]), 0);
+  timer_cancel(&timers[4]); // Twice is harmless
+
+  run_for(61000);
+  CHECK_EQ(fired[0], 1);
+  CHECK_EQ(fired[1], 1);
+  CHECK_EQ(fired[2], 1);
+  CHECK_EQ(fired[3], 1);
+  CHECK_EQ(fired[4], 0);
+  for (int n = 0; n < 4; n++) {
+    CHECK(late[n] < TIMER_TICK_MS * 1000 * 2);
+    CHECK_EQ(timer_active(&timers[n]), 0);
+  }
+  CHECK_EQ(timer_advance(), osWaitForever);
+
+  // Restarting moves the expiry
+  memset(fired, 0, sizeof(fired));
+  start(5, 300);
+  run_for(200);
+  start(5, 300);
+  run_for(200);
+  CHECK_EQ(fired[5], 0);
+  run_for(200);
+  CHECK_EQ(fired[5], 1);
+
+  timer_start(&victim, 1200, &victim_fired);
+  timer_start(&periodic, 500, &periodic_fired);
+  run_for(5000);
+  CHECK_EQ(periodic_runs, 5);
+  CHECK_EQ(timer_active(&victim), 0);
+
+  // Many timers at once, random delays across both levels and beyond, some cancelled
+  memset(fired, 0, sizeof(fired));
+  memset(late, 0, sizeof(late));
+  for (int round = 0; round < 4; round++) {
+    for (int n = 0; n < RANDOM_TIMERS; n++) {
+      start(n, random_below(round == 3 ? 90000 : 3000));
+    }
+    for (int n = 0; n < RANDOM_TIMERS; n += 7) {
+      timer_cancel(&timers[n]);
+      due_us[n] = 0;
+    }
+    run_for(round == 3 ? 91000 : 3100);
+    for (int n = 0; n < RANDOM_TIMERS; n++) {
+      CHECK_EQ(fired[n], due_us[n] ? 1 : 0);
+      fired[n] = 0;
+    }
+  }
+  CHECK_EQ(early, 0);
+  uint32_t worst = 0;
+  for (int n = 0; n < RANDOM_TIMERS; n++) {
+    worst = late[n] > worst ? late[n] : worst;
+  }
+  printf("worst lateness %luus over %d random timers\n", (unsigned long)worst, RANDOM_TIMERS);
+  CHECK(worst < TIMER_TICK_MS * 1000 * 2);
+
+  sim_exit(check_done());
+}
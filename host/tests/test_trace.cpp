@@ -0,0 +1,47 @@
+// Records tracepoints on the virtual clock, wraps the ring and dumps it into a file the way the
+// console would carry it, between lines of text. The trace_decode test then decodes that file.
+#include "check.h"
+#include "sim.h"
+#include "trace.h"
+
+int main() {
+  trace_init();
+  for (int i = 0; i < TRACE_RING_SIZE; i++) { // Wrap the ring so the dump starts mid history
+    TRACE_BEGIN(TRACE_ISR_KEYPAD_SCAN);
+    sim_busy_us(2);
+    TRACE_END(TRACE_ISR_KEYPAD_SCAN);
+    sim_advance_us(100);
+  }
+  TRACE_BEGIN(TRACE_HANDLE_EVENT);
+  TRACE_BEGIN(TRACE_LCD_TRANSMIT); // Nested handlers pair by id
+  sim_busy_us(90);
+  TRACE_END(TRACE_LCD_TRANSMIT);
+  sim_busy_us(10);
+  TRACE_END(TRACE_HANDLE_EVENT);
+  CHECK_EQ(trace_next, 2 * TRACE_RING_SIZE + 4);
+  CHECK_EQ(trace_ring[(trace_next - 1) % TRACE_RING_SIZE].id, TRACE_HANDLE_EVENT | TRACE_END_FLAG);
+  CHECK_EQ(trace_ring[(trace_next - 1) % TRACE_RING_SIZE].cycles - trace_ring[(trace_next - 4) % TRACE_RING_SIZE].cycles,
+           100 * (SIM_CORE_HZ / 1000000));
+
+  FILE *console = freopen("trace_dump.bin", "wb", stdout);
+  CHECK(console != nullptr);
+  printf("latency report...\r\n");
+  trace_dump();
+  printf("lanes report...\r\n");
+  fclose(stdout);
+
+  FILE *file = fopen("trace_dump.bin", "rb");
+  char text[20];
+  CHECK(fread(text, 1, 19, file) == 19);
+  TraceDumpHeader header;
+  CHECK(fread(&header, sizeof(header), 1, file) == 1);
+  fclose(file);
+  CHECK(memcmp(header.magic, TRACE_DUMP_MAGIC, 4) == 0);
+  CHECK_EQ(header.count, TRACE_RING_SIZE);
+  CHECK_EQ(header.written, 2 * TRACE_RING_SIZE + 4);
+  CHECK_EQ(header.id_count, TRACE_ID_COUNT);
+  CHECK_EQ(header.core_hz, SIM_CORE_HZ);
+
+  fprintf(stderr, "%d checks, %d failed\n", check_count, check_failures);
+  sim_exit(check_failures ? 1 : 0);
+}
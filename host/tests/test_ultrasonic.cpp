@@ -0,0 +1,76 @@
+// Replays HC-SR04 pulse width traces through the conversion, median filter and background
+// model: a person walking up, single spurious echoes, an empty room and furniture in range.
+#include "check.h"
+#include "sim.h"
+#include "ultrasonic.h"
+
+#define LENGTH(trace) (int)(sizeof(trace) / sizeof(trace[0]))
+
+// Widths in us, one per ping. 38000 is the sensor's timeout when nothing answers.
+static const uint32_t walk_up[] = {38000, 38000, 11662, 9329, 7580, 5831, 4665, 3498, 2332, 1749, 1166, 875, 875};
+static const uint32_t spikes[] = {2915, 2915, 583, 2915, 2915, 40, 2915, 583, 2915, 2915}; // 500mm, glitches at 100mm and noise
+static const uint32_t empty_room[] = {38000, 38000, 38000, 38000, 38000, 38000, 38000, 38000};
+
+static int trips(const uint32_t *trace, int length, int *first) {
+  UltrasonicFilter filter;
+  ultrasonic_filter_init(&filter, ULTRASONIC_TRIP_MM);
+  int count = 0;
+  *first = -1;
+  for (int i = 0; i < length; i++) {
+    if (ultrasonic_add_pulse(&filter, trace[i])) {
+      if (*first < 0) {
+        *first = i;
+      }
+      count++;
+    }
+  }
+  return count;
+}
+
+int main() {
+  // Conversion: 343 m/s, there and back, rounded
+  CHECK_EQ(ultrasonic_pulse_to_mm(5831), 1000);
+  CHECK_EQ(ultrasonic_pulse_to_mm(875), 150);
+  CHECK_EQ(ultrasonic_pulse_to_mm(117), 20);
+  CHECK_EQ(ultrasonic_pulse_to_mm(100), 0); // Under the minimum range
+  CHECK_EQ(ultrasonic_pulse_to_mm(23324), 4000);
+  CHECK_EQ(ultrasonic_pulse_to_mm(38000), ULTRASONIC_NO_ECHO);
+
+  int first;
+  CHECK_EQ(trips(walk_up, LENGTH(walk_up), &first), 1);
+  CHECK_EQ(first, LENGTH(walk_up) - 1); // Median needs two of three readings in range
+  CHECK_EQ(trips(spikes, LENGTH(spikes), &first), 0); // Single echoes never win the median
+  CHECK_EQ(trips(empty_room, LENGTH(empty_room), &first), 0);
+
+  UltrasonicFilter filter;
+  ultrasonic_filter_init(&filter, 600);
+  for (int i = 0; i < LENGTH(spikes); i++) {
+    ultrasonic_add_pulse(&filter, spikes[i]);
+  }
+  CHECK_EQ(filter.distance_mm, 500);
+  CHECK_EQ(ultrasonic_add_pulse(&filter, 40), 0); // Noise leaves the window alone
+  CHECK_EQ(filter.distance_mm, 500);
+
+  // Background: learn a wardrobe at 1.2m with some jitter, then a person at 0.6m deviates
+  Background scene;
+  background_init(&scene);
+  CHECK_EQ(background_deviates(&scene, 100), 0); // Nothing learned yet
+  for (int i = 0; i < 40; i++) {
+    background_learn(&scene, 1200 + (i % 5) * 4 - 8);
+  }
+  CHECK(scene.mean_mm >= 1190 && scene.mean_mm <= 1210);
+  CHECK_EQ(background_deviates(&scene, 1210), 0);
+  CHECK_EQ(background_deviates(&scene, 1250), 0); // Under BACKGROUND_MIN_MM
+  CHECK_EQ(background_deviates(&scene, 600), 1);
+  CHECK_EQ(background_deviates(&scene, ULTRASONIC_NO_ECHO), 1); // Wardrobe gone is a change too
+
+  // An empty room is a scene as well, anything in range stands out
+  background_init(&scene);
+  for (int i = 0; i < BACKGROUND_WARMUP; i++) {
+    background_learn(&scene, ULTRASONIC_NO_ECHO);
+  }
+  CHECK_EQ(background_deviates(&scene, ULTRASONIC_NO_ECHO), 0);
+  CHECK_EQ(background_deviates(&scene, 3500), 1);
+
+  sim_exit(check_done());
+}
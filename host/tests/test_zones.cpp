@@ -0,0 +1,157 @@
+// The ping scheduler with nine HC-SR04 zones in three ping groups: every trigger and echo pin is
+// sampled while the groups take turns, and no two groups may ever be pulsing or echoing at the
+// same time. A group whose echoes all came back hands over after the 2ms guard; the last group
+// has a sensor that never answers, so its turn must run out on the 40ms timeout instead. Each
+// zone's echoes must carry its own distance, and the ping rate is printed for the record.
+#include "check.h"
+#include "events.h"
+#include "sim.h"
+#include "ultrasonic.h"
+#include "zones.h"
+
+#define ZONES 9
+#define GROUPS 3
+#define DEAD_ZONE 8  // Wired to nothing, its echo never comes
+#define STEP_US 2    // Sampling period, well under the 10us trigger pulse
+#define RUN_MS 3000
+#define ECHO_DELAY_US 250 // The sim's HC-SR04 raises echo this long after the trigger drops
+#define SLACK_US 20  // Sampling plus the timer hops between the end of a turn and the next trigger
+
+static const ZoneConfig table[ZONES] = {
+    {"Hall", ZONE_ULTRASONIC, 0, PE_0, PF_0, 150, 1 << 2},
+    {"Kitchen", ZONE_ULTRASONIC, 0, PE_1, PF_1, 150, 1 << 2},
+    {"Lounge", ZONE_ULTRASONIC, 0, PE_2, PF_2, 150, 1 << 2},
+    {"Stairs", ZONE_ULTRASONIC, 1, PE_3, PF_3, 150, 1 << 2},
+    {"Landing", ZONE_ULTRASONIC, 1, PE_4, PF_4, 150, 1 << 2},
+    {"Garage", ZONE_ULTRASONIC, 1, PE_5, PF_5, 150, 1 << 2},
+    {"Office", ZONE_ULTRASONIC, 2, PE_6, PF_6, 150, 1 << 2},
+    {"Porch", ZONE_ULTRASONIC, 2, PE_7, PF_7, 150, 1 << 2},
+    {"Shed", ZONE_ULTRASONIC, 2, PE_8, PF_8, 150, 1 << 2},
+};
+
+// Object in front of each sensor, 0 for nothing in range (the longest echo, 38ms)
+static const uint32_t distance_mm[ZONES] = {300, 600, 900, 400, 1200, 0, 500, 800, 0};
+
+struct Turn {
+  int group;
+  uint64_t start_us;  // First trigger of the group rose
+  uint64_t end_us;    // Last of its pins fell
+};
+
+static int group_active(int group) {
+  for (int i = 0; i < ZONES; i++) {
+    if (table[i].ping_group == group && (sim_pin_level(table[i].trigger) || sim_pin_level(table[i].echo))) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int main() {
+  event_init();
+  for (int i = 0; i < ZONES; i++) {
+    if (i != DEAD_ZONE) {
+      sim_ultrasonic(table[i].trigger, table[i].echo, distance_mm[i]);
+    }
+  }
+  zones_start(table, ZONES);
+
+  uint32_t pings[ZONES] = {0};
+  uint32_t echoes[ZONES] = {0};
+  uint32_t wrong_distance = 0;
+  int trigger_level[ZONES] = {0};
+  uint32_t overlaps = 0;
+  Turn turns[256];
+  int turn_count = 0;
+  int current = -1;
+
+  for (uint64_t t = 0; t < RUN_MS * 1000ull; t += STEP_US) {
+    sim_advance_us(STEP_US);
+    int active = 0;
+    for (int group = 0; group < GROUPS; group++) {
+      if (!group_active(group)) {
+        continue;
+      }
+      active++;
+      if (group != current && turn_count < 256) { // A different group's pins moved, its turn began
+        turns[turn_count++] = {group, sim_now_us(), sim_now_us()};
+        current = group;
+      }
+      if (group == current) {
+        turns[turn_count - 1].end_us = sim_now_us();
+      }
+    }
+    overlaps += active > 1;
+    for (int i = 0; i < ZONES; i++) {
+      int level = sim_pin_level(table[i].trigger);
+      pings[i] += level && !trigger_level[i];
+      trigger_level[i] = level;
+    }
+    while (event_pending()) { // Never blocks with an event ready
+      IsrEvent event;
+      event_wait(&event, 0);
+      if (event.type != EVENT_ECHO_PULSE || event.source >= ZONES) {
+        continue;
+      }
+      echoes[event.source]++;
+      uint16_t mm = ultrasonic_pulse_to_mm(event.value);
+      uint32_t expected = distance_mm[event.source];
+      if (expected ? mm + 1 < expected || mm > expected + 1 : mm != ULTRASONIC_NO_ECHO) {
+        wrong_distance++;
+      }
+    }
+  }
+
+  CHECK_EQ(overlaps, 0);
+  CHECK_EQ(wrong_distance, 0);
+  CHECK(turn_count > GROUPS * 10);
+  uint32_t guards = 0, timeouts = 0;
+  for (int i = 1; i < turn_count; i++) {
+    const Turn &last = turns[i - 1];
+    const Turn &turn = turns[i];
+    CHECK_EQ(turn.group, (last.group + 1) % GROUPS); // Groups take turns in order
+    if (last.group == table[DEAD_ZONE].ping_group) { // Waited out the missing echo
+      uint64_t waited_us = turn.start_us - last.start_us;
+      CHECK(waited_us >= ZONE_TRIGGER_US + ZONE_PING_TIMEOUT_US);
+      CHECK(waited_us <= ZONE_TRIGGER_US + ZONE_PING_TIMEOUT_US + SLACK_US);
+      timeouts++;
+    } else { // Every echo back, then the guard
+      uint64_t quiet_us = turn.start_us - last.end_us;
+      CHECK(quiet_us >= ZONE_PING_GUARD_US);
+      CHECK(quiet_us <= ZONE_PING_GUARD_US + SLACK_US);
+      guards++;
+    }
+  }
+  CHECK(timeouts > 0);
+  CHECK(guards > 0);
+
+  uint32_t total = 0;
+  for (int i = 0; i < ZONES; i++) {
+    total += pings[i];
+    CHECK(pings[i] >= turn_count / GROUPS - 1); // Every zone fires each time its group does
+    if (i == DEAD_ZONE) {
+      CHECK_EQ(echoes[i], 0);
+    } else {
+      CHECK(echoes[i] + 1 >= pings[i]); // The last ping may still be in flight
+    }
+  }
+  uint32_t round_us = 0; // Expected turns: the longest echo plus the guard, or the timeout
+  for (int group = 0; group < GROUPS; group++) {
+    uint32_t longest_us = 0;
+    for (int i = 0; i < ZONES; i++) {
+      uint32_t echo_us = distance_mm[i] ? distance_mm[i] * 2000 / 343 : 38000;
+      if (table[i].ping_group == group && echo_us > longest_us) {
+        longest_us = echo_us;
+      }
+    }
+    round_us += group == table[DEAD_ZONE].ping_group
+                    ? ZONE_TRIGGER_US + ZONE_PING_TIMEOUT_US
+                    : ZONE_TRIGGER_US + ECHO_DELAY_US + longest_us + ZONE_PING_GUARD_US;
+  }
+  uint32_t pings_per_s = total * 1000 / RUN_MS;
+  printf("%d zones in %d groups: %lu pings/s, %lu rounds, %lu turns ended by the guard and %lu by the timeout\n",
+         ZONES, GROUPS, (unsigned long)pings_per_s, (unsigned long)(turn_count / GROUPS), (unsigned long)guards,
+         (unsigned long)timeouts);
+  CHECK(pings_per_s + ZONES >= ZONES * 1000000ull / round_us); // As fast as the turns allow
+  sim_exit(check_done());
+}
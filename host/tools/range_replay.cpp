@@ -0,0 +1,125 @@
+/*
+ * File Purpose: Replay recorded HC-SR04 traces through the median filter and background model
+ *
+ * Usage: range_replay trace...
+ *   trace  Text file, one ping per line: <time ms> <echo width us> <learn|quiet|intruder>
+ *
+ * Each ping goes through ultrasonic_add_pulse and then the same decision zone_add_pulse makes:
+ * learn pings train the scene as while disarmed, quiet and intruder pings are judged as while
+ * armed. Quiet pings that trip are false positives. A run of intruder pings is one intrusion,
+ * detected at its first trip; the latency is counted from the run's first ping. Lines starting
+ * with # are skipped. Returns 1 if a trace can't be read.
+ */
+#include "ultrasonic.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+struct Zone { // What zones.cpp keeps per ultrasonic zone
+  UltrasonicFilter filter;
+  Background background;
+};
+
+static int judge(Zone *zone, uint32_t width_us, int learning) { // zone_add_pulse's decision
+  int near = ultrasonic_add_pulse(&zone->filter, width_us);
+  if (!ultrasonic_pulse_to_mm(width_us) || zone->filter.count < ULTRASONIC_FILTER_SIZE) {
+    return 0;
+  }
+  if (learning) {
+    background_learn(&zone->background, zone->filter.distance_mm);
+    return near;
+  }
+  if (zone->background.samples < BACKGROUND_WARMUP) {
+    return near;
+  }
+  return background_deviates(&zone->background, zone->filter.distance_mm);
+}
+
+static int replay(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    fprintf(stderr, "range_replay: can't open %s\n", path);
+    return 1;
+  }
+  Zone zone;
+  ultrasonic_filter_init(&zone.filter, ULTRASONIC_TRIP_MM);
+  background_init(&zone.background);
+
+  uint32_t pings = 0, learned = 0, quiet = 0, false_trips = 0;
+  uint64_t quiet_ms = 0, last_ms = 0;
+  std::vector<int64_t> latencies; // -1 for a missed intrusion
+  uint64_t intrusion_ms = 0;
+  int in_intrusion = 0, detected = 0;
+  char line[128], phase[16];
+  int number = 0;
+  while (fgets(line, sizeof(line), file)) {
+    number++;
+    unsigned long long time_ms;
+    unsigned long width_us;
+    if (line[0] == '#' || line[0] == '\n') {
+      continue;
+    }
+    if (sscanf(line, "%llu %lu %15s", &time_ms, &width_us, phase) != 3) {
+      fprintf(stderr, "range_replay: %s:%d: expected <time ms> <width us> <phase>\n", path, number);
+      fclose(file);
+      return 1;
+    }
+    int learning = strcmp(phase, "learn") == 0;
+    int intruder = strcmp(phase, "intruder") == 0;
+    int tripped = judge(&zone, width_us, learning);
+    pings++;
+    learned += learning;
+
+    if (intruder && !in_intrusion) {
+      intrusion_ms = time_ms;
+      detected = 0;
+      latencies.push_back(-1);
+    }
+    in_intrusion = intruder;
+    if (intruder && tripped && !detected) {
+      detected = 1;
+      latencies.back() = time_ms - intrusion_ms;
+    } else if (!learning && !intruder) {
+      quiet++;
+      quiet_ms += pings > 1 ? time_ms - last_ms : 0;
+      false_trips += tripped;
+    }
+    last_ms = time_ms;
+  }
+  fclose(file);
+
+  uint32_t found = 0;
+  int64_t total = 0, worst = 0;
+  for (size_t i = 0; i < latencies.size(); i++) {
+    if (latencies[i] < 0) {
+      printf("intrusion %u: missed\n", (unsigned)i + 1);
+      continue;
+    }
+    printf("intrusion %u: detected after %lld ms\n", (unsigned)i + 1, (long long)latencies[i]);
+    found++;
+    total += latencies[i];
+    worst = latencies[i] > worst ? latencies[i] : worst;
+  }
+  double hours = quiet_ms / 3600000.0;
+  printf("%s: %lu pings, %lu learned, scene %u mm +- %u mm\n", path, (unsigned long)pings,
+         (unsigned long)learned, zone.background.mean_mm, (unsigned)sqrt((double)zone.background.variance));
+  printf("false positives %lu of %lu quiet pings (%.3f%%, %.1f per armed hour)\n", (unsigned long)false_trips,
+         (unsigned long)quiet, quiet ? 100.0 * false_trips / quiet : 0.0, hours > 0 ? false_trips / hours : 0.0);
+  printf("detected %u/%u, latency mean %lld ms, worst %lld ms\n", (unsigned)found, (unsigned)latencies.size(),
+         found ? (long long)(total / found) : 0LL, (long long)worst);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: range_replay trace...\n");
+    return 2;
+  }
+  for (int i = 1; i < argc; i++) {
+    if (replay(argv[i])) {
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * File Purpose: Decode a capture of the telemetry UART into CSV or range_replay traces
+ *
+ * Usage: telemetry_decode [-r phase] [-z zone] [capture]
+ *   -r phase  Write the zone's echo samples as a range_replay trace with the given phase instead of CSV
+ *   -z zone   Zone for -r, 0 if omitted
+ *   capture   Raw bytes read from the UART, stdin if omitted
+ *
+ * CSV lines are time_us,source,channel,value with the time absolute, rebuilt from each packet's
+ * timestamp and the sample deltas. Packets have no checksum, so a packet is only taken if its
+ * samples fill its length exactly; otherwise the scan moves on one byte and looks for the next
+ * sync. Packets missing from the sequence and bytes skipped are counted on stderr.
+ */
+#include "telemetry.h"
+#include <vector>
+
+#define PACKET_SYNC_0 0xA5
+#define PACKET_SYNC_1 0x5A
+#define HEADER_SIZE 8
+#define CHANNELS 16
+
+struct Sample {
+  uint32_t time_us;
+  uint8_t source;
+  uint8_t channel;
+  uint32_t value;
+};
+
+static const char *source_names[TELEMETRY_SOURCE_COUNT] = {"echo", "mic_level", "mic_edge", "key"};
+
+static int get_varint(const uint8_t *bytes, int length, int *at, uint32_t *value) {
+  *value = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (*at >= length) {
+      return 0;
+    }
+    uint8_t byte = bytes[(*at)++];
+    *value |= (uint32_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return 1;
+    }
+  }
+  return 0; // More than five bytes can't be a 32 bit value
+}
+
+// Samples of the packet at bytes, or 0 if it isn't a whole valid packet
+static size_t packet(const uint8_t *bytes, size_t available, std::vector<Sample> *samples) {
+  if (available < HEADER_SIZE || bytes[3] > TELEMETRY_PAYLOAD_MAX || available < HEADER_SIZE + (size_t)bytes[3]) {
+    return 0;
+  }
+  int length = bytes[3];
+  const uint8_t *payload = bytes + HEADER_SIZE;
+  uint32_t time_us = bytes[4] | bytes[5] << 8 | bytes[6] << 16 | (uint32_t)bytes[7] << 24;
+  uint32_t last_value[TELEMETRY_SOURCE_COUNT][CHANNELS] = {};
+  std::vector<Sample> decoded;
+  for (int at = 0; at < length;) {
+    uint8_t tag = payload[at++];
+    uint32_t delta_us, zigzag;
+    if (tag >> 4 >= TELEMETRY_SOURCE_COUNT || !get_varint(payload, length, &at, &delta_us) ||
+        !get_varint(payload, length, &at, &zigzag)) {
+      return 0;
+    }
+    Sample sample;
+    sample.source = tag >> 4;
+    sample.channel = tag & 0xF;
+    time_us += delta_us;
+    sample.time_us = time_us;
+    uint32_t &last = last_value[sample.source][sample.channel];
+    last += (zigzag >> 1) ^ (0u - (zigzag & 1));
+    sample.value = last;
+    decoded.push_back(sample);
+  }
+  samples->insert(samples->end(), decoded.begin(), decoded.end());
+  return HEADER_SIZE + length;
+}
+
+int main(int argc, char **argv) {
+  const char *phase = nullptr;
+  int zone = 0;
+  const char *path = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      phase = argv[++i];
+    } else if (strcmp(argv[i], "-z") == 0 && i + 1 < argc) {
+      zone = atoi(argv[++i]);
+    } else {
+      path = argv[i];
+    }
+  }
+  FILE *file = path ? fopen(path, "rb") : stdin;
+  if (!file) {
+    fprintf(stderr, "telemetry_decode: can't open %s\n", path);
+    return 2;
+  }
+  std::vector<uint8_t> capture;
+  uint8_t buffer[4096];
+  size_t got;
+  while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    capture.insert(capture.end(), buffer, buffer + got);
+  }
+
+  std::vector<Sample> samples;
+  uint32_t packets = 0, missing = 0, skipped = 0;
+  int expected = -1; // Sequence of the next packet
+  for (size_t at = 0; at < capture.size();) {
+    size_t length = 0;
+    if (at + 1 < capture.size() && capture[at] == PACKET_SYNC_0 && capture[at + 1] == PACKET_SYNC_1) {
+      length = packet(&capture[at], capture.size() - at, &samples);
+    }
+    if (!length) {
+      at++;
+      skipped++;
+      continue;
+    }
+    uint8_t sequence = capture[at + 2];
+    missing += expected >= 0 ? (uint8_t)(sequence - expected) : 0;
+    expected = (uint8_t)(sequence + 1);
+    packets++;
+    at += length;
+  }
+
+  if (phase) {
+    printf("# Zone %d echoes from a telemetry capture\n# <time ms> <echo width us> <learn|quiet|intruder>\n", zone);
+  } else {
+    printf("time_us,source,channel,value\n");
+  }
+  for (const Sample &sample : samples) {
+    if (!phase) {
+      printf("%lu,%s,%u,%lu\n", (unsigned long)sample.time_us, source_names[sample.source], sample.channel,
+             (unsigned long)sample.value);
+    } else if (sample.source == TELEMETRY_ECHO && sample.channel == zone) {
+      printf("%lu %lu %s\n", (unsigned long)(sample.time_us / 1000), (unsigned long)sample.value, phase);
+    }
+  }
+  fprintf(stderr, "telemetry_decode: %lu packets, %lu samples, %lu missing, %lu bytes skipped\n",
+          (unsigned long)packets, (unsigned long)samples.size(), (unsigned long)missing, (unsigned long)skipped);
+  return packets ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+/*
+ * File Purpose: Decode the binary trace dumps in a capture of the serial console
+ *
+ * Usage: trace_decode [-t] [capture]
+ *   -t       Also print the timeline, one line per record with the time since the previous one
+ *   capture  Raw bytes read from the console, stdin if omitted
+ *
+ * Text the firmware printed around the dumps is skipped. Each frame with a good checksum is
+ * printed as its header line, then the pairs of begin and end records of every handler as call
+ * count, mean and longest duration in cycles and microseconds. Ends whose begin was overwritten
+ * and handlers still open at the end of the ring are left out.
+ */
+#include "trace.h"
+#include <map>
+#include <string>
+#include <vector>
+
+static void decode(const TraceDumpHeader &header, const TraceRecord *records, const std::vector<std::string> &names,
+                   bool timeline) {
+  double us_per_cycle = 1e6 / header.core_hz;
+  printf("trace %u records, %lu overwritten, %lu Hz\n", header.count,
+         (unsigned long)(header.written - header.count), (unsigned long)header.core_hz);
+  auto name = [&](uint32_t id) { return id < names.size() ? names[id].c_str() : "?"; };
+
+  if (timeline) {
+    for (uint32_t i = 0; i < header.count; i++) {
+      uint32_t delta = i ? records[i].cycles - records[i - 1].cycles : 0;
+      printf("+%-9lu %9.2fus %-5s %s\n", (unsigned long)delta, delta * us_per_cycle,
+             records[i].id & header.end_flag ? "end" : "begin", name(records[i].id & ~header.end_flag));
+    }
+  }
+
+  struct Stats {
+    uint32_t begin;
+    bool open;
+    uint32_t calls;
+    uint64_t total;
+    uint32_t longest;
+  };
+  std::map<uint32_t, Stats> stats;
+  for (uint32_t i = 0; i < header.count; i++) {
+    uint32_t id = records[i].id & ~header.end_flag;
+    Stats &entry = stats[id];
+    if (!(records[i].id & header.end_flag)) {
+      entry.begin = records[i].cycles;
+      entry.open = true;
+    } else if (entry.open) { // Pair with the latest begin of the same id
+      uint32_t cycles = records[i].cycles - entry.begin;
+      entry.open = false;
+      entry.calls++;
+      entry.total += cycles;
+      entry.longest = cycles > entry.longest ? cycles : entry.longest;
+    }
+  }
+  printf("%-28s %6s %10s %10s %10s %10s\n", "handler", "n", "avg cyc", "max cyc", "avg us", "max us");
+  for (const auto &entry : stats) {
+    if (entry.second.calls) {
+      double average = (double)entry.second.total / entry.second.calls;
+      printf("%-28s %6lu %10.0f %10lu %10.2f %10.2f\n", name(entry.first), (unsigned long)entry.second.calls,
+             average, (unsigned long)entry.second.longest, average * us_per_cycle,
+             entry.second.longest * us_per_cycle);
+    }
+  }
+}
+
+// Parse the frame starting at data, returns its length or 0 if it isn't a whole, intact frame
+static size_t frame(const uint8_t *data, size_t length, bool timeline) {
+  TraceDumpHeader header;
+  if (length < sizeof(header)) {
+    return 0;
+  }
+  memcpy(&header, data, sizeof(header));
+  size_t at = sizeof(header) + (size_t)header.count * sizeof(TraceRecord);
+  std::vector<std::string> names;
+  for (int i = 0; i < header.id_count; i++) {
+    const uint8_t *nul = at < length ? (const uint8_t *)memchr(data + at, 0, length - at) : nullptr;
+    if (!nul) {
+      return 0;
+    }
+    names.push_back(std::string((const char *)data + at, nul - (data + at)));
+    at = nul - data + 1;
+  }
+  uint32_t sum = 0, expected;
+  if (at + sizeof(expected) > length) {
+    return 0;
+  }
+  for (size_t i = 0; i < at; i++) {
+    sum += data[i];
+  }
+  memcpy(&expected, data + at, sizeof(expected));
+  if (sum != expected) {
+    fprintf(stderr, "trace_decode: frame with a bad checksum skipped\n");
+    return 0;
+  }
+  std::vector<TraceRecord> records(header.count);
+  memcpy(records.data(), data + sizeof(header), records.size() * sizeof(TraceRecord));
+  decode(header, records.data(), names, timeline);
+  return at + sizeof(expected);
+}
+
+int main(int argc, char **argv) {
+  bool timeline = false;
+  const char *path = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-t") == 0) {
+      timeline = true;
+    } else {
+      path = argv[i];
+    }
+  }
+  FILE *file = path ? fopen(path, "rb") : stdin;
+  if (!file) {
+    fprintf(stderr, "trace_decode: can't open %s\n", path);
+    return 2;
+  }
+  std::vector<uint8_t> capture;
+  uint8_t buffer[4096];
+  size_t got;
+  while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    capture.insert(capture.end(), buffer, buffer + got);
+  }
+
+  int frames = 0;
+  for (size_t at = 0; at + 4 <= capture.size();) {
+    if (memcmp(&capture[at], TRACE_DUMP_MAGIC, 4) != 0) {
+      at++;
+      continue;
+    }
+    size_t length = frame(&capture[at], capture.size() - at, timeline);
+    at += length ? length : 1;
+    frames += length != 0;
+  }
+  if (!frames) {
+    fprintf(stderr, "trace_decode: no trace dump found\n");
+    return 1;
+  }
+  return 0;
+}
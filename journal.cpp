@@ -0,0 +1,193 @@
+#include "journal.h"
+#include "lanes.h"
+#include "mbed.h"
+#include "BlockDevice.h"
+
+#define STAGE_MASK (JOURNAL_STAGE_SIZE - 1)
+#define ERASED_SEQUENCE 0xFFFFFFFF
+
+MBED_STATIC_ASSERT(sizeof(JournalRecord) == 16, "journal records must stay 16 bytes");
+MBED_STATIC_ASSERT((JOURNAL_STAGE_SIZE & STAGE_MASK) == 0,
+                   "JOURNAL_STAGE_SIZE must be a power of two");
+
+static uint16_t record_check(const JournalRecord &record); // Folded sum of the other fields
+static int record_valid(const JournalRecord &record);
+static bd_addr_t slot_address(uint32_t sector, uint32_t slot);
+static void read_record(uint32_t sector, uint32_t slot, JournalRecord *record);
+
+static BlockDevice *flash;
+static uint32_t sector_count;
+static uint32_t sector_size;
+static uint32_t sector_slots; // Records per sector
+static int journal_ready = 0;
+
+static uint32_t head_sector = 0; // Where the next record is programmed
+static uint32_t head_slot = 0;
+static uint32_t next_sequence = 0;
+
+// Single producer (mode thread), single consumer (best-effort lane)
+static JournalRecord stage[JOURNAL_STAGE_SIZE];
+static volatile uint32_t stage_head = 0; // Next slot journal_log fills
+static volatile uint32_t stage_tail = 0; // Next slot journal_flush programs
+static volatile uint32_t flush_posted = 0;
+static volatile uint32_t dropped = 0; // Records lost because the stage was full
+
+void journal_init(BlockDevice *device) {
+  journal_ready = 0;
+  if (device->init() != 0) {
+    return;
+  }
+  flash = device;
+  sector_size = device->get_erase_size();
+  sector_count = device->size() / sector_size;
+  sector_slots = sector_size / sizeof(JournalRecord);
+  if (sector_count < JOURNAL_MIN_SECTORS || sector_size % sizeof(JournalRecord) ||
+      sizeof(JournalRecord) % device->get_program_size()) {
+    return;
+  }
+
+  // Newest sector is the one whose first record has the highest sequence
+  int newest = -1;
+  uint32_t newest_sequence = 0;
+  for (uint32_t sector = 0; sector < sector_count; sector++) {
+    JournalRecord record;
+    read_record(sector, 0, &record);
+    if (record_valid(record) && (newest < 0 || record.sequence > newest_sequence)) {
+      newest = sector;
+      newest_sequence = record.sequence;
+    }
+  }
+
+  if (newest < 0) { // Blank or foreign data, start over
+    head_sector = 0;
+    head_slot = 0;
+    next_sequence = 0;
+    flash->erase(slot_address(0, 0), sector_size);
+  } else {
+    uint32_t low = 1, high = sector_slots; // First erased slot lies in [low, high]
+    while (low < high) {
+      uint32_t middle = (low + high) / 2;
+      JournalRecord record;
+      read_record(newest, middle, &record);
+      if (record.sequence == ERASED_SEQUENCE) {
+        high = middle;
+      } else {
+        low = middle + 1;
+      }
+    }
+    JournalRecord last;
+    read_record(newest, low - 1, &last);
+    head_sector = newest;
+    head_slot = low;
+    next_sequence = (record_valid(last) ? last.sequence : newest_sequence + low - 1) + 1;
+  }
+  journal_ready = 1;
+}
+
+void journal_log(JournalType type, uint8_t sensor, uint8_t mode, uint16_t value) {
+  uint32_t head = stage_head;
+  if (head - core_util_atomic_load_u32(&stage_tail) >= JOURNAL_STAGE_SIZE) {
+    dropped++;
+    return;
+  }
+  JournalRecord &record = stage[head & STAGE_MASK];
+  record.sequence = next_sequence++;
+  record.timestamp_ms = Kernel::Clock::now().time_since_epoch().count();
+  record.type = type;
+  record.sensor = sensor;
+  record.mode = mode;
+  record.reserved = 0xFF;
+  record.value = value;
+  record.check = record_check(record);
+  core_util_atomic_store_u32(&stage_head, head + 1); // Publish to the flush
+
+  if (head + 1 - stage_tail >= JOURNAL_BATCH) {
+    journal_schedule_flush();
+  }
+}
+
+void journal_schedule_flush(void) {
+  if (core_util_atomic_load_u32(&stage_head) == core_util_atomic_load_u32(&stage_tail)) {
+    return;
+  }
+  uint32_t expected = 0;
+  if (core_util_atomic_cas_u32(&flush_posted, &expected, 1) &&
+      !housekeeping_post(&journal_flush)) {
+    core_util_atomic_store_u32(&flush_posted, 0); // Try again on the next schedule
+  }
+}
+
+void journal_flush(void) {
+  static JournalRecord batch[JOURNAL_STAGE_SIZE];
+
+  core_util_atomic_store_u32(&flush_posted, 0);
+  if (!journal_ready) {
+    stage_tail = core_util_atomic_load_u32(&stage_head); // No flash, discard
+    return;
+  }
+
+  uint32_t head = core_util_atomic_load_u32(&stage_head);
+  while (stage_tail != head) {
+    if (head_slot == sector_slots) { // Rotate to the oldest sector
+      head_sector = (head_sector + 1) % sector_count;
+      head_slot = 0;
+      flash->erase(slot_address(head_sector, 0), sector_size);
+    }
+
+    // One program call for as many records as fit in the current sector
+    uint32_t count = head - stage_tail;
+    if (count > sector_slots - head_slot) {
+      count = sector_slots - head_slot;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      batch[i] = stage[(stage_tail + i) & STAGE_MASK];
+    }
+    flash->program(batch, slot_address(head_sector, head_slot), count * sizeof(JournalRecord));
+    head_slot += count;
+    core_util_atomic_store_u32(&stage_tail, stage_tail + count); // Free the stage slots
+  }
+}
+
+static uint16_t record_check(const JournalRecord &record) {
+  const uint16_t *words = (const uint16_t *)&record;
+  uint32_t sum = 0x5A5A;
+  for (uint32_t i = 0; i < offsetof(JournalRecord, check) / 2; i++) {
+    sum = (sum << 1 | sum >> 15) + words[i]; // Rotate so swapped fields change the result
+    sum &= 0xFFFF;
+  }
+  return sum;
+}
+
+static int record_valid(const JournalRecord &record) {
+  return record.sequence != ERASED_SEQUENCE && record.check == record_check(record);
+}
+
+static bd_addr_t slot_address(uint32_t sector, uint32_t slot) {
+  return (bd_addr_t)sector * sector_size + slot * sizeof(JournalRecord);
+}
+
+static void read_record(uint32_t sector, uint32_t slot, JournalRecord *record) {
+  flash->read(record, slot_address(sector, slot), sizeof(JournalRecord));
+}
+
+// ECC double error, raised by the load that read a torn double word. Only the journal keeps
+// data past the image, so zero the double word there (the one value that may be programmed over
+// another) and let the read see an invalid record. In the image itself there's nothing to
+// recover, so wait for the watchdog.
+extern "C" void NMI_Handler(void) {
+  uint32_t eccr = FLASH->ECCR;
+  if (!(eccr & FLASH_ECCR_ECCD)) {
+    while (1) {
+    }
+  }
+  uint32_t address = FLASH_BASE + (eccr & FLASH_ECCR_BK_ECC ? FLASH_BANK_SIZE : 0) +
+                     (eccr & FLASH_ECCR_ADDR_ECC & ~7u);
+  if (address < MBED_APP_START + MBED_APP_SIZE) {
+    while (1) {
+    }
+  }
+  HAL_FLASH_Unlock();
+  HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, address, 0);
+  HAL_FLASH_Lock();
+  FLASH->ECCR = eccr; // ECCD is write 1 to clear
+}
@@ -0,0 +1,61 @@
+/*
+ * File Purpose: Append-only event journal kept on a block device, the flash past the image on the board
+ *
+ * Subroutines:
+ * void journal_init(mbed::BlockDevice *device) - Scan the device's sectors for the head, call once before logging
+ * void journal_log(JournalType type, uint8_t sensor, uint8_t mode, uint16_t value) - Stage a record in RAM, mode thread only
+ * void journal_flush(void) - Program every staged record, best-effort lane only
+ * void journal_schedule_flush(void) - Post a flush to the best-effort lane if records are staged
+ *
+ * Records are 16 bytes and carry a sequence number, so the head is found at boot by reading
+ * the first record of each sector and then binary searching the newest sector for the first
+ * erased slot. Sectors are used round robin and erased just before reuse, spreading wear
+ * evenly. Staged records are programmed in batches once JOURNAL_BATCH are waiting or when the
+ * owner calls journal_schedule_flush().
+ *
+ * On the board the device is a FlashIAPBlockDevice over the sectors target.restrict_size in
+ * mbed_app.json keeps out of the image. A reset mid program can leave a double word whose ECC
+ * doesn't match; reading it raises an ECC double error NMI, which the journal's NMI_Handler
+ * clears by programming the double word to zero so the scan sees an invalid record.
+ */
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+
+namespace mbed {
+class BlockDevice;
+}
+
+#define JOURNAL_MIN_SECTORS 2 // One to write while the oldest is erased
+#define JOURNAL_STAGE_SIZE 32 // Records held in RAM before a flush, must be a power of two
+#define JOURNAL_BATCH 8 // Staged records that trigger a flush on their own
+
+enum JournalType {
+  JOURNAL_BOOT,
+  JOURNAL_PASSCODE_SET,
+  JOURNAL_ARM,
+  JOURNAL_DISARM,
+  JOURNAL_WRONG_PASSCODE,
+  JOURNAL_TRIGGER,        // sensor = zone that tripped
+  JOURNAL_ESCALATE,       // Authorities alerted
+  JOURNAL_INVARIANT       // value = Invariant from main.cpp, first failure of each
+};
+
+struct JournalRecord {
+  uint32_t sequence;     // Increments across boots, erased flash reads 0xFFFFFFFF
+  uint32_t timestamp_ms; // Time since boot
+  uint8_t type;          // JournalType
+  uint8_t sensor;        // Zone number, ZONE_NONE if no zone is involved
+  uint8_t mode;          // System mode when logged
+  uint8_t reserved;
+  uint16_t value;        // Type specific payload
+  uint16_t check;        // Detects records torn by a reset mid program
+};
+
+void journal_init(mbed::BlockDevice *device);
+void journal_log(JournalType type, uint8_t sensor, uint8_t mode, uint16_t value = 0);
+void journal_flush(void);
+void journal_schedule_flush(void);
+
+#endif
@@ -0,0 +1,147 @@
+#include "keypad.h"
+#include "clock.h"
+#include "events.h"
+#include "mbed.h"
+#include "methods.h"
+#include "power.h"
+#include "telemetry.h"
+#include "trace.h"
+
+// Rows are driven on PA3, PC0, PC3, PC1; columns read on PF14, PE11, PE9, PF13
+typedef Port<GPIOA_BASE> RowPortA;
+typedef Port<GPIOC_BASE> RowPortC;
+typedef Port<GPIOE_BASE> ColPortE;
+typedef Port<GPIOF_BASE> ColPortF;
+
+#define ROW_0_MASK (1u << 3) // GPIOA
+#define ROW_1_MASK (1u << 0) // GPIOC
+#define ROW_2_MASK (1u << 3) // GPIOC
+#define ROW_3_MASK (1u << 1) // GPIOC
+#define ROW_C_MASK (ROW_1_MASK | ROW_2_MASK | ROW_3_MASK)
+
+static void keypad_scan(void); // Ticker ISR, one row per tick
+static void keypad_idle(void); // Stop the ticker and wait for a column edge, from keypad_scan
+static void keypad_wake(void); // Column edge ISR, restarts the scan
+static void columns_irq(int enable);
+static unsigned int read_columns(void); // Column levels, bit = column
+
+// Scan samples come straight from IDR, the edges are only used while the scan is stopped
+static InterruptIn col_0(PF_14, PullDown);
+static InterruptIn col_1(PE_11, PullDown);
+static InterruptIn col_2(PE_9, PullDown);
+static InterruptIn col_3(PF_13, PullDown);
+
+static Ticker scan_ticker;
+
+static const uint16_t row_a_values[4] = {ROW_0_MASK, 0, 0, 0}; // PA3 high for row 0 only
+static const uint16_t row_c_values[4] = {0, ROW_1_MASK, ROW_2_MASK, ROW_3_MASK};
+
+static void drive_row(int row) { // One BSRR store per port, no window with two rows high
+  RowPortA::write_port(ROW_0_MASK, row_a_values[row]);
+  RowPortC::write_port(ROW_C_MASK, row_c_values[row]);
+}
+
+static int scan_row = 0; // Row powered since the previous tick
+static uint8_t integrator[16]; // Per key count of pressed samples, 0..KEYPAD_DEBOUNCE_SAMPLES
+static volatile uint16_t pressed = 0; // Debounced key state
+static uint32_t quiet_ticks = 0; // Ticks since any key last read pressed
+static uint32_t first_seen_us[16]; // First raw sample that saw each key down, the key event's timestamp
+static uint32_t edge_us; // Column edge that woke the scan
+static uint8_t edge_ticks = 0; // Ticks of the first sweep after a wake, samples date from edge_us
+
+void keypad_start(void) {
+  RowPortA::enable_rcc();
+  RowPortC::enable_rcc();
+  drive_row(scan_row); // Output levels are latched before the pins switch to outputs
+  RowPortA::configure_group<ROW_0_MASK>(PIN_MODE_OUTPUT);
+  RowPortC::configure_group<ROW_C_MASK>(PIN_MODE_OUTPUT);
+  col_0.rise(&keypad_wake);
+  col_1.rise(&keypad_wake);
+  col_2.rise(&keypad_wake);
+  col_3.rise(&keypad_wake);
+  columns_irq(0);
+  scan_ticker.attach(&keypad_scan, std::chrono::microseconds(KEYPAD_SCAN_US));
+}
+
+uint16_t keypad_pressed(void) { return pressed; }
+
+static void keypad_scan(void) {
+  TRACE_BEGIN(TRACE_ISR_KEYPAD_SCAN);
+  power_wakeup(WAKE_KEYPAD_SCAN);
+  unsigned int columns = read_columns();
+  uint32_t sample_us = edge_ticks ? edge_us : clock_now_us(); // The wake edge is earlier than the sample
+  edge_ticks = edge_ticks ? edge_ticks - 1 : 0;
+
+  uint16_t state = pressed;
+  for (int column = 0; column < 4; column++) {
+    int key = scan_row * 4 + column;
+    uint16_t bit = 1u << key;
+    if (columns & (1u << column)) {
+      if (integrator[key] == 0) {
+        first_seen_us[key] = sample_us; // Debounce time counts towards the key's latency
+      }
+      if (integrator[key] < KEYPAD_DEBOUNCE_SAMPLES && ++integrator[key] == KEYPAD_DEBOUNCE_SAMPLES &&
+          !(state & bit)) {
+        state |= bit;
+        event_post_at(EVENT_KEY_DOWN, scan_row, key, first_seen_us[key]);
+        TELEMETRY(TELEMETRY_KEY, key, 1);
+      }
+    } else if (integrator[key] > 0 && --integrator[key] == 0 && (state & bit)) {
+      state &= ~bit;
+      event_post(EVENT_KEY_UP, scan_row, key);
+      TELEMETRY(TELEMETRY_KEY, key, 0);
+    }
+  }
+  pressed = state;
+  quiet_ticks = columns || state ? 0 : quiet_ticks + 1;
+
+  if (quiet_ticks >= KEYPAD_IDLE_TICKS) {
+    keypad_idle();
+  } else {
+    scan_row = (scan_row + 1) & 3; // Columns settle for a full tick before the next sample
+    drive_row(scan_row);
+  }
+  TRACE_END(TRACE_ISR_KEYPAD_SCAN);
+}
+
+static void keypad_idle(void) {
+  scan_ticker.detach();
+  RowPortA::write_port(ROW_0_MASK, ROW_0_MASK); // Every row powered, any key raises its column
+  RowPortC::write_port(ROW_C_MASK, ROW_C_MASK);
+  columns_irq(1);
+  if (read_columns()) { // Pressed before the edge interrupt was enabled
+    keypad_wake();
+  }
+}
+
+static void keypad_wake(void) {
+  power_wakeup(WAKE_KEYPAD_EDGE);
+  columns_irq(0);
+  for (int key = 0; key < 16; key++) {
+    integrator[key] = 0; // Released keys decay to 0 well within KEYPAD_IDLE_TICKS
+  }
+  quiet_ticks = 0;
+  edge_us = clock_now_us();
+  edge_ticks = 4;
+  scan_row = 0;
+  drive_row(scan_row);
+  scan_ticker.attach(&keypad_scan, std::chrono::microseconds(KEYPAD_SCAN_US));
+}
+
+static void columns_irq(int enable) {
+  InterruptIn *columns[4] = {&col_0, &col_1, &col_2, &col_3};
+  for (int column = 0; column < 4; column++) {
+    if (enable) {
+      columns[column]->enable_irq();
+    } else {
+      columns[column]->disable_irq();
+    }
+  }
+}
+
+static unsigned int read_columns(void) {
+  uint32_t port_e = ColPortE::read_port();
+  uint32_t port_f = ColPortF::read_port();
+  return ((port_f >> 14) & 1) | ((port_e >> 11) & 1) << 1 | ((port_e >> 9) & 1) << 2 |
+         ((port_f >> 13) & 1) << 3;
+}
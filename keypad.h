@@ -0,0 +1,28 @@
+/*
+ * File Purpose: Timer driven scan of the 4x4 matrix keypad with per key debounce
+ *
+ * Subroutines:
+ * void keypad_start(void) - Configure the row outputs, power the first row and start the scan ticker
+ * uint16_t keypad_pressed(void) - Bitmap of debounced keys currently held, bit = row * 4 + column
+ *
+ * Each tick samples the columns of the powered row with one read per port, integrates every
+ * key of that row towards pressed or released, then moves to the next row with one BSRR write
+ * per port. EVENT_KEY_DOWN/EVENT_KEY_UP are posted only when a key's integrator saturates, so
+ * any number of keys can be held at once.
+ *
+ * Once every key has read released for KEYPAD_IDLE_TICKS the ticker stops, all rows are powered
+ * and a rising edge on any column restarts the scan, so an untouched keypad never wakes the MCU.
+ */
+#ifndef KEYPAD_H
+#define KEYPAD_H
+
+#include <stdint.h>
+
+#define KEYPAD_SCAN_US 1000 // Time each row is powered before its columns are sampled
+#define KEYPAD_DEBOUNCE_SAMPLES 3 // Consecutive agreeing samples (one per 4 ticks) to change state
+#define KEYPAD_IDLE_TICKS 64 // Quiet ticks before the scan stops and waits for a column edge
+
+void keypad_start(void);
+uint16_t keypad_pressed(void);
+
+#endif
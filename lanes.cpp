@@ -0,0 +1,61 @@
+#include "lanes.h"
+#include "clock.h"
+#include "mbed.h"
+
+struct LaneStats { // Each lane's stats are only written by the thread draining it
+  uint32_t items;
+  uint32_t max_depth;
+  uint32_t max_wait_us;
+  uint64_t total_wait_us;
+};
+
+static void run_work(void (*work)(void), uint32_t posted_us); // Best-effort lane trampoline
+
+static const char *lane_names[LANE_COUNT] = {"realtime", "best-effort"};
+static LaneStats stats[LANE_COUNT];
+
+static EventQueue housekeeping_queue;
+static volatile uint32_t housekeeping_depth = 0; // Posted and not yet run
+
+void lane_record(Lane lane, uint32_t depth, uint32_t posted_us) {
+  LaneStats &lane_stats = stats[lane];
+  uint32_t wait_us = clock_now_us() - posted_us;
+  lane_stats.items++;
+  lane_stats.total_wait_us += wait_us;
+  lane_stats.max_wait_us = wait_us > lane_stats.max_wait_us ? wait_us : lane_stats.max_wait_us;
+  lane_stats.max_depth = depth > lane_stats.max_depth ? depth : lane_stats.max_depth;
+}
+
+int housekeeping_post(void (*work)(void)) {
+  core_util_atomic_incr_u32(&housekeeping_depth, 1);
+  if (!housekeeping_queue.call(&run_work, work, clock_now_us())) {
+    core_util_atomic_decr_u32(&housekeeping_depth, 1); // Queue memory exhausted
+    return 0;
+  }
+  return 1;
+}
+
+void housekeeping_dispatch(void) {
+  osThreadSetPriority(osThreadGetId(), LANE_BEST_EFFORT_PRIORITY);
+  housekeeping_queue.dispatch_forever();
+}
+
+void lane_report(void) {
+  for (int lane = 0; lane < LANE_COUNT; lane++) {
+    const LaneStats &lane_stats = stats[lane];
+    if (!lane_stats.items) {
+      continue;
+    }
+    printf("lane %s: n=%lu depth max=%lu wait avg=%luus max=%luus\r\n",
+           lane_names[lane], (unsigned long)lane_stats.items,
+           (unsigned long)lane_stats.max_depth,
+           (unsigned long)(lane_stats.total_wait_us / lane_stats.items),
+           (unsigned long)lane_stats.max_wait_us);
+  }
+}
+
+static void run_work(void (*work)(void), uint32_t posted_us) {
+  lane_record(LANE_BEST_EFFORT, core_util_atomic_load_u32(&housekeeping_depth), posted_us);
+  core_util_atomic_decr_u32(&housekeeping_depth, 1);
+  work();
+}
@@ -0,0 +1,29 @@
+/*
+ * File Purpose: Realtime and best-effort dispatch lanes with depth and wait instrumentation
+ *
+ * Subroutines:
+ * void lane_record(Lane lane, uint32_t depth, uint32_t posted_us) - Record one item taken off a lane, depth counts the item itself
+ * int housekeeping_post(void (*work)(void)) - Defer work to the best-effort lane, safe from any ISR or thread
+ * void housekeeping_dispatch(void) - Drop the calling thread to the best-effort priority and run the lane forever
+ * void lane_report(void) - Print per lane depth and wait statistics
+ *
+ * LANE_REALTIME is the event ring drained by the mode thread, which owns the security state and
+ * the alarm outputs. LANE_BEST_EFFORT is an EventQueue drained below the display thread, so
+ * reports and other housekeeping never delay a transition or a redraw.
+ */
+#ifndef LANES_H
+#define LANES_H
+
+#include <stdint.h>
+
+#define LANE_REALTIME_PRIORITY osPriorityHigh // Mode thread
+#define LANE_BEST_EFFORT_PRIORITY osPriorityLow // Housekeeping, below the display thread
+
+enum Lane { LANE_REALTIME, LANE_BEST_EFFORT, LANE_COUNT };
+
+void lane_record(Lane lane, uint32_t depth, uint32_t posted_us);
+int housekeeping_post(void (*work)(void));
+void housekeeping_dispatch(void);
+void lane_report(void);
+
+#endif
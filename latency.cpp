@@ -0,0 +1,111 @@
+#include "latency.h"
+#include "clock.h"
+#include "mbed.h"
+#include "trace.h"
+
+#define SUB_BUCKETS 8 // Buckets per power of two
+#define BUCKETS (SUB_BUCKETS * 24) // Covers up to 2^24 us (~16s)
+
+struct Histogram {
+  uint32_t buckets[BUCKETS];
+  uint32_t count;
+  uint32_t max;
+};
+
+static int bucket_of(uint32_t value); // Log-linear bucket index
+static uint32_t bucket_limit(int bucket); // Largest value in a bucket
+static uint32_t percentile(const Histogram &histogram, uint32_t percent);
+
+static Histogram histograms[LATENCY_PATH_COUNT][STAGE_COUNT];
+static volatile uint32_t origins[LATENCY_PATH_COUNT]; // ISR timestamp each path is timing from
+static volatile int timing[LATENCY_PATH_COUNT]; // Set between latency_begin and the output probe
+
+static const char *path_names[LATENCY_PATH_COUNT] = {"key->display", "sensor->leds",
+                                                       "sensor->buzzer"};
+static const char *stage_names[STAGE_COUNT] = {"dispatch", "handler", "output"};
+
+void latency_begin(LatencyPath path, uint32_t origin_us) {
+  if (timing[path]) { // Keep the oldest origin when outputs are collapsed, it is the worst case
+    return;
+  }
+  origins[path] = origin_us;
+  timing[path] = 1;
+}
+
+void latency_begin_from(LatencyPath path, LatencyPath from) {
+  if (timing[from]) {
+    latency_begin(path, origins[from]);
+  }
+}
+
+void latency_probe(LatencyPath path, LatencyStage stage) {
+  if (!timing[path]) {
+    return;
+  }
+  uint32_t elapsed = clock_now_us() - origins[path];
+  Histogram &histogram = histograms[path][stage];
+  histogram.buckets[bucket_of(elapsed)]++;
+  histogram.count++;
+  if (elapsed > histogram.max) {
+    histogram.max = elapsed;
+  }
+  if (stage == STAGE_OUTPUT) { // Path complete
+    timing[path] = 0;
+  }
+}
+
+void latency_cancel(LatencyPath path) { timing[path] = 0; }
+
+void latency_report(void) {
+  TRACE_BEGIN(TRACE_LATENCY_REPORT);
+  for (int path = 0; path < LATENCY_PATH_COUNT; path++) {
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+      LatencyStats stats = latency_stats((LatencyPath)path, (LatencyStage)stage);
+      if (!stats.count) {
+        continue;
+      }
+      printf("latency %s %s: n=%lu p50=%luus p99=%luus max=%luus\r\n",
+             path_names[path], stage_names[stage], (unsigned long)stats.count,
+             (unsigned long)stats.p50_us, (unsigned long)stats.p99_us, (unsigned long)stats.max_us);
+    }
+  }
+  TRACE_END(TRACE_LATENCY_REPORT);
+}
+
+LatencyStats latency_stats(LatencyPath path, LatencyStage stage) {
+  const Histogram &histogram = histograms[path][stage];
+  LatencyStats stats = {histogram.count, percentile(histogram, 50), percentile(histogram, 99), histogram.max};
+  return stats;
+}
+
+static int bucket_of(uint32_t value) {
+  if (value < SUB_BUCKETS) {
+    return value; // Exact below 8us
+  }
+  int msb = 31 - __builtin_clz(value);
+  int shift = msb - 3; // Keep the top 4 bits: leading 1 plus 3 bits of sub-bucket
+  int bucket = (shift + 1) * SUB_BUCKETS + ((value >> shift) & (SUB_BUCKETS - 1));
+  return bucket < BUCKETS ? bucket : BUCKETS - 1;
+}
+
+static uint32_t bucket_limit(int bucket) {
+  if (bucket < SUB_BUCKETS) {
+    return bucket;
+  }
+  int shift = bucket / SUB_BUCKETS - 1;
+  uint32_t low = (uint32_t)(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+  return low + (1u << shift) - 1;
+}
+
+static uint32_t percentile(const Histogram &histogram, uint32_t percent) {
+  uint32_t target = (histogram.count * percent + 99) / 100; // Rank of the sample we want
+  uint32_t seen = 0;
+  for (int bucket = 0; bucket < BUCKETS; bucket++) {
+    seen += histogram.buckets[bucket];
+    if (seen >= target) {
+      uint32_t limit = bucket_limit(bucket);
+      return limit < histogram.max ? limit : histogram.max;
+    }
+  }
+  return histogram.max;
+}
@@ -0,0 +1,48 @@
+/*
+ * File Purpose: Timestamped probes and histograms for end to end latency
+ *
+ * Subroutines:
+ * void latency_begin(LatencyPath path, uint32_t origin_us) - Start timing a path from the ISR timestamp that began it
+ * void latency_begin_from(LatencyPath path, LatencyPath from) - Start timing a path from the origin another path is timing from
+ * void latency_probe(LatencyPath path, LatencyStage stage) - Record time since the origin for a stage
+ * void latency_cancel(LatencyPath path) - Stop timing a path that won't reach its output
+ * void latency_report(void) - Print count, p50, p99 and max for every path and stage
+ * LatencyStats latency_stats(LatencyPath path, LatencyStage stage) - Count, p50, p99 and max of one stage, for tests
+ *
+ * Each stage keeps a log-linear histogram (8 buckets per power of two, so percentiles are within
+ * ~12%) plus the exact maximum. Recording is a few adds, safe to leave on in normal builds.
+ */
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+enum LatencyPath {
+  LATENCY_KEY_TO_DISPLAY,   // First raw sample of the key (the column edge when it woke the scan) -> '*' or screen flushed to the LCD
+  LATENCY_SENSOR_TO_LEDS,   // Sensor ISR -> alarm_leds driven, the alarm is raised
+  LATENCY_SENSOR_TO_BUZZER, // Sensor ISR -> active_buzzer driven, includes the entry delay
+  LATENCY_PATH_COUNT
+};
+
+enum LatencyStage {
+  STAGE_DISPATCH, // Event taken from the ring (keys: accepted after debounce, sensors: only readings that trip)
+  STAGE_HANDLER,  // State machine action running
+  STAGE_OUTPUT,   // Output pin or LCD updated
+  STAGE_COUNT
+};
+
+struct LatencyStats {
+  uint32_t count;
+  uint32_t p50_us;
+  uint32_t p99_us;
+  uint32_t max_us;
+};
+
+void latency_begin(LatencyPath path, uint32_t origin_us);
+void latency_begin_from(LatencyPath path, LatencyPath from);
+void latency_probe(LatencyPath path, LatencyStage stage);
+void latency_cancel(LatencyPath path);
+void latency_report(void);
+LatencyStats latency_stats(LatencyPath path, LatencyStage stage);
+
+#endif
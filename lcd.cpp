@@ -1,15 +1,25 @@
 #include "lcd.h"
 #include "mbed.h"
+#include "trace.h"
+#include <cstring>
+
+MBED_STATIC_ASSERT(LCD_I2C_FREQUENCY <= 100000,
+                   "enable pulse timing relies on one expander byte covering the 37us command time");
 
 LCD_EM::LCD_EM(unsigned char lcd_cols, unsigned char lcd_rows,
                        unsigned char charsize, PinName sda, PinName scl)
     : i2c(sda, scl) {
 
   _addr = LCD_ADDRESS_1602; //address of the device
-  _cols = lcd_cols;
-  _rows = lcd_rows;
+  _cols = lcd_cols > LCD_MAX_COLS ? LCD_MAX_COLS : lcd_cols;
+  _rows = lcd_rows > LCD_MAX_ROWS ? LCD_MAX_ROWS : lcd_rows;
   _charsize = charsize;
   _backlightval = LCD_BACKLIGHT;
+  _bytes_sent = 0;
+  _tx_len = 0;
+  _last_rs = 0xFF; // unknown until the first expander write
+  i2c.frequency(LCD_I2C_FREQUENCY);
+  resetFrame();
 }
 
 void LCD_EM::begin() {
@@ -31,6 +41,7 @@ void LCD_EM::begin() {
   // Now we pull both RS and R/W low to begin commands
   expanderWrite(
       _backlightval); // reset expanderand turn backlight off (Bit 8 =1)
+  transmit();
   thread_sleep_for(1000);
 
   // put the LCD into 4 bit mode
@@ -39,18 +50,22 @@ void LCD_EM::begin() {
 
   // we start in 8bit mode, try to set 4 bit mode
   write4bits(0x03 << 4);
+  transmit();
   wait_us(4500); // wait min 4.1ms
 
   // second try
   write4bits(0x03 << 4);
+  transmit();
   wait_us(4500); // wait min 4.1ms
 
   // third go!
   write4bits(0x03 << 4);
+  transmit();
   wait_us(150);
 
   // finally, set to 4-bit interface
   write4bits(0x02 << 4);
+  transmit();
 
   // set # lines, font size, etc.
   command(LCD_FUNCTIONSET | _displayfunction);
@@ -59,8 +74,9 @@ void LCD_EM::begin() {
   _displaycontrol = LCD_DISPLAYON | LCD_CURSOROFF | LCD_BLINKOFF;
   display();
 
-  // clear it off
-  clear();
+  // clear it off, the shadow copy starts out matching the blank panel
+  command(LCD_CLEARDISPLAY);
+  wait_us(2000); // this command takes a long time!
 
   // Initialize to default text direction (for roman languages)
   _displaymode = LCD_ENTRYLEFT | LCD_ENTRYSHIFTDECREMENT;
@@ -68,28 +84,66 @@ void LCD_EM::begin() {
   // set the entry mode
   command(LCD_ENTRYMODESET | _displaymode);
 
-  home();
+  resetFrame();
+  _ddram_col = 0; // clear display leaves the address counter at 0
+  _ddram_row = 0;
   backlight();
 }
 
 //------------------Core Functions-----------------------------------------
 
 void LCD_EM::clear() {
-  command(LCD_CLEARDISPLAY); // clear display, set cursor position to zero
-  wait_us(2000);             // this command takes a long time!
+  // blank the frame, the panel is only touched on flush()
+  memset(_frame, ' ', sizeof(_frame));
+  _col = 0;
+  _row = 0;
 }
 
 void LCD_EM::home() {
-  command(LCD_RETURNHOME); // set cursor position to zero
-  wait_us(2000);           // this command takes a long time!
+  _col = 0; // set cursor position to zero
+  _row = 0;
 }
 
 void LCD_EM::setCursor(unsigned char col, unsigned char row) {
-  int row_offsets[] = {0x00, 0x40, 0x14, 0x54};
-  if (row > _rows) {
+  if (row >= _rows) {
     row = _rows - 1; // we count rows starting w/0
   }
-  command(LCD_SETDDRAMADDR | (col + row_offsets[row]));
+  _col = col;
+  _row = row;
+}
+
+void LCD_EM::flush() {
+  static const unsigned char row_offsets[] = {0x00, 0x40, 0x14, 0x54};
+  for (int r = 0; r < _rows; r++) {
+    for (int c = 0; c < _cols; c++) {
+      if (_frame[r][c] == _shadow[r][c]) {
+        continue; // cell already shows the right character
+      }
+      if (_ddram_row != r || _ddram_col != c) { // only move when not already there
+        send(LCD_SETDDRAMADDR | (c + row_offsets[r]), 0);
+        _ddram_row = r;
+        _ddram_col = c;
+      }
+      send(_frame[r][c], Rs);
+      _shadow[r][c] = _frame[r][c];
+      _ddram_col++; // address counter auto increments in left to right mode
+      if (!(_displaymode & LCD_ENTRYLEFT) || _ddram_col >= _cols) {
+        _ddram_col = -1; // counter moved somewhere we don't track
+      }
+    }
+  }
+  transmit(); // whole update goes out in as few transactions as fit
+}
+
+unsigned int LCD_EM::getBytesSent() { return _bytes_sent; }
+
+void LCD_EM::resetFrame() {
+  memset(_frame, ' ', sizeof(_frame));
+  memset(_shadow, ' ', sizeof(_shadow));
+  _col = 0;
+  _row = 0;
+  _ddram_col = -1;
+  _ddram_row = -1;
 }
 
 // Turn the display on/off (quickly)
@@ -162,27 +216,38 @@ void LCD_EM::createChar(unsigned char location, unsigned char charmap[]) {
   location &= 0x7; // we only have 8 locations 0-7
   command(LCD_SETCGRAMADDR | (location << 3));
   for (int i = 0; i < 8; i++) {
-    write(charmap[i]);
+    send(charmap[i], Rs);
   }
+  transmit();
+  _ddram_col = -1; // address counter now points into CGRAM
+  _ddram_row = -1;
 }
 
 // Turn the (optional) backlight off/on
 void LCD_EM::noBacklight(void) {
   _backlightval = LCD_NOBACKLIGHT;
   expanderWrite(0);
+  transmit();
 }
 
 void LCD_EM::backlight(void) {
   _backlightval = LCD_BACKLIGHT;
   expanderWrite(0);
+  transmit();
 }
 bool LCD_EM::getBacklight() { return _backlightval == LCD_BACKLIGHT; }
 
 //-----------functions to output to LCD---------------------------------------
-inline void LCD_EM::command(unsigned char value) { send(value, 0); }
+void LCD_EM::command(unsigned char value) {
+  send(value, 0);
+  transmit();
+}
 
-inline int LCD_EM::write(unsigned char value) {
-  send(value, Rs);
+int LCD_EM::write(unsigned char value) {
+  if (_col < _cols) { // characters past the last column are not visible
+    _frame[_row][_col] = value;
+  }
+  _col++;
   return 1;
 }
 
@@ -196,26 +261,37 @@ void LCD_EM::send(unsigned char value, unsigned char mode) {
 }
 
 void LCD_EM::write4bits(unsigned char value) {
-  expanderWrite(value);
+  if ((value & Rs) != _last_rs) { // RS has to settle before En rises
+    expanderWrite(value);
+  }
   pulseEnable(value);
 }
 
 void LCD_EM::expanderWrite(unsigned char _data) {
-  char data_write[2];
-  data_write[0] = _data | _backlightval;
-  // Wire.beginTransmission(_addr);
-  // Wire.write((int)(_data) | _backlightval);
-  // Wire.endTransmission();
-  i2c.write(_addr, data_write, 1, 0);
-  i2c.stop();
+  if (_tx_len == LCD_TX_BUFFER) { // batch full, send what we have
+    transmit();
+  }
+  _tx_buffer[_tx_len++] = _data | _backlightval;
+  _last_rs = _data & Rs;
 }
 
-void LCD_EM::pulseEnable(unsigned char _data) {
-  expanderWrite(_data | En); // En high
-  wait_us(1);                // enable pulse must be >450ns
+void LCD_EM::transmit() {
+  if (_tx_len == 0) {
+    return;
+  }
+  // one START/address/STOP for the whole batch instead of one per byte
+  TRACE_BEGIN(TRACE_LCD_TRANSMIT);
+  i2c.write(_addr, _tx_buffer, _tx_len, 0);
+  TRACE_END(TRACE_LCD_TRANSMIT);
+  _bytes_sent += _tx_len;
+  _tx_len = 0;
+}
 
+void LCD_EM::pulseEnable(unsigned char _data) {
+  // each byte is ~90us on the bus at 100kHz, well over the >450ns enable
+  // pulse and the >37us commands need to settle
+  expanderWrite(_data | En);  // En high
   expanderWrite(_data & ~En); // En low
-  wait_us(50);                // commands need > 37us to settle
 }
 
 void LCD_EM::load_custom_character(unsigned char char_num,
@@ -234,7 +310,7 @@ void LCD_EM::setBacklight(unsigned char new_val) {
 int LCD_EM::print(const char *text) {
 
   while (*text != 0) {
-    send(*text, Rs);
+    write(*text);
     text++;
   }
   return 0;
@@ -1,5 +1,8 @@
 //modified from https://os.mbed.com/users/Yar/code/LiquidCrystal_I2C_for_Nucleo/
 
+#ifndef LCD_H
+#define LCD_H
+
  #include "mbed.h"
  
 // commands
@@ -48,6 +51,19 @@
 #define En 0x04//B00000100  // Enable bit
 #define Rw 0x02 // B00000010  // Read/Write bit
 #define Rs 0x01 //B00000001  // Register select bit
+
+// largest panel the shadow framebuffer can mirror (20x4)
+#define LCD_MAX_COLS 20
+#define LCD_MAX_ROWS 4
+
+// expander bytes batched into one I2C transaction, and the bus speed the
+// enable pulse timing relies on (PCF8574 is rated for 100kHz). A byte takes
+// ~90us at 100kHz but only ~22us at 400kHz, less than the 37us an HD44780
+// command needs, so the bus can't go faster without adding waits back.
+// At 100kHz one changed cell is one transaction of 10 bytes, about 1ms with
+// the cursor move; a repaint of all 32 cells of a 16x2 is 140 bytes, about 13ms
+#define LCD_TX_BUFFER 64
+#define LCD_I2C_FREQUENCY 100000
  
 /**
  * This is the driver for the Liquid Crystal LCD displays that use the I2C bus.
@@ -55,8 +71,18 @@
  * After creating an instance of this class, first call begin() before anything else.
  * The backlight is on by default, since that is the most likely operating mode in
  * most cases.
+ *
+ * Text operations (clear, home, setCursor, write, print) only update a frame
+ * buffer in RAM. flush() compares that frame with a shadow copy of the panel's
+ * DDRAM and sends only the cells that changed, so redrawing a screen that is
+ * mostly the same costs a handful of I2C bytes instead of a full rewrite.
+ *
+ * Expander writes are queued and sent as one multi-byte I2C transaction per
+ * operation; the time each byte spends on the bus covers the HD44780 enable
+ * pulse width and command settle time, so no busy waits are needed between
+ * nibbles.
  */
-class CSE321_LCD {
+class LCD_EM {
 public:
       /**
      * Constructor
@@ -67,7 +93,7 @@ public:
      * @param sda       Pin to use for SDA connection of I2C for LCD
      * @param scl       Pin to use for the SCL connection of I2C for LCD          
      */
-    CSE321_LCD( unsigned char lcd_cols, unsigned char lcd_rows, unsigned char charsize = LCD_5x8DOTS,PinName sda=PB_9, PinName scl=PB_8);
+    LCD_EM( unsigned char lcd_cols, unsigned char lcd_rows, unsigned char charsize = LCD_5x8DOTS,PinName sda=PB_9, PinName scl=PB_8);
  
     /**
      * Set the LCD display in the correct begin state, must be called before anything else is done.
@@ -75,7 +101,7 @@ public:
     void begin();
  
      /**
-      * Remove all the characters currently shown. Next print/write operation will start
+      * Blank the frame buffer. Next print/write operation will start
       * from the first position on LCD display.
       */
     void clear();
@@ -84,6 +110,19 @@ public:
      * Next print/write operation will will start from the first position on the LCD display.
      */
     void home();
+
+    /**
+     * Send the frame buffer cells that differ from the panel, moving the DDRAM
+     * address only when the next changed cell is not the one the panel's
+     * address counter already points at.
+     */
+    void flush();
+
+    /**
+     * Number of bytes written to the I2C expander since begin(), used to
+     * compare the bus cost of screen updates.
+     */
+    unsigned int getBytesSent();
  
      /**
       * Do not show any characters on the LCD display. Backlight state will remain unchanged.
@@ -148,6 +187,8 @@ private:
     void write4bits(unsigned char);
     void expanderWrite(unsigned char);
     void pulseEnable(unsigned char);
+    void transmit();
+    void resetFrame();
     unsigned char _addr;
     unsigned char _displayfunction;
     unsigned char _displaycontrol;
@@ -157,7 +198,20 @@ private:
     unsigned char _charsize;
     unsigned char _backlightval;
 
+    unsigned char _frame[LCD_MAX_ROWS][LCD_MAX_COLS];  // text the application wants shown
+    unsigned char _shadow[LCD_MAX_ROWS][LCD_MAX_COLS]; // text currently in the panel's DDRAM
+    unsigned char _col; // frame buffer write position
+    unsigned char _row;
+    int _ddram_col; // panel address counter position, -1 when unknown
+    int _ddram_row;
+    unsigned int _bytes_sent;
+
+    char _tx_buffer[LCD_TX_BUFFER]; // expander bytes waiting for transmit()
+    int _tx_len;
+    unsigned char _last_rs; // RS level the expander is currently driving
+
        //MBED I2C object used to transfer data to LCD
     I2C i2c;       
 };
- 
+
+#endif
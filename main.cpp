@@ -4,449 +4,510 @@
 #include "ThisThread.h"
 #include "Ticker.h"
 #include "mbed_thread.h"
+#include "FlashIAPBlockDevice.h"
 #include <lcd.h>
+#include <clock.h>
+#include <display.h>
+#include <glyphs.h>
+#include <events.h>
+#include <journal.h>
+#include <keypad.h>
+#include <state_machine.h>
+#include <ultrasonic.h>
+#include <zones.h>
+#include <microphone.h>
+#include <notify.h>
+#include <power.h>
+#include <latency.h>
+#include <lanes.h>
+#include <snapshot.h>
+#include <sound.h>
+#include <telemetry.h>
+#include <timers.h>
+#include <trace.h>
 #include <methods.h>
 #include <cstdio>
 #include <mbed.h>
 #include <string>
 #include <time.h>
 
-void isr_col(void); // Rising edge Interrupt Service Routine for column pins
-                    // [PF_14, PE_11, PE_9, PF_13]
-void isr_falling_edge(void); // Falling edge Interrupt Service Routine for
-                             // column pins [PF_14, PE_11, PE_9, PF_13]
-
+#if !MICROPHONE_ADC
 void isr_microphone(void); // Rising edge ISR for micrphone PD_7
+void microphone_holdoff_end(void); // Unmask the microphone pin after a storm holdoff
+#endif
 
-void isr_ultrasonic(void); // Rising edge ISR for ultrasonic sensor echo pin PD_5
-void isr_ultrasonic_falling_edge(void); // Falling edge ISR for ultrasonic echo pin 
-
-void ultrasonic_handler(void); // Handler after timeout is reached to see if object is within specified range
-void trigger_ultrasonic_sensor(void); // Send 10us pulse to ultrasonic trigger pin
+void microphone_handler(int zone, uint32_t timestamp); // Handles switching to triggered mode if sound is detected
+void handle_event(const IsrEvent &event); // Applies one event from the ISR ring to the system mode
 
-void microphone_handler(void); // Handles switching to triggered mode if sound is detected
-
-void row_handler(void); // Thread callback that handles the powering of rows on the matrix keypad
 void key_handler(void); // Thread callback that handles key presses based on current system mode
-
-void power_on_mode(void); // Initial power on state where passcode is defined
-void unarmed_mode(void); // Unarmed state where sensors do not trigger the system
-void armed_mode(void); // Armed state (after entering passcode in unarmed mode) where sensors trigger the system
-void triggered_mode(void); // State when a sensor is tripped in the armed state
-void trigger_mode_transition(void); // Used to call blocking code from ultrasonic ISR when motion detected
-
-void idle_timeout_handler(void); // Timeout handler after 10 seconds has passed without system input
-void set_display_off(void); // Calls blocking code from idle timeout to set the display off and reset LCD text
+void key_pressed(int index); // Applies one debounced key press to the system mode
+
+void trigger_mode_transition(void); // Enable alarm outputs when a sensor trips while armed
+DisplayScreen mode_screen(void); // Screen shown for the current system mode when nothing else is
+
+void idle_expired(void); // Timer callback after 10 seconds has passed without system input
+void banner_expired(void); // Timer callback that replaces the incorrect passcode banner with the mode screen
+void exit_delay_expired(void); // Timer callback that starts watching the sensors once armed
+void entry_delay_expired(void); // Timer callback that sounds the buzzer if a trip wasn't disarmed in time
+void alarm_blink(void); // Timer callback toggling the alarm LEDs while triggered
+void escalate_alarm(void); // Timer callback that alerts authorities if the alarm wasn't disarmed
+void zone_trip(int zone, uint32_t origin_us); // Dispatch a zone trip if the zone is armed and the exit delay is over
+void update_ping_rate(void); // Match the ultrasonic ping rate to the system mode
+void post_reports(void); // Timer callback that hands the periodic reports to the best-effort lane
+void flush_journal(void); // Timer callback that hands staged journal records to the best-effort lane
+void warm_restart(const Snapshot &snapshot); // Restore the mode and outputs saved before a reset
+void save_snapshot(void); // Save the mode and passcode so a reset comes back in the same mode
+void report_warm_restart(void); // Print how long the restore took, runs on the best-effort lane
+void set_display_off(void); // Called after the idle timeout to reset passcode entry and post the idle screen
+void check_invariant(int holds, int invariant); // Count a broken invariant, journal the first time each breaks
+void check_outputs(void); // Alarm outputs must match the mode after every event and timer
+void invariants_report(void); // Print invariant failures, runs on the best-effort lane
+
+enum Invariant {
+  INVARIANT_OUTPUTS,    // Triggered blinks and sounds the buzzer once the entry delay is over, otherwise silent
+  INVARIANT_KEY_ORDER,  // Every key goes down then up, a repeat means an event was lost
+  INVARIANT_EVENT_RING, // ISR ring never overflowed
+  INVARIANT_COUNT
+};
 
 const uint32_t TIMEOUT_MS = 5000; // Watchdog timeout before triggering system reset
+const uint32_t WATCHDOG_KICK_MS = 1000; // Longest the mode thread waits for an event before kicking the watchdog
+const uint32_t IDLE_TIMEOUT_MS = 10000; // No keypad input for this long blanks the display
+const uint32_t EXIT_DELAY_MS = 10000; // Time to leave after arming before the sensors count
+const uint32_t ENTRY_DELAY_MS = 5000; // Time to disarm after a trip before the buzzer sounds
+const uint32_t ESCALATION_MS = 10000; // Time to disarm after a trip before authorities are alerted
+const uint32_t ALARM_BLINK_MS = 500; // Alarm LED toggle period while triggered
+const uint32_t PING_GAP_MS[4] = {1000, 1000, 0, 250}; // Pause between ultrasonic ping rounds per mode, armed pings back to back
+const uint32_t REPORT_MS = 60000; // Period of the latency, lane and trace reports
+const uint32_t JOURNAL_FLUSH_MS = 5000; // Longest a journal record waits in RAM
+const PinName TELEMETRY_TX = PD_8; // USART3 TX on the morpho header
+const PinName NOTIFY_TX = PC_12; // UART5 on the Zio header, notifications keep off the console
+const PinName NOTIFY_RX = PD_2;
 
-int key_pressed = 0; // Determines if key is pressed (toggled by keypad ISRs)
-int debounced = 0; // Determines if a key press is valid after debouncing it
 int display_on = 1; // Flag to determine LCD state
-volatile int echo_on = 0; // Determines if the echo pin is high or low (can change while thread is going to access it)
-
-string password = "****"; // Passcode entered on system boot
+int authorities_alerted = 0; // Set once the escalation timer fires, cleared on disarm
+reset_reason_t reset_reason; // Why the system last reset, for the journal
+uint32_t restored_at_us = 0; // Time from reset until a saved mode was restored, 0 on a cold start
+int tripped_zone = ZONE_NONE; // Zone behind the current alarm, shown on the LCD and journalled
+int ping_mode = -1; // Mode the ping rate was last set for
+uint16_t keys_down = 0; // Keys the mode thread has seen go down and not up
+uint32_t invariant_failures[INVARIANT_COUNT];
+
+string password = "****"; // Passcode entered on system boot, only kept until it is hashed
+uint32_t passcode_hash = 0; // Hash of the passcode, restored with the mode after a reset
 string password_entered = "****"; // Passcode entered when attempting to switch between system modes
 int password_position = 0; // Flag to determine which digit is being entered
-int entering_password = 0; // Flag to determine if a passcode is being entered
 
 LCD_EM LCD(16, 2, LCD_5x8DOTS, PB_9, PB_8); // Initialize LCD
 
-// Initialize interrupts for columns of keypad. Set pull down to pull port down
-// to 0 volts
-InterruptIn col_0(PF_14, PullDown);
-InterruptIn col_1(PE_11, PullDown);
-InterruptIn col_2(PE_9, PullDown);
-InterruptIn col_3(PF_13, PullDown);
-
+#if !MICROPHONE_ADC // The ADC build leaves PD_7 and its EXTI line alone
 InterruptIn microphone(PD_7, PullDown); // Initialize microphone Dout as an interrupt
-InterruptIn ultrasonic_echo(PD_5, PullDown); // Initialize ultrasonic sensor echo as an interrupt
+Timeout microphone_holdoff; // Keeps the microphone pin masked while its rate limit refills
+#endif
 
-DigitalOut ultrasonic_trigger(PD_6); // Set ultrasonic trigger as a digit output
 DigitalOut active_buzzer(PD_4); // Set active buzzer as a digit output
 DigitalOut microphone_enable(PF_12); // Set pin going to microphone AND Gate as a digit output to enable and disable the mic interrupt pin
 DigitalOut alarm_leds(PD_15); // Set LEDs as a digital output
 
-Thread row_thread; // Declare thread handling keypad rows
-Thread key_thread; // Declare thread maintaining system modes
-
-Mutex resource_lock; // Declare mutex to maintain thread sychronization and protect against race conditions
-
-EventQueue queue; // Initialize EventQueue to queue blocking code from ISR
-
-Timeout idle_timeout; // Timeout to disable LCD backlight after 10 seconds
-Timeout ultrasonic_timeout; // Timeout to check if ultrasonic echo is still active to determine object distance 
-
-Ticker ultrasonic_ticker; // Ticker to trigger ultrasonic sensor pulses
+Thread key_thread(LANE_REALTIME_PRIORITY); // Declare thread maintaining system modes, the only thread that changes them
+
+// Timed behaviour, all run from the mode thread's timer wheel
+WheelTimer idle_timer; // Disables LCD backlight after 10 seconds without input
+WheelTimer banner_timer; // Reverts the incorrect passcode banner
+WheelTimer exit_delay_timer; // Running while the sensors are ignored after arming
+WheelTimer entry_delay_timer; // Running between a trip and the buzzer
+WheelTimer escalation_timer; // Running between a trip and alerting authorities
+WheelTimer alarm_blink_timer; // Alarm LED toggle while triggered
+WheelTimer report_timer; // Periodic reports
+WheelTimer journal_timer; // Periodic journal flush
+FlashIAPBlockDevice journal_flash; // Sectors past the image, see target.restrict_size
+
+// Sensor zones, the index is the zone number. Ultrasonic sensors that can hear each
+// other's pings need different ping groups.
+#define ZONE_MIC 1
+const ZoneConfig zone_table[] = {
+    {"Ultrasonic", ZONE_ULTRASONIC, 0, PD_6, PD_5, ULTRASONIC_TRIP_MM, 1 << 2},
+    {"Microphone", ZONE_MICROPHONE, 0, NC, NC, 0, 1 << 2},
+};
 
 char keypad[4][4] = {{'1', '2', '3', 'A'},
                      {'4', '5', '6', 'B'},
                      {'7', '8', '9', 'C'},
                      {'*', '0', '#', 'D'}}; // Enumerate keypad matrix
 
-int mode = 0; // 0 -> Power On Mode (Define Code), 1 -> Unarmed, 2 -> Armed, 3
-              // -> Triggered
-
-int row = 0; // Current keypad row to power
-
 int main() {
-    // Enable interrupts
-  col_0.enable_irq();
-  col_1.enable_irq();
-  col_2.enable_irq();
-  col_3.enable_irq();
-  
-  // Enable clock control register for GPIO A & C
-  enable_rcc('a');
-  enable_rcc('c');
-
-  // Declare GPIOA pin 3 as an output
-  set_pin_mode(3, GPIOA, 1);
-  // Declare GPIOC pin 0 as an output
-  set_pin_mode(0, GPIOC, 1);
-  // Declare GPIOC pin 3 as an output
-  set_pin_mode(3, GPIOC, 1);
-  // Declare GPIOC pin 1 as an output
-  set_pin_mode(1, GPIOC, 1);
-
-  LCD.begin(); // Initialize LCD
-  LCD.print("Set Passcode: "); // Print prompt
-  LCD.setCursor(0, 1); // Set cursor to next row
-
-  // Declare interrupts for rising edge of each column of keypad
-  col_0.rise(&isr_col);
-  col_1.rise(&isr_col);
-  col_2.rise(&isr_col);
-  col_3.rise(&isr_col);
+  reset_reason = ResetReason::get();
+  Snapshot snapshot;
+  if (snapshot_load(&snapshot) && snapshot.mode) { // Still running before the reset, pick up where it left off
+    warm_restart(snapshot);
+  }
 
-  microphone.rise(&isr_microphone); // Set microphone rising edge ISR
+  trace_init(); // Start the cycle counter before the first tracepoint
+  event_init(); // Ring must be ready before any ISR posts to it
+  journal_init(&journal_flash); // Find the journal head before the mode thread logs anything
+  notify_start(NOTIFY_TX, NOTIFY_RX); // Framed alarm notifications on their own UART
+#if TELEMETRY_ENABLED
+  telemetry_start(TELEMETRY_TX); // Raw sensor samples on their own UART
+#endif
 
-  ultrasonic_echo.rise(&isr_ultrasonic); // Set ultrasonic sensor rising edge ISR
-  ultrasonic_echo.fall(&isr_ultrasonic_falling_edge); // Set ultrasonic sensor falling edge ISR
+  display_show(mode_screen(), 0, tripped_zone); // Prompt is drawn once the LCD finishes initializing
+  display_start(&LCD); // Start thread that initializes and draws the LCD
 
-  // Declare interrupts for falling edge of each column of keypad
-  col_0.fall(&isr_falling_edge);
-  col_1.fall(&isr_falling_edge);
-  col_2.fall(&isr_falling_edge);
-  col_3.fall(&isr_falling_edge);
+#if MICROPHONE_ADC
+  microphone_start(ZONE_MIC); // Sample the microphone with ADC + DMA, posts EVENT_MIC on sustained sound
+#else
+  microphone.rise(&isr_microphone); // Set microphone rising edge ISR
+#endif
 
-  idle_timeout.attach(&idle_timeout_handler, 10s); // Attach timeout to handle when system has not received user input
-  
-  ultrasonic_ticker.attach(&trigger_ultrasonic_sensor, 500ms); // Attach ticker to trigger ultrasonic sensor pulses
+  zones_start(zone_table, sizeof(zone_table) / sizeof(zone_table[0])); // Start staggered ultrasonic pings
 
-  row_thread.start(row_handler); // Start thread to handle keypad row powering
+  keypad_start(); // Scan keypad rows from a ticker, posts debounced key events
   key_thread.start(key_handler); // Start thread to handle system mode functions
 
   Watchdog &watchdog = Watchdog::get_instance(); // Initialize watchdog 
   watchdog.start(TIMEOUT_MS); // Start watchdog with specified timeout
 
-  queue.dispatch_forever(); // Use main thread to handle any blocking code sent from ISR to the queue
-}
-
-void isr_col(void) { key_pressed = 1; } // Set flag to handle in debounce ticker
-
-void isr_falling_edge(void) { // Set flag to indicate key no longer pressed
-  key_pressed = 0;
-  debounced = 0;
+  housekeeping_dispatch(); // Main thread runs the best-effort lane at low priority
 }
 
+#if !MICROPHONE_ADC
 void isr_microphone(void) { 
-  microphone_enable = 0; // Disable mic input to prevent ISR overflow
-  queue.call(&microphone_handler); // Send ISR blocking code to Queue
-}
-
-void isr_ultrasonic(void) {
-  echo_on = 1; // Set echo flag
-  ultrasonic_timeout.attach(&ultrasonic_handler, 888us); // Set timeout to check detected object distance
+  TRACE_BEGIN(TRACE_ISR_MICROPHONE);
+  power_wakeup(WAKE_MICROPHONE);
+  int admitted = sound_admit();
+  TELEMETRY(TELEMETRY_MIC_EDGE, ZONE_MIC, admitted);
+  if (admitted) {
+    microphone_enable = 0; // Disable mic input to prevent ISR overflow
+    event_post(EVENT_MIC, ZONE_MIC); // Let the mode thread decide whether to trigger
+  } else { // Noise storm, mask the pin until the bucket has earned another token
+    microphone.disable_irq();
+    microphone_holdoff.attach(&microphone_holdoff_end,
+                              std::chrono::microseconds(1000000 / SOUND_RATE_PER_S));
+  }
+  TRACE_END(TRACE_ISR_MICROPHONE);
 }
 
-void isr_ultrasonic_falling_edge(void) { echo_on = 0; } // Set echo flag
+void microphone_holdoff_end(void) { microphone.enable_irq(); }
+#endif
 
-void microphone_handler() {
-  resource_lock.lock(); // Lock system resources before modifying flags
-  if (mode == 2) { // If armed, reset flags and enter triggered mode
-    mode = 3;
-    alarm_leds = 1;
-    password_position = 0;
-    entering_password = 0;
-    active_buzzer = 1;
-    LCD.clear();
-    LCD.print("Triggered");
+void microphone_handler(int zone, uint32_t timestamp) {
+  if (sound_event(timestamp)) { // Enough sound within the window, only triggers the alarm when armed
+    zone_set_level(zone, ZONE_LEVELS - 1);
+    zone_trip(zone, timestamp);
+  } else {
+    zone_set_level(zone, 2);
   }
-  else { // Reenable microphone
+  if (sm_mode() != 3) { // Reenable microphone unless it just tripped the alarm
       microphone_enable = 1;
   }
-  resource_lock.unlock(); // Unlock system resources after modifying flags
 }
 
-void ultrasonic_handler() {
-  if (mode == 2 && !echo_on) { // If armed and within triggering distance, handle in queue for blocking code
-    queue.call(&trigger_mode_transition);
+void update_ping_rate() {
+  int mode = sm_mode();
+  if (mode != ping_mode) {
+    ping_mode = mode;
+    zones_set_mode(mode, PING_GAP_MS[mode], mode < 2); // Scene is learned while disarmed
+  }
+}
+
+void zone_trip(int zone, uint32_t origin_us) {
+  if (!timer_active(&exit_delay_timer) && zone_armed(zone, sm_mode())) {
+    latency_begin(LATENCY_SENSOR_TO_LEDS, origin_us); // Only readings that trip are timed
+    latency_probe(LATENCY_SENSOR_TO_LEDS, STAGE_DISPATCH);
+    tripped_zone = zone;
+    sm_dispatch(INPUT_SENSOR_TRIP);
+    latency_cancel(LATENCY_SENSOR_TO_LEDS); // Already recorded its output unless the table ignored the trip
   }
 }
 
 void trigger_mode_transition() {
-    // Reset flags, enable alarm outputs, and enter triggered mode
-  mode = 3;
+    // Reset flags and enable alarm outputs; the buzzer waits out the entry delay
+  latency_probe(LATENCY_SENSOR_TO_LEDS, STAGE_HANDLER);
+  latency_begin_from(LATENCY_SENSOR_TO_BUZZER, LATENCY_SENSOR_TO_LEDS); // Completes in entry_delay_expired
   alarm_leds = 1;
   password_position = 0;
-  entering_password = 0;
   microphone_enable = 0;
+  latency_probe(LATENCY_SENSOR_TO_LEDS, STAGE_OUTPUT);
+  journal_log(JOURNAL_TRIGGER, tripped_zone, sm_mode());
+  save_snapshot();
+  notify_send(NOTIFY_TRIP, tripped_zone, sm_mode());
+  display_show(SCREEN_TRIGGERED, 0, tripped_zone);
+  timer_start(&alarm_blink_timer, ALARM_BLINK_MS, &alarm_blink);
+  timer_start(&entry_delay_timer, ENTRY_DELAY_MS, &entry_delay_expired);
+  timer_start(&escalation_timer, ESCALATION_MS, &escalate_alarm);
+}
+
+void entry_delay_expired() {
   active_buzzer = 1;
-  LCD.clear();
-  LCD.print("Triggered");
+  latency_probe(LATENCY_SENSOR_TO_BUZZER, STAGE_OUTPUT);
 }
 
-void key_handler() {
-  while (1) {
-    resource_lock.lock(); // Lock system resources before modifying flags
-    if (key_pressed) { // Check keypress
-      if (!debounced) { // Debounce key if not already handled
-        thread_sleep_for(10); // Debounce time is 10ms
-        if (key_pressed) { // If key is still pressed, it is a valid press
-          debounced = 1;
-          if (!display_on) { // Turn display on if the system was in idle state
-            display_on = 1;
-            LCD.backlight();
-          }
-          idle_timeout.detach(); // Reset idle timeout
-          idle_timeout.attach(&idle_timeout_handler, 10s);
-          switch (mode) { // Handle the keypress based on current system mode
-          case 0:
-            power_on_mode();
-            break;
-          case 1:
-            unarmed_mode();
-            break;
-          case 2:
-            armed_mode();
-            break;
-          case 3:
-            triggered_mode();
-            break;
-          }
-        }
-      }
-    }
-    resource_lock.unlock(); // Unlock system resources after modifying flags
+void alarm_blink() {
+  alarm_leds = !alarm_leds;
+  timer_start(&alarm_blink_timer, ALARM_BLINK_MS, &alarm_blink); // Runs until disarmed
+}
+
+void escalate_alarm() {
+  authorities_alerted = 1;
+  journal_log(JOURNAL_ESCALATE, tripped_zone, sm_mode());
+  save_snapshot();
+  notify_send(NOTIFY_ESCALATE, tripped_zone, sm_mode()); // Queued, never waits on the UART
+  if (sm_state() == STATE_TRIGGERED) { // Leave a passcode being entered on screen
+    display_show(SCREEN_AUTHORITIES_ALERTED, 0, tripped_zone);
   }
 }
 
-void row_handler() {
+void exit_delay_expired() { microphone_enable = 1; }
+
+void key_handler() {
+  IsrEvent event;
+  timer_init();
+  timer_start(&idle_timer, IDLE_TIMEOUT_MS, &idle_expired);
+  timer_start(&report_timer, REPORT_MS, &post_reports);
+  timer_start(&journal_timer, JOURNAL_FLUSH_MS, &flush_journal);
+  journal_log(JOURNAL_BOOT, ZONE_NONE, sm_mode(), reset_reason);
+  if (sm_mode() == 3) { // Restored into an alarm, its timers didn't survive the reset
+    timer_start(&alarm_blink_timer, ALARM_BLINK_MS, &alarm_blink);
+    if (!authorities_alerted) {
+      timer_start(&escalation_timer, ESCALATION_MS, &escalate_alarm);
+    }
+  }
+  if (restored_at_us) {
+    housekeeping_post(&report_warm_restart);
+  }
   while (1) {
-    resource_lock.lock(); // Lock system resources before modifying flags
-    if (!key_pressed) {
-      row++;    // Increment row
-      row %= 4; // Keep row between 0 and 3
-      switch (row) {
-      case 0: // Turn off other rows, turn on row 0
-        write_to_pin(0, GPIOC, 0);
-        write_to_pin(3, GPIOC, 0);
-        write_to_pin(1, GPIOC, 0);
-        write_to_pin(3, GPIOA, 1);
-        break;
-      case 1: // Turn off other rows, turn on row 1
-        write_to_pin(3, GPIOA, 0);
-        write_to_pin(3, GPIOC, 0);
-        write_to_pin(1, GPIOC, 0);
-        write_to_pin(0, GPIOC, 1);
-        break;
-      case 2: // Turn off other rows, turn on row 2
-        write_to_pin(3, GPIOA, 0);
-        write_to_pin(0, GPIOC, 0);
-        write_to_pin(1, GPIOC, 0);
-        write_to_pin(3, GPIOC, 1);
-        break;
-      case 3: // Turn off other rows, turn on row 3
-        write_to_pin(3, GPIOA, 0);
-        write_to_pin(0, GPIOC, 0);
-        write_to_pin(3, GPIOC, 0);
-        write_to_pin(1, GPIOC, 1);
-        break;
-      }
+    update_ping_rate();
+    uint32_t timeout_ms = timer_advance(); // Run due timers, then sleep until the next one
+    if (timeout_ms > WATCHDOG_KICK_MS) {
+      timeout_ms = WATCHDOG_KICK_MS;
     }
-    resource_lock.unlock(); // Unlock system resources after modifying flags
-    Watchdog::get_instance().kick(); // Reset watchdog timer since user input is still working correctly and not blocked
+    if (event_wait(&event, timeout_ms)) { // Sleep until an ISR posts something
+      lane_record(LANE_REALTIME, event_pending() + 1, event.posted);
+      handle_event(event);
+    } else {
+      power_wakeup(WAKE_TIMER);
+    }
+    check_outputs();
+    Watchdog::get_instance().kick(); // Reset watchdog timer since the mode thread is not blocked
   }
 }
 
-void power_on_mode() {
-  if (col_0.read() && keypad[row][0] != '*') { // Check if column powered and if number pressed
-    password[password_position] = keypad[row][0];
-  } else if (col_1.read()) { // Check if column powered
-    password[password_position] = keypad[row][1];
-  } else if (col_2.read() && keypad[row][2] != '#') { // Check if column powered and if number pressed
-    password[password_position] = keypad[row][2];
+void key_pressed(int index) {
+  char key = keypad[index / 4][index % 4];
+  if (!display_on) { // Turn display on if the system was in idle state
+    display_on = 1;
+    display_backlight(1);
   }
-  if ((col_0.read() && keypad[row][0] != '*') || col_1.read() ||
-      (col_2.read() && keypad[row][2] != '#')) { // If valid number pressed, set password, update position, and update LCD
-    password_position++;
-    LCD.print("*");
-    if (password_position == 4) {
-      password_position = 0;
-      mode = 1;
-      LCD.clear();
-      LCD.print("Unarmed");
+  timer_start(&idle_timer, IDLE_TIMEOUT_MS, &idle_expired); // Reset idle timeout
+  if (sm_dispatch(sm_key_input(key), key) == ACTION_NONE) { // Transition table decides what the key does in this mode
+    latency_cancel(LATENCY_KEY_TO_DISPLAY); // Key ignored, nothing will be drawn
+  } else {
+    latency_probe(LATENCY_KEY_TO_DISPLAY, STAGE_HANDLER);
+  }
+}
+
+void handle_event(const IsrEvent &event) {
+  TRACE_BEGIN(TRACE_HANDLE_EVENT);
+  switch (event.type) {
+  case EVENT_KEY_DOWN: // Already debounced by the keypad scan
+    check_invariant(!(keys_down & (1u << event.value)), INVARIANT_KEY_ORDER);
+    keys_down |= 1u << event.value;
+    latency_begin(LATENCY_KEY_TO_DISPLAY, event.timestamp);
+    latency_probe(LATENCY_KEY_TO_DISPLAY, STAGE_DISPATCH);
+    key_pressed(event.value);
+    break;
+  case EVENT_KEY_UP: // Keys act on press only
+    check_invariant(keys_down & (1u << event.value), INVARIANT_KEY_ORDER);
+    keys_down &= ~(1u << event.value);
+    break;
+  case EVENT_MIC:
+    microphone_handler(event.source, event.timestamp);
+    break;
+  case EVENT_ECHO_PULSE:
+    if (zone_add_pulse(event.source, event.value)) { // Filtered distance is within trip range
+      zone_trip(event.source, event.timestamp);
     }
+    break;
   }
+  TRACE_END(TRACE_HANDLE_EVENT);
 }
 
-void unarmed_mode() {
-  if (col_0.read() && keypad[row][0] != '*' && entering_password) { // Check if column powered and if number pressed if entering password
-    password_entered[password_position] = keypad[row][0];
-  } else if (col_1.read() && entering_password) { // Check if column powered and if number pressed if entering password
-    password_entered[password_position] = keypad[row][1];
-
-  } else if (col_2.read() && keypad[row][2] != '#' && entering_password) { // Check if column powered and if number pressed if entering password
-    password_entered[password_position] = keypad[row][2];
-  } else if (col_3.read() && keypad[row][3] == 'A' && !entering_password) { // Check if column powered and if A pressed if NOT entering password
-    entering_password = 1;
-    LCD.clear();
-    LCD.print("Enter Passcode: ");
-    LCD.setCursor(0, 1);
+void idle_expired() { // Activated if system has idled without user input for 10s
+  if (display_on) {
+    display_on = 0;
+    sm_dispatch(INPUT_IDLE);
   }
-  if ((col_0.read() && keypad[row][0] != '*' && entering_password) ||
-      (col_1.read() && entering_password) ||
-      (col_2.read() && keypad[row][2] != '#' && entering_password)) { // Check for valid number press and then update flags
-    password_position++;
-    LCD.print("*");
-    if (password_position == 4) { // If password entered, compare between actual password
-      password_position = 0;
-      entering_password = 0;
-      if (password_entered == password) { // If correct password -> armed mode else stay in unarmed mode
-        mode = 2;
-        microphone_enable = 1;
-        LCD.clear();
-        LCD.print("Armed");
-      } else {
-        LCD.clear();
-        LCD.print("Incorrect");
-        LCD.setCursor(0, 1);
-        LCD.print("Passcode");
-        thread_sleep_for(2000);
-        LCD.clear();
-        LCD.print("Unarmed");
-      }
-    }
+}
+
+void banner_expired() { display_show(mode_screen(), 0, tripped_zone); }
+
+void post_reports() { // Printing is slow, keep it off the mode thread
+  housekeeping_post(&latency_report);
+  housekeeping_post(&lane_report);
+  housekeeping_post(&zones_report);
+  housekeeping_post(&sound_report);
+  housekeeping_post(&notify_report);
+  housekeeping_post(&invariants_report);
+  housekeeping_post(&power_report);
+  housekeeping_post(&glyphs_report);
+#if TELEMETRY_ENABLED
+  housekeeping_post(&telemetry_report);
+#endif
+#if TRACE_ENABLED
+  housekeeping_post(&trace_dump);
+#endif
+  timer_start(&report_timer, REPORT_MS, &post_reports);
+}
+
+void warm_restart(const Snapshot &snapshot) {
+  passcode_hash = snapshot.passcode_hash;
+  authorities_alerted = snapshot.alerted;
+  tripped_zone = snapshot.sensor;
+  sm_restore_mode(snapshot.mode);
+  if (snapshot.mode == 2) { // Armed, no exit delay since nobody is leaving
+    microphone_enable = 1;
+  } else if (snapshot.mode == 3) { // Alarm was already sounding, its entry delay is long gone
+    alarm_leds = 1;
+    active_buzzer = 1;
   }
+  restored_at_us = clock_now_us(); // Timer starts at reset, so this is boot to armed
+}
+
+void save_snapshot() {
+  Snapshot snapshot;
+  snapshot.mode = sm_mode();
+  snapshot.alerted = authorities_alerted;
+  snapshot.sensor = tripped_zone;
+  snapshot.passcode_hash = passcode_hash;
+  snapshot_save(snapshot);
 }
 
-void armed_mode() {
-  if (col_0.read() && keypad[row][0] != '*' && entering_password) { // Check if column powered and if number pressed if entering password
-    password_entered[password_position] = keypad[row][0];
-  } else if (col_1.read() && entering_password) { // Check if column powered and if number pressed if entering password
-    password_entered[password_position] = keypad[row][1];
-
-  } else if (col_2.read() && keypad[row][2] != '#' && entering_password) { // Check if column powered and if number pressed if entering password
-    password_entered[password_position] = keypad[row][2];
-  } else if (col_3.read() && keypad[row][3] == 'A' && !entering_password) { // Check if column powered and if A pressed if NOT entering password
-    entering_password = 1;
-    LCD.clear();
-    LCD.print("Enter Passcode: ");
-    LCD.setCursor(0, 1);
+void check_invariant(int holds, int invariant) {
+  if (holds) {
+    return;
   }
-  if ((col_0.read() && keypad[row][0] != '*' && entering_password) ||
-      (col_1.read() && entering_password) ||
-      (col_2.read() && keypad[row][2] != '#' && entering_password)) {  // Check for valid number press and then update flags
-    password_position++;
-    LCD.print("*");
-    if (password_position == 4) { // If password entered, compare between actual password
-      password_position = 0;
-      entering_password = 0;
-      if (password_entered == password) { // If correct password -> unarmed mode else stay in armed mode
-        mode = 1;
-        LCD.clear();
-        LCD.print("Unarmed");
-      } else {
-        LCD.clear();
-        LCD.print("Incorrect");
-        LCD.setCursor(0, 1);
-        LCD.print("Passcode");
-        thread_sleep_for(2000);
-        LCD.clear();
-        LCD.print("Armed");
-      }
-    }
+  if (invariant_failures[invariant]++ == 0) { // Later failures only count, the journal keeps the first
+    journal_log(JOURNAL_INVARIANT, ZONE_NONE, sm_mode(), invariant);
   }
 }
 
-void triggered_mode() {
-  if (col_0.read() && keypad[row][0] != '*' && entering_password) { // Check if column powered and if number pressed if entering password
-    password_entered[password_position] = keypad[row][0];
-  } else if (col_1.read() && entering_password) { // Check if column powered and if number pressed if entering password
-    password_entered[password_position] = keypad[row][1];
-
-  } else if (col_2.read() && keypad[row][2] != '#' && entering_password) { // Check if column powered and if number pressed if entering password
-    password_entered[password_position] = keypad[row][2];
-  } else if (col_3.read() && keypad[row][3] == 'A' && !entering_password) { // Check if column powered and if A pressed if NOT entering password
-    entering_password = 1;
-    LCD.clear();
-    LCD.print("Enter Passcode: ");
-    LCD.setCursor(0, 1);
+void check_outputs() {
+  if (sm_mode() == 3) {
+    check_invariant(timer_active(&alarm_blink_timer) &&
+                        (active_buzzer || timer_active(&entry_delay_timer)),
+                    INVARIANT_OUTPUTS);
+  } else {
+    check_invariant(!active_buzzer && !timer_active(&alarm_blink_timer), INVARIANT_OUTPUTS);
   }
-  if ((col_0.read() && keypad[row][0] != '*' && entering_password) ||
-      (col_1.read() && entering_password) ||
-      (col_2.read() && keypad[row][2] != '#' && entering_password)) {  // Check for valid number press and then update flags
-    password_position++;
-    LCD.print("*");
-    if (password_position == 4) { // If password entered, compare between actual password
-      password_position = 0;
-      entering_password = 0;
-      if (password_entered == password) {  // If correct password -> unarmed mode else stay in triggered mode
-        mode = 1;
-        LCD.clear();
-        LCD.print("Unarmed");
-        active_buzzer = 0;
-        alarm_leds = 0;
-      } else {
-        LCD.clear();
-        LCD.print("Incorrect");
-        LCD.setCursor(0, 1);
-        LCD.print("Passcode");
-        thread_sleep_for(2000);
-        LCD.clear();
-        LCD.print("Triggered");
-      }
+  check_invariant(event_lost_count() == 0, INVARIANT_EVENT_RING);
+}
+
+void invariants_report() {
+  static const char *names[INVARIANT_COUNT] = {"outputs", "key order", "event ring"};
+  for (int i = 0; i < INVARIANT_COUNT; i++) {
+    if (invariant_failures[i]) {
+      printf("invariant %s: failed %lu times\r\n", names[i], (unsigned long)invariant_failures[i]);
     }
   }
 }
 
-void idle_timeout_handler() { // Handler acivated if system has idled without user input for 10s
-  if (display_on) {
-    display_on = 0;
-    queue.call(&set_display_off); // Queue LCD blocking code from ISR
-  }
+void report_warm_restart() {
+  printf("warm restart into mode %d after reset reason %d, restored %luus after reset\r\n",
+         sm_mode(), (int)reset_reason, (unsigned long)restored_at_us);
 }
 
-void set_display_off() {
-  LCD.noBacklight();  // Turn off LCD backlight since system is idling
-  LCD.clear();
-  password_position = 0; // Reset password flags
-  entering_password = 0;
-  switch (mode) { // Reset prompt to idle prompt
-  case 0:
-    LCD.print("Set Passcode: ");
-    LCD.setCursor(0, 1);
+void flush_journal() {
+  journal_schedule_flush(); // Programming flash stalls, keep it off the mode thread
+  timer_start(&journal_timer, JOURNAL_FLUSH_MS, &flush_journal);
+}
+
+int sm_run_action(SecurityAction action, char key) {
+  if (action != ACTION_NONE) { // Whatever the action draws replaces a pending banner
+    timer_cancel(&banner_timer);
+  }
+  switch (action) {
+  case ACTION_STORE_DIGIT: // Store digit of the new passcode
+    password[password_position] = key;
+    password_position++;
+    display_show(SCREEN_SET_PASSCODE, password_position);
+    if (password_position == 4) {
+      password_position = 0;
+      return INPUT_CODE_COMPLETE;
+    }
     break;
-  case 1:
-    LCD.print("Unarmed");
+  case ACTION_PASSCODE_SET:
+    passcode_hash = snapshot_hash(password.c_str(), 4);
+    password = "****"; // Only the hash is kept
+    save_snapshot();
+    journal_log(JOURNAL_PASSCODE_SET, ZONE_NONE, sm_mode());
+    display_show(SCREEN_UNARMED);
     break;
-  case 2:
-    LCD.print("Armed");
+  case ACTION_BEGIN_ENTRY:
+    password_position = 0;
+    display_show(SCREEN_ENTER_PASSCODE);
+    break;
+  case ACTION_ENTRY_DIGIT: // Store digit, compare once all four are entered
+    password_entered[password_position] = key;
+    password_position++;
+    display_show(SCREEN_ENTER_PASSCODE, password_position);
+    if (password_position == 4) {
+      password_position = 0;
+      return snapshot_hash(password_entered.c_str(), 4) == passcode_hash ? INPUT_CODE_MATCH : INPUT_CODE_MISMATCH;
+    }
     break;
-  case 3:
-    LCD.print("Triggered");
+  case ACTION_ARM: // Sensors are enabled once the exit delay runs out
+    journal_log(JOURNAL_ARM, ZONE_NONE, sm_mode());
+    save_snapshot();
+    notify_send(NOTIFY_ARM, ZONE_NONE, sm_mode());
+    timer_start(&exit_delay_timer, EXIT_DELAY_MS, &exit_delay_expired);
+    display_show(SCREEN_ARMED);
+    break;
+  case ACTION_DISARM: // Also silences the alarm when disarming from triggered
+    timer_cancel(&alarm_blink_timer);
+    timer_cancel(&entry_delay_timer);
+    timer_cancel(&escalation_timer);
+    latency_cancel(LATENCY_SENSOR_TO_BUZZER); // Disarmed inside the entry delay, the buzzer never sounds
+    authorities_alerted = 0;
+    tripped_zone = ZONE_NONE;
+    active_buzzer = 0;
+    alarm_leds = 0;
+    journal_log(JOURNAL_DISARM, ZONE_NONE, sm_mode());
+    save_snapshot();
+    notify_send(NOTIFY_DISARM, ZONE_NONE, sm_mode());
+    display_show(SCREEN_UNARMED);
+    break;
+  case ACTION_REJECT_CODE:
+    journal_log(JOURNAL_WRONG_PASSCODE, ZONE_NONE, sm_mode());
+    display_show(SCREEN_INCORRECT_PASSCODE);
+    timer_start(&banner_timer, DISPLAY_BANNER_MS, &banner_expired);
+    break;
+  case ACTION_TRIGGER:
+    trigger_mode_transition();
+    break;
+  case ACTION_IDLE:
+    set_display_off();
+    break;
+  default:
     break;
   }
+  return -1; // No follow-up input
 }
 
-void trigger_ultrasonic_sensor() {
-  if (!echo_on) { // Wait for previous trigger to finish
-    ultrasonic_trigger = 1; // Activate pulse
-    wait_us(10); // Wait for specified time
-    ultrasonic_trigger = 0; // Deactivate trigger pulse
-    if (mode == 3) {
-      alarm_leds = !alarm_leds; // Toggle alarm LEDs if in triggered mode
-    }
+void set_display_off() {
+  display_backlight(0);  // Turn off LCD backlight since system is idling
+  password_position = 0; // Reset password flags
+  display_show(mode_screen(), 0, tripped_zone); // Reset prompt to idle prompt
+}
+
+DisplayScreen mode_screen() {
+  switch (sm_mode()) {
+  case 0:
+    return SCREEN_SET_PASSCODE;
+  case 1:
+    return SCREEN_UNARMED;
+  case 2:
+    return SCREEN_ARMED;
+  default:
+    return authorities_alerted ? SCREEN_AUTHORITIES_ALERTED : SCREEN_TRIGGERED;
   }
 }
@@ -8,6 +8,10 @@
  * void set_pin_mode(unsigned int pin, GPIO_TypeDef *port, unsigned int mode) - Set the designed pin/port to be an input/output
  * void enable_rcc(unsigned int port) - Enable the reset control clock for the specified GPIO port
  * void write_to_pin(unsigned int pin, GPIO_TypeDef *port, unsigned int value) - Writes the designated value (0/1) to the entered pin and port
+ * Port<Base>::enable_rcc() - Enable the port clock, RCC bit resolved at compile time
+ * Port<Base>::configure_group<Mask>(mode) - Set MODER for every pin in the mask with one store
+ * Port<Base>::write_port(mask, values) - Drive every pin in the mask with one BSRR store
+ * Pin<Base, N>::set_mode(mode) / write(value) / read() - Single pin forms of the above
  *
  * Assignment: Project 2
  * Inputs: 
@@ -17,8 +21,60 @@
  *      MBED Bare Metal Guide - https://os.mbed.com/docs/mbed-os/v6.15/bare-metal/index.html
  *      STM32L48 User Guide - https://www.st.com/resource/en/reference_manual/rm0351-stm32l47xxx-stm32l48xxx-stm32l49xxx-and-stm32l4axxx-advanced-armbased-32bit-mcus-stmicroelectronics.pdf 
  */
- #include "mbed.h"
+#ifndef METHODS_H
+#define METHODS_H
+
+#include "mbed.h"
+
+#define PIN_MODE_INPUT 0
+#define PIN_MODE_OUTPUT 1
+#define PIN_MODE_ALTERNATE 2
+#define PIN_MODE_ANALOG 3
 
 void set_pin_mode(unsigned int pin, GPIO_TypeDef *port, unsigned int mode);
 void enable_rcc(unsigned int port);
 void write_to_pin(unsigned int pin, GPIO_TypeDef *port, unsigned int value);
+
+// Spreads a 16-bit pin mask to the 2-bit-per-pin MODER layout
+constexpr uint32_t moder_spread(uint16_t mask, uint32_t field) {
+  uint32_t result = 0;
+  for (unsigned int pin = 0; pin < 16; pin++) {
+    if (mask & (1u << pin)) {
+      result |= field << (pin * 2);
+    }
+  }
+  return result;
+}
+
+template <uint32_t PortBase> struct Port {
+  // GPIOA..GPIOI are 0x400 apart and enabled by consecutive AHB2ENR bits
+  static constexpr uint32_t rcc_bit = 1u << ((PortBase - GPIOA_BASE) / 0x400);
+
+  static GPIO_TypeDef *regs() { return reinterpret_cast<GPIO_TypeDef *>(PortBase); }
+
+  static void enable_rcc() { RCC->AHB2ENR |= rcc_bit; }
+
+  template <uint16_t Mask> static void configure_group(unsigned int mode) {
+    GPIO_TypeDef *port = regs();
+    port->MODER = (port->MODER & ~moder_spread(Mask, 0x3)) | moder_spread(Mask, mode & 0x3);
+  }
+
+  static void write_port(uint16_t mask, uint16_t values) {
+    // Upper half of BSRR resets, lower half sets; set wins if both are written
+    regs()->BSRR = ((uint32_t)(mask & ~values) << 16) | (mask & values);
+  }
+
+  static uint16_t read_port() { return regs()->IDR; }
+};
+
+template <uint32_t PortBase, unsigned int N> struct Pin {
+  static_assert(N < 16, "GPIO ports have 16 pins");
+  typedef Port<PortBase> port;
+  static constexpr uint16_t mask = 1u << N;
+
+  static void set_mode(unsigned int mode) { port::template configure_group<mask>(mode); }
+  static void write(unsigned int value) { port::write_port(mask, value ? mask : 0); }
+  static int read() { return (port::regs()->IDR >> N) & 1; }
+};
+
+#endif
@@ -0,0 +1,136 @@
+#include "microphone.h"
+#include "envelope.h"
+#include "events.h"
+#include "sound.h"
+#include "mbed.h"
+#include "power.h"
+#include "telemetry.h"
+#include "trace.h"
+
+#if MICROPHONE_ADC
+
+// Microphone analog output on PC_4 (A4 on the Zio header), ADC1 channel 13
+#define MIC_GPIO_PORT GPIOC
+#define MIC_GPIO_PIN GPIO_PIN_4
+#define MIC_ADC_CHANNEL ADC_CHANNEL_13
+
+static void microphone_dma_irq(void); // Half/full transfer interrupt, one per block
+
+static ADC_HandleTypeDef mic_adc;
+static DMA_HandleTypeDef mic_dma;
+static TIM_HandleTypeDef mic_timer;
+
+static uint16_t samples[2 * MICROPHONE_BLOCK_SAMPLES]; // DMA fills one half while the other is measured
+static uint8_t mic_zone; // Event source for EVENT_MIC
+
+void microphone_start(uint8_t zone) {
+  mic_zone = zone;
+  __HAL_RCC_GPIOC_CLK_ENABLE();
+  __HAL_RCC_ADC_CLK_ENABLE();
+  __HAL_RCC_DMA1_CLK_ENABLE();
+  __HAL_RCC_DMAMUX1_CLK_ENABLE();
+  __HAL_RCC_TIM6_CLK_ENABLE();
+  __HAL_RCC_ADC_CONFIG(RCC_ADCCLKSOURCE_SYSCLK);
+
+  GPIO_InitTypeDef gpio = {0};
+  gpio.Pin = MIC_GPIO_PIN;
+  gpio.Mode = GPIO_MODE_ANALOG;
+  gpio.Pull = GPIO_NOPULL;
+  HAL_GPIO_Init(MIC_GPIO_PORT, &gpio);
+
+  // One conversion per TIM6 update event
+  mic_adc.Instance = ADC1;
+  mic_adc.Init.ClockPrescaler = ADC_CLOCK_ASYNC_DIV4;
+  mic_adc.Init.Resolution = ADC_RESOLUTION_12B;
+  mic_adc.Init.DataAlign = ADC_DATAALIGN_RIGHT;
+  mic_adc.Init.ScanConvMode = ADC_SCAN_DISABLE;
+  mic_adc.Init.EOCSelection = ADC_EOC_SINGLE_CONV;
+  mic_adc.Init.LowPowerAutoWait = DISABLE;
+  mic_adc.Init.ContinuousConvMode = DISABLE;
+  mic_adc.Init.NbrOfConversion = 1;
+  mic_adc.Init.DiscontinuousConvMode = DISABLE;
+  mic_adc.Init.ExternalTrigConv = ADC_EXTERNALTRIG_T6_TRGO;
+  mic_adc.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_RISING;
+  mic_adc.Init.DMAContinuousRequests = ENABLE;
+  mic_adc.Init.Overrun = ADC_OVR_DATA_OVERWRITTEN;
+  mic_adc.Init.OversamplingMode = DISABLE;
+  HAL_ADC_Init(&mic_adc);
+
+  ADC_ChannelConfTypeDef channel = {0};
+  channel.Channel = MIC_ADC_CHANNEL;
+  channel.Rank = ADC_REGULAR_RANK_1;
+  channel.SamplingTime = ADC_SAMPLETIME_47CYCLES_5;
+  channel.SingleDiff = ADC_SINGLE_ENDED;
+  channel.OffsetNumber = ADC_OFFSET_NONE;
+  HAL_ADC_ConfigChannel(&mic_adc, &channel);
+  HAL_ADCEx_Calibration_Start(&mic_adc, ADC_SINGLE_ENDED);
+
+  // Circular transfer over both blocks, interrupting at the half and the end
+  mic_dma.Instance = DMA1_Channel1;
+  mic_dma.Init.Request = DMA_REQUEST_ADC1;
+  mic_dma.Init.Direction = DMA_PERIPH_TO_MEMORY;
+  mic_dma.Init.PeriphInc = DMA_PINC_DISABLE;
+  mic_dma.Init.MemInc = DMA_MINC_ENABLE;
+  mic_dma.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+  mic_dma.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+  mic_dma.Init.Mode = DMA_CIRCULAR;
+  mic_dma.Init.Priority = DMA_PRIORITY_MEDIUM;
+  HAL_DMA_Init(&mic_dma);
+  __HAL_LINKDMA(&mic_adc, DMA_Handle, mic_dma);
+
+  NVIC_SetVector(DMA1_Channel1_IRQn, (uintptr_t)&microphone_dma_irq);
+  HAL_NVIC_SetPriority(DMA1_Channel1_IRQn, 2, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel1_IRQn);
+
+  // TIM6 runs from the APB1 timer clock, which is doubled when APB1 is divided
+  uint32_t timer_clock = HAL_RCC_GetPCLK1Freq();
+  if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_HCLK_DIV1) {
+    timer_clock *= 2;
+  }
+  mic_timer.Instance = TIM6;
+  mic_timer.Init.Prescaler = 0;
+  mic_timer.Init.CounterMode = TIM_COUNTERMODE_UP;
+  mic_timer.Init.Period = timer_clock / MICROPHONE_SAMPLE_RATE_HZ - 1;
+  mic_timer.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  HAL_TIM_Base_Init(&mic_timer);
+
+  TIM_MasterConfigTypeDef master = {0};
+  master.MasterOutputTrigger = TIM_TRGO_UPDATE;
+  master.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+  HAL_TIMEx_MasterConfigSynchronization(&mic_timer, &master);
+
+  HAL_ADC_Start_DMA(&mic_adc, (uint32_t *)samples, 2 * MICROPHONE_BLOCK_SAMPLES);
+  HAL_TIM_Base_Start(&mic_timer);
+}
+
+static void microphone_dma_irq(void) {
+  TRACE_BEGIN(TRACE_ISR_MIC_DMA);
+  power_wakeup(WAKE_MICROPHONE);
+  uint32_t flags = DMA1->ISR;
+  const uint16_t *block = NULL;
+
+  if (flags & DMA_ISR_HTIF1) { // First half is complete, DMA moved on to the second
+    DMA1->IFCR = DMA_IFCR_CHTIF1;
+    block = &samples[0];
+  } else if (flags & DMA_ISR_TCIF1) { // Second half is complete, DMA wrapped to the first
+    DMA1->IFCR = DMA_IFCR_CTCIF1;
+    block = &samples[MICROPHONE_BLOCK_SAMPLES];
+  } else {
+    DMA1->IFCR = DMA_IFCR_CGIF1; // Transfer error, nothing to measure
+    TRACE_END(TRACE_ISR_MIC_DMA);
+    return;
+  }
+
+  Envelope envelope = envelope_measure(block, MICROPHONE_BLOCK_SAMPLES);
+  TELEMETRY(TELEMETRY_MIC_LEVEL, mic_zone, envelope.rms); // Every block, before any gating
+  if (envelope_update(envelope) && sound_admit()) {
+    event_post(EVENT_MIC, mic_zone, envelope.rms);
+  }
+  TRACE_END(TRACE_ISR_MIC_DMA);
+}
+
+#else
+
+void microphone_start(uint8_t zone) {} // Digital threshold output is handled by isr_microphone
+
+#endif
@@ -0,0 +1,24 @@
+/*
+ * File Purpose: Continuous ADC sampling of the microphone's analog output
+ *
+ * Subroutines:
+ * void microphone_start(uint8_t zone) - Start timer triggered ADC conversions streamed by DMA into two sample blocks, posting as zone
+ *
+ * TIM6 triggers ADC1 at MICROPHONE_SAMPLE_RATE_HZ and DMA fills a circular buffer. The half and full
+ * transfer interrupts hand each finished block to the envelope kernel, so the CPU is interrupted
+ * once per block instead of once per threshold edge. EVENT_MIC is posted each time the envelope has
+ * stayed loud for ENVELOPE_SUSTAIN_BLOCKS, subject to the sound module's rate limit.
+ */
+#ifndef MICROPHONE_H
+#define MICROPHONE_H
+
+#include <stdint.h>
+
+#define MICROPHONE_ADC 1 // 1 -> analog output on PC_4 sampled by ADC, 0 -> digital threshold output on PD_7
+
+#define MICROPHONE_SAMPLE_RATE_HZ 8000
+#define MICROPHONE_BLOCK_SAMPLES 256 // Samples per block (32ms), at most 256 for the envelope accumulator
+
+void microphone_start(uint8_t zone);
+
+#endif
@@ -0,0 +1,277 @@
+#include "notify.h"
+#include "clock.h"
+#include "mbed.h"
+
+#define FRAME_FLAG 0x7E
+#define FRAME_ESCAPE 0x7D
+#define FRAME_XOR 0x20
+#define BODY_SIZE 9   // sequence (2), type, zone, mode, timestamp
+#define FRAME_MAX (2 + 2 * (BODY_SIZE + 2)) // Flags plus every byte escaped
+#define RX_MAX (BODY_SIZE + 2)
+
+enum EntryState {
+  ENTRY_FREE,
+  ENTRY_QUEUED,   // Waiting for the UART
+  ENTRY_SENDING,  // Frame being written
+  ENTRY_WAITING   // Sent, waiting for the acknowledgement
+};
+
+struct Entry { // Shared between the caller's thread and the UART ISRs, touched inside critical sections
+  uint8_t state;
+  uint16_t sequence;
+  uint8_t type;
+  uint8_t zone;
+  uint8_t mode;
+  uint8_t tries;
+  uint32_t queued_us; // When notify_send accepted it, also the frame timestamp
+  uint32_t sent_us;   // End of the latest transmission
+};
+
+class NotifySerial : public SerialBase { // SerialBase alone exposes the asynchronous write
+public:
+  NotifySerial(PinName tx, PinName rx, int baud) : SerialBase(tx, rx, baud) {}
+  int getc(void) { return _base_getc(); }
+};
+
+static void kick(void); // Start the oldest queued frame if the UART is idle, critical section held
+static void tx_done(int event); // Asynchronous write finished, ISR
+static void rx_byte(void); // Acknowledgement deframer, ISR
+static void retry_check(void); // Requeue or give up on unacknowledged frames, Timeout ISR
+static int is_alarm(uint8_t type); // Trips and escalations are never given up
+static Entry *free_entry(NotifyType type); // Free slot, or for an alarm the oldest status entry evicted
+static void arm_retry(void);
+static uint16_t crc16(const uint8_t *data, int length); // CRC-16/CCITT, init 0xFFFF
+static int put_escaped(uint8_t *frame, int length, uint8_t byte);
+
+static NotifySerial *serial;
+static Entry queue[NOTIFY_QUEUE_SIZE];
+static uint16_t next_sequence = 0;
+static Entry *sending = NULL;
+static uint8_t tx_frame[FRAME_MAX];
+static Timeout retry_timeout;
+static int retry_armed = 0;
+
+static uint8_t rx_frame[RX_MAX];
+static int rx_length = 0;
+static int rx_escape = 0;
+
+static volatile uint32_t sent = 0; // Frames written, retransmissions included
+static volatile uint32_t retries = 0;
+static volatile uint32_t acked = 0;
+static volatile uint32_t failed = 0; // Arm or disarm given up after NOTIFY_TRIES
+static volatile uint32_t dropped = 0; // Queue full, or evicted for an alarm
+static volatile uint32_t bad_frames = 0;
+static uint64_t latency_total_us = 0; // Queued to acknowledged
+static uint32_t latency_max_us = 0;
+
+void notify_start(PinName tx, PinName rx) {
+  serial = new NotifySerial(tx, rx, NOTIFY_BAUD);
+  serial->attach(callback(rx_byte), SerialBase::RxIrq);
+}
+
+int notify_send(NotifyType type, uint8_t zone, uint8_t mode) {
+  core_util_critical_section_enter();
+  Entry *entry = free_entry(type);
+  if (entry) {
+    entry->sequence = next_sequence++;
+    entry->type = type;
+    entry->zone = zone;
+    entry->mode = mode;
+    entry->tries = 0;
+    entry->queued_us = clock_now_us();
+    entry->state = ENTRY_QUEUED;
+    kick();
+  } else {
+    dropped++;
+  }
+  core_util_critical_section_exit();
+  return entry != NULL;
+}
+
+static int is_alarm(uint8_t type) { return type == NOTIFY_TRIP || type == NOTIFY_ESCALATE; }
+
+static Entry *free_entry(NotifyType type) {
+  Entry *oldest_status = NULL;
+  for (int i = 0; i < NOTIFY_QUEUE_SIZE; i++) {
+    Entry &entry = queue[i];
+    if (entry.state == ENTRY_FREE) {
+      return &entry;
+    }
+    if (!is_alarm(entry.type) && entry.state != ENTRY_SENDING &&
+        (!oldest_status || (int16_t)(entry.sequence - oldest_status->sequence) < 0)) {
+      oldest_status = &entry;
+    }
+  }
+  if (!is_alarm(type) || !oldest_status) {
+    return NULL;
+  }
+  dropped++;
+  return oldest_status;
+}
+
+static void kick(void) {
+  if (sending || !serial) {
+    return;
+  }
+  Entry *oldest = NULL;
+  for (int i = 0; i < NOTIFY_QUEUE_SIZE; i++) {
+    Entry &entry = queue[i];
+    if (entry.state == ENTRY_QUEUED &&
+        (!oldest || (int16_t)(entry.sequence - oldest->sequence) < 0)) {
+      oldest = &entry;
+    }
+  }
+  if (!oldest) {
+    return;
+  }
+  uint8_t body[BODY_SIZE + 2];
+  body[0] = (uint8_t)oldest->sequence;
+  body[1] = (uint8_t)(oldest->sequence >> 8);
+  body[2] = oldest->type;
+  body[3] = oldest->zone;
+  body[4] = oldest->mode;
+  for (int i = 0; i < 4; i++) {
+    body[5 + i] = (uint8_t)(oldest->queued_us >> (8 * i));
+  }
+  uint16_t check = crc16(body, BODY_SIZE);
+  body[BODY_SIZE] = (uint8_t)(check >> 8);
+  body[BODY_SIZE + 1] = (uint8_t)check;
+
+  int length = 0;
+  tx_frame[length++] = FRAME_FLAG;
+  for (int i = 0; i < BODY_SIZE + 2; i++) {
+    length = put_escaped(tx_frame, length, body[i]);
+  }
+  tx_frame[length++] = FRAME_FLAG;
+
+  oldest->state = ENTRY_SENDING;
+  sending = oldest;
+  if (serial->write(tx_frame, length, callback(tx_done), SERIAL_EVENT_TX_COMPLETE) != 0) {
+    oldest->state = ENTRY_QUEUED; // UART busy, the retry timer tries again
+    sending = NULL;
+    arm_retry();
+  }
+}
+
+static void tx_done(int event) {
+  core_util_critical_section_enter();
+  if (sending) {
+    if (sending->state == ENTRY_SENDING) { // Not acknowledged while it was still going out
+      sending->state = ENTRY_WAITING;
+      sending->sent_us = clock_now_us();
+      sending->tries += sending->tries < 0xFF; // Alarms are retried for as long as it takes
+    }
+    sending = NULL;
+    sent++;
+  }
+  kick();
+  arm_retry();
+  core_util_critical_section_exit();
+}
+
+static void retry_check(void) {
+  core_util_critical_section_enter();
+  retry_armed = 0;
+  uint32_t now = clock_now_us();
+  for (int i = 0; i < NOTIFY_QUEUE_SIZE; i++) {
+    Entry &entry = queue[i];
+    if (entry.state != ENTRY_WAITING ||
+        now - entry.sent_us < NOTIFY_ACK_TIMEOUT_MS * 1000u) {
+      continue;
+    }
+    if (entry.tries >= NOTIFY_TRIES && !is_alarm(entry.type)) {
+      entry.state = ENTRY_FREE;
+      failed++;
+    } else {
+      entry.state = ENTRY_QUEUED;
+      retries++;
+    }
+  }
+  kick();
+  arm_retry();
+  core_util_critical_section_exit();
+}
+
+static void arm_retry(void) {
+  if (retry_armed) {
+    return;
+  }
+  for (int i = 0; i < NOTIFY_QUEUE_SIZE; i++) {
+    if (queue[i].state == ENTRY_WAITING || queue[i].state == ENTRY_QUEUED) {
+      retry_armed = 1;
+      retry_timeout.attach(&retry_check,
+                         std::chrono::milliseconds(NOTIFY_ACK_TIMEOUT_MS / 2));
+      return;
+    }
+  }
+}
+
+static void rx_byte(void) {
+  while (serial->readable()) {
+    uint8_t byte = (uint8_t)serial->getc();
+    if (byte == FRAME_FLAG) {
+      if (rx_length == RX_MAX &&
+          crc16(rx_frame, BODY_SIZE) == ((rx_frame[BODY_SIZE] << 8) | rx_frame[BODY_SIZE + 1]) &&
+          rx_frame[2] == NOTIFY_ACK) {
+        uint16_t sequence = rx_frame[0] | rx_frame[1] << 8;
+        core_util_critical_section_enter();
+        for (int i = 0; i < NOTIFY_QUEUE_SIZE; i++) {
+          Entry &entry = queue[i];
+          if (entry.state == ENTRY_FREE || !entry.tries || entry.sequence != sequence) {
+            continue; // Only a frame that went out can be acknowledged
+          }
+          // A frame still being written is released by tx_done clearing sending
+          uint32_t latency_us = clock_now_us() - entry.queued_us;
+          latency_total_us += latency_us;
+          latency_max_us = latency_us > latency_max_us ? latency_us : latency_max_us;
+          entry.state = ENTRY_FREE;
+          acked++;
+          break;
+        }
+        core_util_critical_section_exit();
+      } else if (rx_length) {
+        bad_frames++;
+      }
+      rx_length = 0;
+      rx_escape = 0;
+    } else if (byte == FRAME_ESCAPE) {
+      rx_escape = 1;
+    } else if (rx_length < RX_MAX) {
+      rx_frame[rx_length++] = rx_escape ? byte ^ FRAME_XOR : byte;
+      rx_escape = 0;
+    } else {
+      rx_length = RX_MAX + 1; // Too long, discarded at the next flag
+    }
+  }
+}
+
+static uint16_t crc16(const uint8_t *data, int length) {
+  uint16_t crc = 0xFFFF;
+  for (int i = 0; i < length; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+static int put_escaped(uint8_t *frame, int length, uint8_t byte) {
+  if (byte == FRAME_FLAG || byte == FRAME_ESCAPE) {
+    frame[length++] = FRAME_ESCAPE;
+    byte ^= FRAME_XOR;
+  }
+  frame[length++] = byte;
+  return length;
+}
+
+void notify_report(void) {
+  printf("notify: sent=%lu retries=%lu acked=%lu failed=%lu dropped=%lu bad frames=%lu",
+         (unsigned long)sent, (unsigned long)retries, (unsigned long)acked,
+         (unsigned long)failed, (unsigned long)dropped, (unsigned long)bad_frames);
+  if (acked) {
+    printf(" latency avg=%luus max=%luus", (unsigned long)(latency_total_us / acked),
+           (unsigned long)latency_max_us);
+  }
+  printf("\r\n");
+}
@@ -0,0 +1,45 @@
+/*
+ * File Purpose: Framed alarm notifications sent over their own UART without blocking
+ *
+ * Subroutines:
+ * void notify_start(PinName tx, PinName rx) - Open the notification UART and start listening for acknowledgements
+ * int notify_send(NotifyType type, uint8_t zone, uint8_t mode) - Queue a notification, returns 0 if the queue is full
+ * void notify_report(void) - Print delivery counters and acknowledgement latency
+ *
+ * Frame: 0x7E, sequence (2 bytes little endian), type, zone, mode, timestamp (4 bytes little
+ * endian), CRC-16/CCITT of the nine bytes before it (big endian), 0x7E. 0x7E and 0x7D inside a
+ * frame are sent as 0x7D followed by the byte xor 0x20, so the receiver can resynchronise on any
+ * flag. The receiver answers with a frame of type NOTIFY_ACK carrying the sequence. The sequence
+ * takes over a minute of back to back frames to come round, far longer than any acknowledgement
+ * is late, so an acknowledgement never retires a newer frame that reuses its number. The console's
+ * printf output never shares the port, it would land inside frames.
+ *
+ * Notifications wait in a preallocated queue and go out one frame at a time with the UART's
+ * asynchronous write, which is interrupt driven (one byte per transmit register empty IRQ), not
+ * DMA. A frame that isn't acknowledged within NOTIFY_ACK_TIMEOUT_MS is sent again. Trips and
+ * escalations are sent until they are acknowledged; arm and disarm give up after NOTIFY_TRIES and
+ * make room for an alarm when the queue is full.
+ */
+#ifndef NOTIFY_H
+#define NOTIFY_H
+
+#include "mbed.h"
+
+#define NOTIFY_QUEUE_SIZE 8
+#define NOTIFY_ACK_TIMEOUT_MS 500
+#define NOTIFY_TRIES 5 // Sends of an arm or disarm notification before it is given up
+#define NOTIFY_BAUD 115200
+
+enum NotifyType {
+  NOTIFY_ARM = 1,
+  NOTIFY_DISARM,
+  NOTIFY_TRIP,     // zone = zone that tripped
+  NOTIFY_ESCALATE, // Not disarmed in time, authorities alerted
+  NOTIFY_ACK = 0x80
+};
+
+void notify_start(PinName tx, PinName rx);
+int notify_send(NotifyType type, uint8_t zone, uint8_t mode);
+void notify_report(void);
+
+#endif
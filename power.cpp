@@ -0,0 +1,35 @@
+#include "power.h"
+
+volatile uint32_t power_wakeups[WAKE_SOURCE_COUNT];
+
+static const char *wake_names[WAKE_SOURCE_COUNT] = {"keypad edge", "keypad scan", "ultrasonic",
+                                                    "microphone", "timer"};
+static uint32_t reported_wakeups[WAKE_SOURCE_COUNT]; // Counts at the previous report
+static mbed_stats_cpu_t reported_stats;
+
+void power_report(void) {
+#if MBED_CPU_STATS_ENABLED
+  mbed_stats_cpu_t stats;
+  mbed_stats_cpu_get(&stats);
+  uint64_t uptime_us = stats.uptime - reported_stats.uptime;
+  uint64_t idle_us = stats.idle_time - reported_stats.idle_time;
+  uint64_t sleep_us = (stats.sleep_time + stats.deep_sleep_time) -
+                      (reported_stats.sleep_time + reported_stats.deep_sleep_time);
+  reported_stats = stats;
+  if (!uptime_us) {
+    return;
+  }
+  // Tenths of a percent
+  uint32_t busy = (uint32_t)((uptime_us - idle_us) * 1000 / uptime_us);
+  uint32_t sleep = (uint32_t)(sleep_us * 1000 / uptime_us);
+  printf("power: busy=%lu.%lu%% sleep=%lu.%lu%% wakeups/s:", (unsigned long)(busy / 10),
+         (unsigned long)(busy % 10), (unsigned long)(sleep / 10), (unsigned long)(sleep % 10));
+  for (int source = 0; source < WAKE_SOURCE_COUNT; source++) {
+    uint32_t count = power_wakeups[source];
+    uint32_t rate = (uint32_t)((uint64_t)(count - reported_wakeups[source]) * 1000000 / uptime_us);
+    reported_wakeups[source] = count;
+    printf(" %s=%lu", wake_names[source], (unsigned long)rate);
+  }
+  printf("\r\n");
+#endif
+}
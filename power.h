@@ -0,0 +1,39 @@
+/*
+ * File Purpose: Account for CPU busy time, sleep time and which interrupts wake the MCU
+ *
+ * Subroutines:
+ * void power_wakeup(WakeSource source) - Count an interrupt from source, safe from any ISR or thread
+ * void power_report(void) - Print busy and sleep percentages and interrupts per second since the last report
+ *
+ * The idle thread sleeps whenever no thread is ready, so every counted interrupt that arrives
+ * while the firmware is quiet is a wakeup. Busy and sleep time come from the mbed CPU stats,
+ * enabled with platform.cpu-stats-enabled in mbed_app.json.
+ *
+ * The board is never fully quiet. Unarmed, with the display dark and nothing happening, the host
+ * model counts about 41 wakeups a second (host/tests/test_power.cpp). 31 of them are the
+ * microphone's ADC DMA half and full blocks. Most of the rest are ultrasonic pings and the mode
+ * thread's watchdog kick. While the backlight is on, the status line redraw adds 4 a second.
+ */
+#ifndef POWER_H
+#define POWER_H
+
+#include "mbed.h"
+
+enum WakeSource {
+  WAKE_KEYPAD_EDGE, // Column edge while the keypad scan is stopped
+  WAKE_KEYPAD_SCAN, // Scan ticker, only while a key is or was recently down
+  WAKE_ULTRASONIC,  // Ping sequence timeouts and echo edges
+  WAKE_MICROPHONE,  // ADC DMA block or digital output edge
+  WAKE_TIMER,       // Mode thread woke for its timer wheel or the watchdog
+  WAKE_SOURCE_COUNT
+};
+
+extern volatile uint32_t power_wakeups[WAKE_SOURCE_COUNT];
+
+inline void power_wakeup(WakeSource source) {
+  core_util_atomic_incr_u32(&power_wakeups[source], 1);
+}
+
+void power_report(void);
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ * File Purpose: Token bucket for limiting how often an interrupt source may post events
+ *
+ * Subroutines:
+ * int rate_limit_take(RateLimit *limit, uint32_t now_us) - Take a token, returns 0 and counts a suppression if the bucket is empty
+ *
+ * A bucket refills one token every interval_us up to burst. Each bucket must only be used from
+ * one interrupt, so no atomics are needed.
+ */
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include <stdint.h>
+
+struct RateLimit {
+  uint32_t interval_us; // Time to earn one token
+  uint16_t burst;       // Bucket size
+  uint16_t tokens;
+  uint32_t refill_us;   // Start of the interval the next token is earned over
+  volatile uint32_t suppressed; // Posts refused since boot
+};
+
+#define RATE_LIMIT_INIT(per_second, burst) {1000000 / (per_second), (burst), (burst), 0, 0}
+
+inline int rate_limit_take(RateLimit *limit, uint32_t now_us) {
+  if (limit->tokens < limit->burst) {
+    uint32_t earned = (now_us - limit->refill_us) / limit->interval_us;
+    if (earned) {
+      uint32_t tokens = limit->tokens + earned;
+      limit->tokens = tokens < limit->burst ? tokens : limit->burst;
+      limit->refill_us += earned * limit->interval_us;
+    }
+  } else {
+    limit->refill_us = now_us; // Full bucket earns nothing
+  }
+  if (!limit->tokens) {
+    limit->suppressed++;
+    return 0;
+  }
+  limit->tokens--;
+  return 1;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#include "snapshot.h"
+#include "mbed.h"
+
+#define SNAPSHOT_MAGIC 0x5EC0 // Top half of the first register, changes with the layout
+
+static uint32_t snapshot_check(uint32_t state, uint32_t hash); // Mixes both registers
+static void backup_access(void); // Clocks the RTC registers and lifts backup domain write protection
+
+void snapshot_save(const Snapshot &snapshot) {
+  uint32_t state = SNAPSHOT_MAGIC << 16 | (snapshot.alerted & 0xF) << 12 |
+                   (snapshot.sensor & 0xF) << 8 | snapshot.mode;
+  backup_access();
+  RTC->BKP2R = 0; // Invalid until the check is written last
+  RTC->BKP0R = state;
+  RTC->BKP1R = snapshot.passcode_hash;
+  RTC->BKP2R = snapshot_check(state, snapshot.passcode_hash);
+}
+
+int snapshot_load(Snapshot *snapshot) {
+  backup_access();
+  uint32_t state = RTC->BKP0R;
+  uint32_t hash = RTC->BKP1R;
+  if (state >> 16 != SNAPSHOT_MAGIC || RTC->BKP2R != snapshot_check(state, hash)) {
+    return 0;
+  }
+  snapshot->mode = state & 0xFF;
+  snapshot->sensor = (state >> 8) & 0xF;
+  snapshot->alerted = (state >> 12) & 0xF;
+  snapshot->passcode_hash = hash;
+  return 1;
+}
+
+// Unsalted on purpose: with 10^4 four digit codes no hash or salt stops a brute force by anyone
+// who can read BKP1R, and reading it takes code on the chip or the SWD port, either of which can
+// already rewrite the firmware. The hash only keeps the digits out of a casual register dump; an
+// outsider has the keypad, and no choice of hash changes what guessing there costs.
+uint32_t snapshot_hash(const char *passcode, int length) {
+  uint32_t hash = 2166136261u; // FNV-1a
+  for (int i = 0; i < length; i++) {
+    hash = (hash ^ (uint8_t)passcode[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static uint32_t snapshot_check(uint32_t state, uint32_t hash) {
+  uint32_t check = state * 0x9E3779B1u ^ hash;
+  return ~(check ^ check >> 15);
+}
+
+static void backup_access(void) {
+  __HAL_RCC_PWR_CLK_ENABLE();
+  __HAL_RCC_RTCAPB_CLK_ENABLE();
+  HAL_PWR_EnableBkUpAccess();
+}
@@ -0,0 +1,29 @@
+/*
+ * File Purpose: Security state kept in RTC backup registers so a reset comes back armed
+ *
+ * Subroutines:
+ * void snapshot_save(const Snapshot &snapshot) - Write the snapshot, a reset part way through leaves it invalid
+ * int snapshot_load(Snapshot *snapshot) - Read the snapshot, returns 0 if it is missing or fails its check
+ * uint32_t snapshot_hash(const char *passcode, int length) - Hash stored in place of the passcode digits
+ *
+ * The backup registers survive watchdog, software and pin resets but not a loss of power, so a
+ * valid snapshot at boot means the system was already running. Loading is a few register reads
+ * and can run before any thread or the LCD is started.
+ */
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+
+struct Snapshot {
+  uint8_t mode;           // System mode, 0 means nothing worth restoring
+  uint8_t alerted;        // Authorities were already alerted for the current alarm
+  uint8_t sensor;         // Zone that tripped the current alarm
+  uint32_t passcode_hash;
+};
+
+void snapshot_save(const Snapshot &snapshot);
+int snapshot_load(Snapshot *snapshot);
+uint32_t snapshot_hash(const char *passcode, int length);
+
+#endif
@@ -0,0 +1,51 @@
+#include "sound.h"
+#include "clock.h"
+#include "envelope.h"
+#include "events.h"
+#include "microphone.h"
+#include "mbed.h"
+#include "ratelimit.h"
+
+static RateLimit limit = RATE_LIMIT_INIT(SOUND_RATE_PER_S, SOUND_BURST);
+static volatile uint32_t admitted = 0;
+
+static uint32_t recent[SOUND_TRIP_EVENTS]; // Timestamps of the latest events, oldest overwritten first
+static int recent_next = 0;
+static int recent_count = 0;
+static uint32_t trips = 0;
+
+int sound_admit(void) {
+  if (!rate_limit_take(&limit, clock_now_us())) {
+    return 0;
+  }
+  admitted++;
+  return 1;
+}
+
+int sound_event(uint32_t timestamp_us) {
+  recent[recent_next] = timestamp_us;
+  recent_next = (recent_next + 1) % SOUND_TRIP_EVENTS;
+  if (recent_count < SOUND_TRIP_EVENTS) {
+    recent_count++;
+    if (recent_count < SOUND_TRIP_EVENTS) {
+      return 0;
+    }
+  }
+  uint32_t oldest = recent[recent_next]; // Next slot to overwrite holds the oldest
+  if (timestamp_us - oldest > SOUND_WINDOW_MS * 1000u) {
+    return 0;
+  }
+  recent_count = 0; // Start counting afresh for the next trip
+  trips++;
+  return 1;
+}
+
+void sound_report(void) {
+  printf("sound: admitted=%lu suppressed=%lu trips=%lu ring overflow=%lu",
+         (unsigned long)admitted, (unsigned long)limit.suppressed,
+         (unsigned long)trips, (unsigned long)event_lost_count());
+#if MICROPHONE_ADC
+  printf(" floor=%u threshold=%u", envelope_noise_floor(), envelope_threshold());
+#endif
+  printf("\r\n");
+}
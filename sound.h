@@ -0,0 +1,27 @@
+/*
+ * File Purpose: Storm protection and trip confirmation for microphone events
+ *
+ * Subroutines:
+ * int sound_admit(void) - Token bucket check for the microphone ISR, 0 if the event must be dropped
+ * int sound_event(uint32_t timestamp_us) - Count an admitted event on the mode thread, returns 1 once SOUND_TRIP_EVENTS fell within SOUND_WINDOW_MS
+ * void sound_report(void) - Print the admitted, suppressed and trip counters and the noise floor
+ *
+ * However loud or noisy the room, the ISR posts at most SOUND_RATE_PER_S events a second after
+ * a burst of SOUND_BURST, so the mode thread's share of the CPU stays flat. A single event never
+ * trips the alarm on its own.
+ */
+#ifndef SOUND_H
+#define SOUND_H
+
+#include <stdint.h>
+
+#define SOUND_RATE_PER_S 10  // Sustained microphone events the ISR may post
+#define SOUND_BURST 4        // Events it may post back to back
+#define SOUND_TRIP_EVENTS 3  // Events needed within the window for a trip
+#define SOUND_WINDOW_MS 3000
+
+int sound_admit(void);
+int sound_event(uint32_t timestamp_us);
+void sound_report(void);
+
+#endif
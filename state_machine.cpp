@@ -0,0 +1,127 @@
+#include "state_machine.h"
+
+#define T(action, next) {ACTION_##action, STATE_##next}
+
+// Columns: DIGIT, ARM_KEY, OTHER_KEY, CODE_COMPLETE, CODE_MATCH, CODE_MISMATCH, SENSOR_TRIP, IDLE
+static constexpr Transition transitions[STATE_COUNT][INPUT_COUNT] = {
+    // STATE_SET_PASSCODE
+    {T(STORE_DIGIT, SET_PASSCODE), T(NONE, SET_PASSCODE), T(NONE, SET_PASSCODE),
+     T(PASSCODE_SET, UNARMED), T(NONE, SET_PASSCODE), T(NONE, SET_PASSCODE),
+     T(NONE, SET_PASSCODE), T(IDLE, SET_PASSCODE)},
+    // STATE_UNARMED
+    {T(NONE, UNARMED), T(BEGIN_ENTRY, UNARMED_ENTRY), T(NONE, UNARMED),
+     T(NONE, UNARMED), T(NONE, UNARMED), T(NONE, UNARMED),
+     T(NONE, UNARMED), T(IDLE, UNARMED)},
+    // STATE_UNARMED_ENTRY
+    {T(ENTRY_DIGIT, UNARMED_ENTRY), T(NONE, UNARMED_ENTRY), T(NONE, UNARMED_ENTRY),
+     T(NONE, UNARMED_ENTRY), T(ARM, ARMED), T(REJECT_CODE, UNARMED),
+     T(NONE, UNARMED_ENTRY), T(IDLE, UNARMED)},
+    // STATE_ARMED
+    {T(NONE, ARMED), T(BEGIN_ENTRY, ARMED_ENTRY), T(NONE, ARMED),
+     T(NONE, ARMED), T(NONE, ARMED), T(NONE, ARMED),
+     T(TRIGGER, TRIGGERED), T(IDLE, ARMED)},
+    // STATE_ARMED_ENTRY
+    {T(ENTRY_DIGIT, ARMED_ENTRY), T(NONE, ARMED_ENTRY), T(NONE, ARMED_ENTRY),
+     T(NONE, ARMED_ENTRY), T(DISARM, UNARMED), T(REJECT_CODE, ARMED),
+     T(TRIGGER, TRIGGERED), T(IDLE, ARMED)},
+    // STATE_TRIGGERED
+    {T(NONE, TRIGGERED), T(BEGIN_ENTRY, TRIGGERED_ENTRY), T(NONE, TRIGGERED),
+     T(NONE, TRIGGERED), T(NONE, TRIGGERED), T(NONE, TRIGGERED),
+     T(NONE, TRIGGERED), T(IDLE, TRIGGERED)},
+    // STATE_TRIGGERED_ENTRY
+    {T(ENTRY_DIGIT, TRIGGERED_ENTRY), T(NONE, TRIGGERED_ENTRY), T(NONE, TRIGGERED_ENTRY),
+     T(NONE, TRIGGERED_ENTRY), T(DISARM, UNARMED), T(REJECT_CODE, TRIGGERED),
+     T(NONE, TRIGGERED_ENTRY), T(IDLE, TRIGGERED)},
+};
+
+#undef T
+
+// System mode shown to the rest of the firmware for each state
+static constexpr uint8_t state_modes[STATE_COUNT] = {0, 1, 1, 2, 2, 3, 3};
+
+static constexpr bool table_complete() { // Every cell names a real action and state
+  for (int s = 0; s < STATE_COUNT; s++) {
+    for (int i = 0; i < INPUT_COUNT; i++) {
+      if (transitions[s][i].action == ACTION_MISSING ||
+          transitions[s][i].action >= ACTION_COUNT ||
+          transitions[s][i].next >= STATE_COUNT) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static constexpr bool all_states_reachable() { // Flood fill from the power on state
+  bool reached[STATE_COUNT] = {};
+  reached[STATE_SET_PASSCODE] = true;
+  for (int pass = 0; pass < STATE_COUNT; pass++) {
+    for (int s = 0; s < STATE_COUNT; s++) {
+      if (!reached[s]) {
+        continue;
+      }
+      for (int i = 0; i < INPUT_COUNT; i++) {
+        reached[transitions[s][i].next] = true;
+      }
+    }
+  }
+  for (int s = 0; s < STATE_COUNT; s++) {
+    if (!reached[s]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static constexpr bool mode_changes_need_code() { // Only a matching passcode arms, disarms or silences
+  for (int s = 0; s < STATE_COUNT; s++) {
+    for (int i = 0; i < INPUT_COUNT; i++) {
+      const Transition &transition = transitions[s][i];
+      bool guarded = transition.action == ACTION_ARM || transition.action == ACTION_DISARM ||
+                     (state_modes[s] >= 2 && state_modes[transition.next] < 2) ||
+                     (state_modes[s] == 3 && state_modes[transition.next] != 3);
+      if (guarded && i != INPUT_CODE_MATCH) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static_assert(table_complete(), "transition table has a missing or invalid cell");
+static_assert(all_states_reachable(), "transition table has an unreachable state");
+static_assert(mode_changes_need_code(), "transition table leaves armed or triggered without the passcode");
+
+static volatile uint8_t state = STATE_SET_PASSCODE; // Read by ISRs through sm_mode()
+
+SecurityAction sm_dispatch(SecurityInput input, char key) {
+  SecurityAction action = ACTION_NONE;
+  int next_input = input;
+  while (next_input >= 0) { // Actions may hand back a follow-up input, e.g. passcode complete
+    const Transition &transition = transitions[state][next_input];
+    state = transition.next;
+    action = (SecurityAction)transition.action;
+    next_input = sm_run_action(action, key);
+  }
+  return action;
+}
+
+SecurityState sm_state(void) { return (SecurityState)state; }
+
+int sm_mode(void) { return state_modes[state]; }
+
+void sm_restore_mode(int mode) { // First state of each mode is its resting state
+  for (int s = 0; s < STATE_COUNT; s++) {
+    if (state_modes[s] == mode) {
+      state = s;
+      return;
+    }
+  }
+}
+
+SecurityInput sm_key_input(char key) {
+  if (key >= '0' && key <= '9') {
+    return INPUT_DIGIT;
+  }
+  return key == 'A' ? INPUT_ARM_KEY : INPUT_OTHER_KEY;
+}
@@ -0,0 +1,71 @@
+/*
+ * File Purpose: Table driven state machine for the security modes
+ *
+ * Subroutines:
+ * SecurityAction sm_dispatch(SecurityInput input, char key) - Run the transition for input, feeding back any follow-up input the action returns; returns the last action run
+ * SecurityState sm_state(void) - Current state
+ * int sm_mode(void) - Current state as the system mode (0 -> Set Passcode, 1 -> Unarmed, 2 -> Armed, 3 -> Triggered)
+ * SecurityInput sm_key_input(char key) - Classify a keypad character as an input
+ * void sm_restore_mode(int mode) - Jump straight to the resting state of a mode, used when restoring after a reset
+ * int sm_run_action(SecurityAction action, char key) - Implemented by the application, returns a follow-up input or -1
+ *
+ * The transition table is a constexpr array checked at compile time: every state must give
+ * every input an explicit transition, every next state must exist and every state must be
+ * reachable from STATE_SET_PASSCODE.
+ */
+#ifndef STATE_MACHINE_H
+#define STATE_MACHINE_H
+
+#include <stdint.h>
+
+enum SecurityState {
+  STATE_SET_PASSCODE,    // Power on, defining the passcode
+  STATE_UNARMED,
+  STATE_UNARMED_ENTRY,   // Unarmed, passcode being entered to arm
+  STATE_ARMED,
+  STATE_ARMED_ENTRY,     // Armed, passcode being entered to disarm
+  STATE_TRIGGERED,
+  STATE_TRIGGERED_ENTRY, // Triggered, passcode being entered to disarm
+  STATE_COUNT
+};
+
+enum SecurityInput {
+  INPUT_DIGIT,         // 0-9 pressed
+  INPUT_ARM_KEY,       // A pressed
+  INPUT_OTHER_KEY,     // * # B C D pressed
+  INPUT_CODE_COMPLETE, // Fourth digit of a new passcode stored
+  INPUT_CODE_MATCH,    // Fourth digit entered and the passcode matches
+  INPUT_CODE_MISMATCH, // Fourth digit entered and the passcode doesn't match
+  INPUT_SENSOR_TRIP,   // Microphone or ultrasonic sensor tripped
+  INPUT_IDLE,          // No keypad input for the idle period
+  INPUT_COUNT
+};
+
+enum SecurityAction {
+  ACTION_MISSING, // Zero so a cell left out of the table fails the compile time check
+  ACTION_NONE,
+  ACTION_STORE_DIGIT,  // Store a digit of the new passcode
+  ACTION_PASSCODE_SET, // New passcode complete
+  ACTION_BEGIN_ENTRY,  // Start entering the passcode
+  ACTION_ENTRY_DIGIT,  // Store a digit of the entered passcode and compare after the fourth
+  ACTION_ARM,
+  ACTION_DISARM,
+  ACTION_REJECT_CODE,  // Show the incorrect passcode banner
+  ACTION_TRIGGER,      // Sound the alarm
+  ACTION_IDLE,         // Blank the display and drop any partial entry
+  ACTION_COUNT
+};
+
+struct Transition {
+  uint8_t action; // SecurityAction
+  uint8_t next;   // SecurityState
+};
+
+SecurityAction sm_dispatch(SecurityInput input, char key = 0);
+SecurityState sm_state(void);
+int sm_mode(void);
+SecurityInput sm_key_input(char key);
+void sm_restore_mode(int mode);
+int sm_run_action(SecurityAction action, char key);
+
+#endif
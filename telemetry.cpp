@@ -0,0 +1,161 @@
+#include "telemetry.h"
+#include "clock.h"
+#include <string.h>
+
+#define PACKET_SYNC_0 0xA5
+#define PACKET_SYNC_1 0x5A
+#define HEADER_SIZE 8
+#define SAMPLE_MAX 11 // Tag plus two five byte varints
+#define CHANNELS 16
+
+struct Packet {
+  uint8_t bytes[HEADER_SIZE + TELEMETRY_PAYLOAD_MAX];
+};
+
+class TelemetrySerial : public SerialBase { // SerialBase alone exposes the asynchronous write
+public:
+  TelemetrySerial(PinName tx, int baud) : SerialBase(tx, NC, baud) {}
+};
+
+static void seal(void); // Hand the filling packet to the UART, critical section held
+static void flush_quiet(void); // Timeout callback, the stream went quiet with a packet part filled
+static void tx_done(int event); // Asynchronous write finished, ISR
+static int put_varint(uint8_t *bytes, int length, uint32_t value);
+
+static TelemetrySerial *serial;
+static Packet packets[2];
+static int filling = 0;       // Packet the samples go into
+static volatile int sending = 0; // The other packet is still on the wire
+static int length = 0;        // Sample bytes in the filling packet
+static uint32_t first_us;     // Timestamp of the first sample in the filling packet
+static uint32_t last_us;      // Timestamp of the previous sample in the filling packet
+static Timeout quiet_timeout; // Armed only while a packet is part filled
+static uint32_t last_value[TELEMETRY_SOURCE_COUNT][CHANNELS];
+static uint8_t sequence = 0;
+
+static volatile uint32_t samples = 0;
+static volatile uint32_t lost = 0; // Both packets busy
+static volatile uint32_t packets_sent = 0;
+static volatile uint32_t bytes_sent = 0;
+static uint64_t encode_cycles = 0; // Spent in telemetry_sample, critical section included
+static uint32_t encode_max_cycles = 0;
+static uint64_t reported_cycles = 0; // encode_cycles at the previous report
+static uint32_t reported_us = 0;
+
+void telemetry_start(PinName tx) {
+  serial = new TelemetrySerial(tx, TELEMETRY_BAUD);
+  reported_us = clock_now_us();
+}
+
+void telemetry_sample(TelemetrySource source, uint8_t channel, uint32_t value) {
+  if (!serial) {
+    return;
+  }
+  uint32_t start = DWT->CYCCNT;
+  core_util_critical_section_enter();
+  uint32_t now = clock_now_us();
+  if (length > TELEMETRY_PAYLOAD_MAX - SAMPLE_MAX || (length && now - first_us >= TELEMETRY_FLUSH_MS * 1000)) {
+    seal();
+  }
+  if (length > TELEMETRY_PAYLOAD_MAX - SAMPLE_MAX) { // Other packet still sending
+    lost++;
+  } else {
+    uint8_t *bytes = packets[filling].bytes + HEADER_SIZE;
+    channel &= CHANNELS - 1;
+    if (length == 0) {
+      memset(last_value, 0, sizeof(last_value));
+      first_us = now;
+      last_us = now;
+      quiet_timeout.attach(&flush_quiet, std::chrono::milliseconds(2 * TELEMETRY_FLUSH_MS));
+      for (int i = 0; i < 4; i++) {
+        packets[filling].bytes[4 + i] = (uint8_t)(now >> (8 * i));
+      }
+    }
+    int32_t delta = (int32_t)(value - last_value[source][channel]);
+    last_value[source][channel] = value;
+    bytes[length++] = (uint8_t)(source << 4 | channel);
+    length = put_varint(bytes, length, now - last_us);
+    length = put_varint(bytes, length, ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+    last_us = now;
+    samples++;
+  }
+  uint32_t cycles = DWT->CYCCNT - start;
+  encode_cycles += cycles;
+  encode_max_cycles = cycles > encode_max_cycles ? cycles : encode_max_cycles;
+  core_util_critical_section_exit();
+}
+
+void telemetry_flush(void) {
+  core_util_critical_section_enter();
+  if (length) {
+    seal();
+  }
+  core_util_critical_section_exit();
+}
+
+static void flush_quiet(void) {
+  core_util_critical_section_enter();
+  if (length) {
+    seal();
+  }
+  if (length) { // Other packet still sending, try again
+    quiet_timeout.attach(&flush_quiet, std::chrono::milliseconds(TELEMETRY_FLUSH_MS));
+  }
+  core_util_critical_section_exit();
+}
+
+static void seal(void) {
+  if (sending) {
+    return;
+  }
+  uint8_t *bytes = packets[filling].bytes;
+  bytes[0] = PACKET_SYNC_0;
+  bytes[1] = PACKET_SYNC_1;
+  bytes[2] = sequence++;
+  bytes[3] = (uint8_t)length;
+  int total = HEADER_SIZE + length;
+  sending = 1;
+  if (serial->write(bytes, total, callback(tx_done), SERIAL_EVENT_TX_COMPLETE) != 0) {
+    sending = 0; // UART busy, the packet's samples are dropped
+    lost++;
+  } else {
+    packets_sent++;
+    bytes_sent += total;
+  }
+  quiet_timeout.detach();
+  filling ^= 1;
+  length = 0;
+}
+
+static void tx_done(int event) { sending = 0; }
+
+static int put_varint(uint8_t *bytes, int length, uint32_t value) {
+  while (value >= 0x80) {
+    bytes[length++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  bytes[length++] = (uint8_t)value;
+  return length;
+}
+
+void telemetry_report(void) {
+  core_util_critical_section_enter();
+  uint64_t total = encode_cycles;
+  uint64_t cycles = total - reported_cycles;
+  reported_cycles = total;
+  core_util_critical_section_exit();
+  uint32_t now = clock_now_us();
+  uint32_t elapsed_us = now - reported_us;
+  reported_us = now;
+  // Share of the CPU spent encoding since the last report, in hundredths of a percent
+  uint32_t load = elapsed_us ? (uint32_t)(cycles * 10000 / ((uint64_t)elapsed_us * (SystemCoreClock / 1000000))) : 0;
+  printf("telemetry: samples=%lu lost=%lu packets=%lu bytes=%lu",
+         (unsigned long)samples, (unsigned long)lost, (unsigned long)packets_sent,
+         (unsigned long)bytes_sent);
+  if (samples) {
+    printf(" encode avg=%lu max=%lu cycles load=%lu.%02lu%%",
+           (unsigned long)(total / samples), (unsigned long)encode_max_cycles,
+           (unsigned long)(load / 100), (unsigned long)(load % 100));
+  }
+  printf("\r\n");
+}
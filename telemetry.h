@@ -0,0 +1,53 @@
+/*
+ * File Purpose: Stream timestamped raw sensor samples over a spare UART in compact binary packets
+ *
+ * Subroutines:
+ * void telemetry_start(PinName tx) - Open the telemetry UART, transmit only
+ * void telemetry_sample(TelemetrySource source, uint8_t channel, uint32_t value) - Encode a sample, safe from any ISR or thread
+ * void telemetry_flush(void) - Send the partly filled packet now
+ * void telemetry_report(void) - Print packet counters and the cycles spent encoding
+ *
+ * Packet: 0xA5 0x5A, sequence, length of the sample bytes, timestamp of the first sample in
+ * microseconds (4 bytes little endian), then the samples. Each sample is a tag byte
+ * (source << 4 | channel), the microseconds since the previous sample and the zigzag difference
+ * from the previous value of the same tag, both as 7 bit varints. Differences start from 0 in
+ * every packet so a packet lost on the wire doesn't corrupt the next one.
+ *
+ * Samples are encoded straight into one of two packet buffers and the full buffer is handed to
+ * the UART's asynchronous write as it is, while the other buffer fills. If both are busy the
+ * sample is counted as lost. With TELEMETRY_ENABLED 0 the TELEMETRY macro compiles to nothing.
+ *
+ * A packet also goes out with the first sample that arrives TELEMETRY_FLUSH_MS after its first,
+ * so a steady stream flushes itself without a timer. Only a stream that goes quiet with a packet
+ * part filled needs a Timeout to send it, after twice that. An empty stream wakes nothing.
+ */
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "mbed.h"
+
+#define TELEMETRY_ENABLED 1
+#define TELEMETRY_PAYLOAD_MAX 240 // Sample bytes per packet, must fit the length byte
+#define TELEMETRY_FLUSH_MS 250
+#define TELEMETRY_BAUD 460800
+
+enum TelemetrySource {
+  TELEMETRY_ECHO,      // channel = zone, value = echo width in us
+  TELEMETRY_MIC_LEVEL, // channel = zone, value = block RMS
+  TELEMETRY_MIC_EDGE,  // channel = zone, value = 1 admitted, 0 rate limited
+  TELEMETRY_KEY,       // channel = key index, value = 1 down, 0 up
+  TELEMETRY_SOURCE_COUNT
+};
+
+void telemetry_start(PinName tx);
+void telemetry_sample(TelemetrySource source, uint8_t channel, uint32_t value);
+void telemetry_flush(void);
+void telemetry_report(void);
+
+#if TELEMETRY_ENABLED
+#define TELEMETRY(source, channel, value) telemetry_sample(source, channel, value)
+#else
+#define TELEMETRY(source, channel, value)
+#endif
+
+#endif
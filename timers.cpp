@@ -0,0 +1,110 @@
+#include "timers.h"
+#include "clock.h"
+#include "mbed.h"
+
+#define TICK_US (TIMER_TICK_MS * 1000)
+#define SLOT_MASK (TIMER_SLOTS - 1)
+#define LEVEL_SHIFT 6 // log2(TIMER_SLOTS)
+
+static WheelTimer *wheel[2][TIMER_SLOTS]; // List head per slot
+static uint64_t occupied[2]; // Bit per slot with at least one timer
+static uint32_t now_tick = 0; // Last tick processed
+static uint32_t tick_start_us = 0; // clock_now_us() at the start of now_tick
+
+static void insert(WheelTimer *timer) {
+  uint32_t group = timer->expires >> LEVEL_SHIFT;
+  uint32_t now_group = now_tick >> LEVEL_SHIFT;
+  int level, slot;
+  if (timer->expires - now_tick < TIMER_SLOTS) {
+    level = 0;
+    slot = timer->expires & SLOT_MASK;
+  } else if (group - now_group < TIMER_SLOTS) {
+    level = 1;
+    slot = group & SLOT_MASK;
+  } else { // Beyond the wheel, park in the furthest slot and re-insert when it cascades
+    level = 1;
+    slot = (now_group + TIMER_SLOTS - 1) & SLOT_MASK;
+  }
+
+  WheelTimer **head = &wheel[level][slot];
+  timer->level = level;
+  timer->slot = slot;
+  timer->next = *head;
+  if (timer->next) {
+    timer->next->pprev = &timer->next;
+  }
+  timer->pprev = head;
+  *head = timer;
+  occupied[level] |= 1ull << slot;
+}
+
+static void unlink(WheelTimer *timer) {
+  *timer->pprev = timer->next;
+  if (timer->next) {
+    timer->next->pprev = timer->pprev;
+  }
+  if (!wheel[timer->level][timer->slot]) {
+    occupied[timer->level] &= ~(1ull << timer->slot);
+  }
+  timer->pprev = NULL;
+}
+
+void timer_init(void) {
+  tick_start_us = clock_now_us();
+}
+
+void timer_start(WheelTimer *timer, uint32_t delay_ms, void (*callback)(void)) {
+  timer_cancel(timer);
+  uint32_t ticks = (delay_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+  uint32_t elapsed = (clock_now_us() - tick_start_us) / TICK_US; // Ticks not yet processed
+  timer->expires = now_tick + elapsed + (ticks ? ticks : 1); // Never the tick being processed
+  timer->callback = callback;
+  insert(timer);
+}
+
+void timer_cancel(WheelTimer *timer) {
+  if (timer->pprev) {
+    unlink(timer);
+  }
+}
+
+int timer_active(const WheelTimer *timer) { return timer->pprev != NULL; }
+
+uint32_t timer_advance(void) {
+  uint32_t now_us = clock_now_us();
+  while (now_us - tick_start_us >= TICK_US) {
+    tick_start_us += TICK_US;
+    now_tick++;
+
+    if ((now_tick & SLOT_MASK) == 0) { // Entering a new group, spread its timers over level 0
+      int slot = (now_tick >> LEVEL_SHIFT) & SLOT_MASK;
+      while (WheelTimer *timer = wheel[1][slot]) {
+        unlink(timer);
+        insert(timer);
+      }
+    }
+
+    int slot = now_tick & SLOT_MASK;
+    while (WheelTimer *timer = wheel[0][slot]) { // Callbacks may start or cancel any timer
+      unlink(timer);
+      timer->callback();
+    }
+  }
+
+  // Earliest tick with work: the next occupied level 0 slot or the next cascade
+  uint32_t ticks = 0;
+  if (occupied[0]) {
+    int from = (now_tick + 1) & SLOT_MASK;
+    uint64_t rotated = (occupied[0] >> from) | (from ? occupied[0] << (TIMER_SLOTS - from) : 0);
+    ticks = __builtin_ctzll(rotated) + 1;
+  }
+  if (occupied[1]) {
+    uint32_t cascade = TIMER_SLOTS - (now_tick & SLOT_MASK);
+    ticks = ticks && ticks < cascade ? ticks : cascade;
+  }
+  if (!ticks) {
+    return osWaitForever;
+  }
+  uint32_t into_tick = now_us - tick_start_us;
+  return (ticks * TICK_US - into_tick + 999) / 1000;
+}
@@ -0,0 +1,40 @@
+/*
+ * File Purpose: Hierarchical timer wheel for the mode thread's timed behaviour
+ *
+ * Subroutines:
+ * void timer_init(void) - Start the wheel at the current time
+ * void timer_start(WheelTimer *timer, uint32_t delay_ms, void (*callback)(void)) - Run callback after delay_ms, restarting the timer if it is already running
+ * void timer_cancel(WheelTimer *timer) - Stop the timer if it is running
+ * int timer_active(const WheelTimer *timer) - 1 while the timer is waiting to expire
+ * uint32_t timer_advance(void) - Run every callback that is due, returns ms until the next expiry or osWaitForever
+ *
+ * Two levels of 64 slots: the first holds timers due within 64 ticks, the second holds one slot
+ * per 64 ticks and is cascaded into the first as time reaches it. Timers are intrusive list nodes,
+ * so start and cancel are O(1) and any number can run at once. Time comes from clock_now_us(),
+ * there is no tick interrupt; the mode thread calls timer_advance() and sleeps for the time it
+ * returns. Only the mode thread may touch timers.
+ */
+#ifndef TIMERS_H
+#define TIMERS_H
+
+#include <stdint.h>
+
+#define TIMER_TICK_MS 10 // Wheel resolution
+#define TIMER_SLOTS 64   // Slots per level, must be 64 to match the occupancy bitmaps
+
+struct WheelTimer {
+  WheelTimer *next;
+  WheelTimer **pprev; // Link that points at this timer, NULL when not running
+  uint32_t expires;   // Tick the timer is due on
+  uint8_t level;      // Wheel level and slot holding the timer
+  uint8_t slot;
+  void (*callback)(void);
+};
+
+void timer_init(void);
+void timer_start(WheelTimer *timer, uint32_t delay_ms, void (*callback)(void));
+void timer_cancel(WheelTimer *timer);
+int timer_active(const WheelTimer *timer);
+uint32_t timer_advance(void);
+
+#endif
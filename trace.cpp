@@ -0,0 +1,55 @@
+#include "trace.h"
+#include <cstring>
+
+MBED_STATIC_ASSERT(sizeof(TraceDumpHeader) == 16 && sizeof(TraceRecord) == 8,
+                   "the decoder reads the dump as packed little endian fields");
+MBED_STATIC_ASSERT(TRACE_RING_SIZE <= 0xFFFF, "dump header counts records in 16 bits");
+
+TraceRecord trace_ring[TRACE_RING_SIZE];
+volatile uint32_t trace_next = 0;
+
+static const char *trace_names[TRACE_ID_COUNT] = {
+    "isr_keypad_scan",  "isr_microphone",        "isr_mic_dma",
+    "isr_ultrasonic",   "isr_ultrasonic_falling_edge",
+    "isr_trigger",      "handle_event",
+    "latency_report",   "lcd_transmit"};
+
+static TraceRecord snapshot[TRACE_RING_SIZE]; // Copy taken before printing so ISRs can keep tracing
+
+void trace_init(void) {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; // Power the DWT unit
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static uint32_t dump_write(const void *data, uint32_t length, uint32_t sum) {
+  fwrite(data, 1, length, stdout);
+  const uint8_t *bytes = (const uint8_t *)data;
+  for (uint32_t i = 0; i < length; i++) {
+    sum += bytes[i];
+  }
+  return sum;
+}
+
+void trace_dump(void) {
+  uint32_t end = core_util_atomic_load_u32(&trace_next);
+  uint32_t count = end < TRACE_RING_SIZE ? end : TRACE_RING_SIZE;
+  for (uint32_t i = 0; i < count; i++) { // Oldest record first
+    snapshot[i] = trace_ring[(end - count + i) & (TRACE_RING_SIZE - 1)];
+  }
+
+  TraceDumpHeader header;
+  memcpy(header.magic, TRACE_DUMP_MAGIC, sizeof(header.magic));
+  header.core_hz = SystemCoreClock;
+  header.written = end;
+  header.count = count;
+  header.id_count = TRACE_ID_COUNT;
+  header.end_flag = TRACE_END_FLAG;
+  uint32_t sum = dump_write(&header, sizeof(header), 0);
+  sum = dump_write(snapshot, count * sizeof(TraceRecord), sum);
+  for (int id = 0; id < TRACE_ID_COUNT; id++) {
+    sum = dump_write(trace_names[id], strlen(trace_names[id]) + 1, sum);
+  }
+  fwrite(&sum, sizeof(sum), 1, stdout);
+  fflush(stdout);
+}
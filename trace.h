@@ -0,0 +1,78 @@
+/*
+ * File Purpose: Cycle counter tracepoints recorded into a RAM ring and dumped over the serial console
+ *
+ * Subroutines:
+ * void trace_init(void) - Enable the DWT cycle counter
+ * void trace_point(uint32_t id) - Record the cycle count and id, safe from any ISR or thread
+ * void trace_dump(void) - Write the ring to the serial console as one binary frame
+ *
+ * TRACE_BEGIN/TRACE_END mark the two ends of a handler so the decoder can pair them into
+ * durations. A tracepoint is one atomic increment and two stores; with TRACE_ENABLED 0
+ * the macros compile to nothing.
+ *
+ * The dump is a TraceDumpHeader, the records oldest first, the id names as NUL terminated
+ * strings and a byte sum of everything before it, all little endian. That is 8 bytes a record
+ * instead of a text line, and the board does no pairing or statistics. host/tools/trace_decode
+ * finds the frames in a capture of the console and prints the timeline and per-handler
+ * durations. The console must not convert newlines, see mbed_app.json.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "mbed.h"
+
+#define TRACE_ENABLED 1
+#define TRACE_RING_SIZE 256 // Must be a power of two
+#define TRACE_END_FLAG 0x80 // Set in the id of the record that closes a handler
+
+enum TraceId {
+  TRACE_ISR_KEYPAD_SCAN,
+  TRACE_ISR_MICROPHONE,
+  TRACE_ISR_MIC_DMA,
+  TRACE_ISR_ULTRASONIC,
+  TRACE_ISR_ULTRASONIC_FALLING_EDGE,
+  TRACE_ISR_ULTRASONIC_TRIGGER,
+  TRACE_HANDLE_EVENT,
+  TRACE_LATENCY_REPORT,
+  TRACE_LCD_TRANSMIT,
+  TRACE_ID_COUNT
+};
+
+#define TRACE_DUMP_MAGIC "TRC1"
+
+struct TraceDumpHeader {
+  char magic[4];     // TRACE_DUMP_MAGIC
+  uint32_t core_hz;  // Cycle counter rate
+  uint32_t written;  // Records written since boot, the ones before the ring's were overwritten
+  uint16_t count;    // Records that follow
+  uint8_t id_count;  // Names that follow the records
+  uint8_t end_flag;  // TRACE_END_FLAG
+};
+
+struct TraceRecord {
+  uint32_t cycles; // DWT->CYCCNT when recorded
+  uint32_t id;     // TraceId, with TRACE_END_FLAG on handler exit
+};
+
+extern TraceRecord trace_ring[TRACE_RING_SIZE];
+extern volatile uint32_t trace_next; // Total records written, ring index is this modulo the size
+
+void trace_init(void);
+void trace_dump(void);
+
+inline void trace_point(uint32_t id) {
+  TraceRecord &record =
+      trace_ring[(core_util_atomic_incr_u32(&trace_next, 1) - 1) & (TRACE_RING_SIZE - 1)];
+  record.cycles = DWT->CYCCNT;
+  record.id = id;
+}
+
+#if TRACE_ENABLED
+#define TRACE_BEGIN(id) trace_point(id)
+#define TRACE_END(id) trace_point((id) | TRACE_END_FLAG)
+#else
+#define TRACE_BEGIN(id)
+#define TRACE_END(id)
+#endif
+
+#endif
@@ -0,0 +1,85 @@
+#include "ultrasonic.h"
+
+uint16_t ultrasonic_pulse_to_mm(uint32_t width_us) {
+  // Sound travels 343 m/s and the pulse covers the distance there and back,
+  // so mm = us * 0.343 / 2, rounded
+  uint32_t mm = (width_us * 343 + 1000) / 2000;
+  if (mm < ULTRASONIC_MIN_MM) {
+    return 0;
+  }
+  if (mm > ULTRASONIC_MAX_MM) {
+    return ULTRASONIC_NO_ECHO;
+  }
+  return mm;
+}
+
+void ultrasonic_filter_init(UltrasonicFilter *filter, uint16_t trip_mm) {
+  filter->count = 0;
+  filter->next = 0;
+  filter->distance_mm = ULTRASONIC_NO_ECHO;
+  filter->trip_mm = trip_mm;
+}
+
+int ultrasonic_add_pulse(UltrasonicFilter *filter, uint32_t width_us) {
+  uint16_t mm = ultrasonic_pulse_to_mm(width_us);
+  if (mm == 0) { // Shorter than any real echo, leave the window as is
+    return 0;
+  }
+
+  const uint16_t *window = filter->window;
+  filter->window[filter->next] = mm;
+  filter->next = (filter->next + 1) % ULTRASONIC_FILTER_SIZE;
+  if (filter->count < ULTRASONIC_FILTER_SIZE && ++filter->count < ULTRASONIC_FILTER_SIZE) {
+    return 0; // Not enough readings for a median yet
+  }
+
+  uint16_t sorted[ULTRASONIC_FILTER_SIZE]; // Insertion sort, the window is tiny
+  for (int i = 0; i < ULTRASONIC_FILTER_SIZE; i++) {
+    int j = i;
+    while (j > 0 && sorted[j - 1] > window[i]) {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = window[i];
+  }
+  filter->distance_mm = sorted[ULTRASONIC_FILTER_SIZE / 2];
+  return filter->distance_mm <= filter->trip_mm;
+}
+
+// Nothing in range is a steady reading too, model it as just past the farthest echo
+static int32_t scene_mm(uint16_t mm) {
+  return mm == ULTRASONIC_NO_ECHO ? ULTRASONIC_MAX_MM + 1 : mm;
+}
+
+void background_init(Background *background) {
+  background->mean_mm = 0;
+  background->samples = 0;
+  background->variance = 0;
+}
+
+void background_learn(Background *background, uint16_t mm) {
+  int32_t distance = scene_mm(mm);
+  if (background->samples == 0) {
+    background->mean_mm = distance;
+    background->samples = 1;
+    return;
+  }
+  int32_t diff = distance - background->mean_mm;
+  background->mean_mm += diff / (1 << BACKGROUND_SHIFT);
+  int32_t variance = background->variance;
+  variance += (diff * diff - variance) / (1 << BACKGROUND_SHIFT);
+  background->variance = variance;
+  if (background->samples < BACKGROUND_WARMUP) {
+    background->samples++;
+  }
+}
+
+int background_deviates(const Background *background, uint16_t mm) {
+  if (background->samples < BACKGROUND_WARMUP) {
+    return 0; // Not enough of the scene seen to judge
+  }
+  int32_t diff = scene_mm(mm) - background->mean_mm;
+  uint32_t square = diff * diff;
+  return square > (uint32_t)BACKGROUND_MIN_MM * BACKGROUND_MIN_MM &&
+         square > BACKGROUND_SIGMAS * BACKGROUND_SIGMAS * background->variance;
+}
@@ -0,0 +1,58 @@
+/*
+ * File Purpose: Converts HC-SR04 echo pulse widths to distances and filters them
+ *
+ * Subroutines:
+ * uint16_t ultrasonic_pulse_to_mm(uint32_t width_us) - Distance for an echo pulse width, 0 if too short, ULTRASONIC_NO_ECHO if too long
+ * void ultrasonic_filter_init(UltrasonicFilter *filter, uint16_t trip_mm) - Empty the window and set the trip distance
+ * int ultrasonic_add_pulse(UltrasonicFilter *filter, uint32_t width_us) - Filter a new pulse width, returns 1 if the filtered distance is within trip range
+ * void background_init(Background *background) - Forget the learned scene
+ * void background_learn(Background *background, uint16_t mm) - Fold a filtered distance into the scene model
+ * int background_deviates(const Background *background, uint16_t mm) - 1 if a filtered distance doesn't fit the learned scene
+ *
+ * Readings go through a median of the last ULTRASONIC_FILTER_SIZE valid distances so a
+ * single spurious echo can't trip the alarm. Pulses shorter than the sensor's minimum range are
+ * dropped as noise, longer ones count as nothing in range.
+ *
+ * The background model keeps an exponentially weighted mean and variance of the filtered distance
+ * while the system is disarmed, so furniture in range becomes part of the scene. Once armed a
+ * reading deviates if it is more than BACKGROUND_SIGMAS deviations and BACKGROUND_MIN_MM away
+ * from the mean. Both steps are a few integer operations and the model is 8 bytes per sensor.
+ */
+#ifndef ULTRASONIC_H
+#define ULTRASONIC_H
+
+#include <stdint.h>
+
+#define ULTRASONIC_TRIP_MM 150     // Default trip distance, about where the old 888us check tripped
+#define ULTRASONIC_MIN_MM 20       // HC-SR04 can't measure closer than this
+#define ULTRASONIC_MAX_MM 4000     // or farther than this
+#define ULTRASONIC_FILTER_SIZE 3   // Readings in the median window, must be odd
+#define ULTRASONIC_NO_ECHO 0xFFFF  // Distance reported when nothing is in range
+
+#define BACKGROUND_SHIFT 4         // Weight of a new reading is 1 / 2^shift
+#define BACKGROUND_WARMUP 16       // Readings before the model is trusted
+#define BACKGROUND_SIGMAS 4        // Deviations from the mean that count as a change
+#define BACKGROUND_MIN_MM 100      // Smallest change that counts, covers a perfectly still scene
+
+struct UltrasonicFilter { // One per sensor
+  uint16_t window[ULTRASONIC_FILTER_SIZE]; // Last valid distances, oldest overwritten first
+  uint8_t count;        // Valid entries in window
+  uint8_t next;         // Entry the next reading replaces
+  uint16_t distance_mm; // Latest median
+  uint16_t trip_mm;
+};
+
+struct Background { // One per sensor
+  uint16_t mean_mm;
+  uint16_t samples;  // Readings learned, saturates at BACKGROUND_WARMUP
+  uint32_t variance; // mm^2
+};
+
+uint16_t ultrasonic_pulse_to_mm(uint32_t width_us);
+void ultrasonic_filter_init(UltrasonicFilter *filter, uint16_t trip_mm);
+int ultrasonic_add_pulse(UltrasonicFilter *filter, uint32_t width_us);
+void background_init(Background *background);
+void background_learn(Background *background, uint16_t mm);
+int background_deviates(const Background *background, uint16_t mm);
+
+#endif
@@ -0,0 +1,254 @@
+#include "zones.h"
+#include "clock.h"
+#include "events.h"
+#include "power.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "ultrasonic.h"
+#include <math.h>
+
+struct ZoneState {
+  InterruptIn *echo;
+  DigitalOut *trigger;
+  uint32_t rise_us;   // Echo rising edge of the ping in flight
+  uint32_t ping_us;   // When the zone was last pinged, 0 before the first ping
+  uint8_t waiting;    // Pinged and the echo hasn't ended yet
+  UltrasonicFilter filter;
+  Background background;
+  volatile uint8_t level;     // Latest activity level, read by the render thread
+  volatile uint32_t level_us; // When level was set
+};
+
+struct ModeStats { // Written from the ping ISR, except time_us which the owner's thread updates
+  uint32_t pings;
+  uint32_t refreshes;  // Intervals measured between two pings of one zone
+  uint64_t refresh_total_us;
+  uint32_t refresh_max_us;
+  uint64_t time_us;    // Time spent in the mode before the current stay
+};
+
+static void start_turn(void); // Raise every trigger in the current group, Timeout ISR
+static void end_trigger(void); // Drop the triggers after ZONE_TRIGGER_US, Timeout ISR
+static void turn_timeout(void); // Some echo never ended, move on, Timeout ISR
+static void schedule_next(uint32_t delay_us); // Advance the group and arm the next turn
+static void echo_rise(ZoneState *zone); // Echo ISRs, bound to each zone
+static void echo_fall(ZoneState *zone);
+
+static const ZoneConfig *configs;
+static int count = 0;
+static ZoneState zones[ZONE_MAX];
+
+static uint8_t group_count = 0; // Ping groups in use, numbered from 0
+static uint8_t current_group = 0;
+static volatile uint32_t outstanding = 0; // Echoes still expected from the current group
+static volatile uint8_t listening = 0; // Triggers are down and the group's echoes count
+static Timeout ping_timeout; // Next step of the ping sequence
+
+static volatile uint32_t round_gap_us = 0; // Pause before each round outside a burst
+static volatile uint32_t burst_until_us = 0; // Rounds run back to back until this time
+static volatile uint8_t current_mode = 0;
+static int learning = 1; // Scene models learn instead of judging, owner's thread only
+static uint32_t mode_since_us = 0;
+static ModeStats mode_stats[ZONE_MODES];
+
+void zones_start(const ZoneConfig *zone_configs, int zone_total) {
+  configs = zone_configs;
+  count = zone_total < ZONE_MAX ? zone_total : ZONE_MAX;
+  for (int i = 0; i < count; i++) {
+    const ZoneConfig &config = configs[i];
+    if (config.type != ZONE_ULTRASONIC) {
+      continue;
+    }
+    ultrasonic_filter_init(&zones[i].filter, config.trip_mm);
+    background_init(&zones[i].background);
+    zones[i].trigger = new DigitalOut(config.trigger, 0);
+    zones[i].echo = new InterruptIn(config.echo, PullDown);
+    zones[i].echo->rise(callback(&echo_rise, &zones[i]));
+    zones[i].echo->fall(callback(&echo_fall, &zones[i]));
+    if (config.ping_group >= group_count) {
+      group_count = config.ping_group + 1;
+    }
+  }
+  mode_since_us = clock_now_us();
+  if (group_count) {
+    ping_timeout.attach(&start_turn, std::chrono::microseconds(ZONE_PING_GUARD_US));
+  }
+}
+
+int zone_count(void) { return count; }
+
+const char *zone_name(int zone) { return zone < count ? configs[zone].name : ""; }
+
+int zone_armed(int zone, int mode) {
+  return zone < count && (configs[zone].arm_mask >> mode) & 1;
+}
+
+int zone_type(int zone) { return zone < count ? configs[zone].type : -1; }
+
+int zone_level(int zone) {
+  if (zone >= count || clock_now_us() - zones[zone].level_us > ZONE_LEVEL_HOLD_MS * 1000u) {
+    return 0;
+  }
+  return zones[zone].level;
+}
+
+void zone_set_level(int zone, int level) {
+  if (zone >= count) {
+    return;
+  }
+  zones[zone].level = level < ZONE_LEVELS ? level : ZONE_LEVELS - 1;
+  zones[zone].level_us = clock_now_us();
+}
+
+int zone_add_pulse(int zone, uint32_t width_us) {
+  if (zone >= count || configs[zone].type != ZONE_ULTRASONIC) {
+    return 0;
+  }
+  uint16_t mm = ultrasonic_pulse_to_mm(width_us);
+  if (mm && mm <= configs[zone].trip_mm * ZONE_NEAR_FACTOR) { // Something is approaching, watch closely
+    core_util_atomic_store_u32(&burst_until_us, clock_now_us() + ZONE_BURST_MS * 1000);
+  }
+  ZoneState &state = zones[zone];
+  int near = ultrasonic_add_pulse(&state.filter, width_us);
+  if (state.filter.count >= ULTRASONIC_FILTER_SIZE) { // Range bar: in range, near, at the trip point
+    uint16_t distance = state.filter.distance_mm;
+    uint16_t trip_mm = configs[zone].trip_mm;
+    zone_set_level(zone, distance <= trip_mm                    ? 3
+                         : distance <= trip_mm * ZONE_NEAR_FACTOR ? 2
+                         : distance <= ULTRASONIC_MAX_MM          ? 1
+                                                                  : 0);
+  }
+  if (!mm || state.filter.count < ULTRASONIC_FILTER_SIZE) {
+    return 0; // No new filtered distance
+  }
+  if (learning) {
+    background_learn(&state.background, state.filter.distance_mm);
+    return near;
+  }
+  if (state.background.samples < BACKGROUND_WARMUP) {
+    return near; // Scene never learned, fall back to the trip distance
+  }
+  return background_deviates(&state.background, state.filter.distance_mm);
+}
+
+void zones_set_mode(int mode, uint32_t round_gap_ms, int learn) {
+  uint32_t now_us = clock_now_us();
+  learning = learn;
+  if (mode != current_mode) {
+    mode_stats[current_mode].time_us += now_us - mode_since_us;
+    mode_since_us = now_us;
+    current_mode = mode < ZONE_MODES ? mode : ZONE_MODES - 1;
+  }
+  round_gap_us = round_gap_ms * 1000;
+}
+
+void zones_report(void) {
+  uint32_t now_us = clock_now_us();
+  for (int mode = 0; mode < ZONE_MODES; mode++) {
+    const ModeStats &stats = mode_stats[mode];
+    uint64_t time_us = stats.time_us + (mode == current_mode ? now_us - mode_since_us : 0);
+    if (!stats.pings || !time_us) {
+      continue;
+    }
+    // Refresh interval is the worst case time for a zone to notice a change
+    printf("zones mode %d: %lu pings/h, refresh avg=%lums max=%lums\r\n", mode,
+           (unsigned long)(stats.pings * 3600000000ull / time_us),
+           (unsigned long)(stats.refreshes ? stats.refresh_total_us / stats.refreshes / 1000 : 0),
+           (unsigned long)(stats.refresh_max_us / 1000));
+  }
+  for (int i = 0; i < count; i++) {
+    if (configs[i].type == ZONE_ULTRASONIC) {
+      const Background &background = zones[i].background;
+      printf("zone %d %s: %umm, scene %umm +-%lumm%s\r\n", i, configs[i].name,
+             zones[i].filter.distance_mm, background.mean_mm,
+             (unsigned long)sqrtf((float)background.variance),
+             background.samples < BACKGROUND_WARMUP ? " (learning)" : "");
+    }
+  }
+}
+
+static void start_turn(void) {
+  TRACE_BEGIN(TRACE_ISR_ULTRASONIC_TRIGGER);
+  power_wakeup(WAKE_ULTRASONIC);
+  uint32_t now_us = clock_now_us();
+  ModeStats &stats = mode_stats[current_mode];
+  uint32_t fired = 0;
+  for (int i = 0; i < count; i++) {
+    ZoneState &zone = zones[i];
+    zone.waiting = 0; // Zones the last group never heard back from give up
+    if (configs[i].type != ZONE_ULTRASONIC || configs[i].ping_group != current_group ||
+        zone.echo->read()) { // Skip a sensor still reporting its previous echo
+      continue;
+    }
+    if (zone.ping_us) {
+      uint32_t refresh_us = now_us - zone.ping_us;
+      stats.refreshes++;
+      stats.refresh_total_us += refresh_us;
+      stats.refresh_max_us = refresh_us > stats.refresh_max_us ? refresh_us : stats.refresh_max_us;
+    }
+    zone.ping_us = now_us;
+    zone.waiting = 1;
+    *zone.trigger = 1;
+    fired++;
+  }
+  stats.pings += fired;
+  outstanding = fired;
+
+  if (fired) { // Triggers drop from their own timer, then the echoes are awaited
+    ping_timeout.attach(&end_trigger, std::chrono::microseconds(ZONE_TRIGGER_US));
+  } else {
+    schedule_next(ZONE_PING_GUARD_US);
+  }
+  TRACE_END(TRACE_ISR_ULTRASONIC_TRIGGER);
+}
+
+static void end_trigger(void) {
+  power_wakeup(WAKE_ULTRASONIC);
+  for (int i = 0; i < count; i++) {
+    if (zones[i].waiting) {
+      *zones[i].trigger = 0;
+    }
+  }
+  listening = 1;
+  ping_timeout.attach(&turn_timeout, std::chrono::microseconds(ZONE_PING_TIMEOUT_US));
+}
+
+static void turn_timeout(void) {
+  power_wakeup(WAKE_ULTRASONIC);
+  for (int i = 0; i < count; i++) {
+    zones[i].waiting = 0; // A late echo from the abandoned group must not advance it again
+  }
+  outstanding = 0;
+  schedule_next(0);
+}
+
+static void schedule_next(uint32_t delay_us) {
+  listening = 0;
+  current_group = (current_group + 1) % group_count;
+  if (current_group == 0 && (int32_t)(burst_until_us - clock_now_us()) <= 0) {
+    delay_us += round_gap_us; // Round complete and nothing near, rest for the mode's gap
+  }
+  ping_timeout.attach(&start_turn, std::chrono::microseconds(delay_us ? delay_us : 1));
+}
+
+static void echo_rise(ZoneState *zone) {
+  TRACE_BEGIN(TRACE_ISR_ULTRASONIC);
+  power_wakeup(WAKE_ULTRASONIC);
+  zone->rise_us = clock_now_us();
+  TRACE_END(TRACE_ISR_ULTRASONIC);
+}
+
+static void echo_fall(ZoneState *zone) {
+  TRACE_BEGIN(TRACE_ISR_ULTRASONIC_FALLING_EDGE);
+  power_wakeup(WAKE_ULTRASONIC);
+  if (listening && zone->waiting) { // A glitch while the trigger is high must not replace end_trigger
+    uint32_t width_us = clock_now_us() - zone->rise_us;
+    zone->waiting = 0;
+    event_post(EVENT_ECHO_PULSE, zone - zones, width_us > 0xFFFF ? 0xFFFF : width_us);
+    TELEMETRY(TELEMETRY_ECHO, zone - zones, width_us);
+    if (--outstanding == 0) { // Whole group is back, start the next one early
+      schedule_next(ZONE_PING_GUARD_US);
+    }
+  }
+  TRACE_END(TRACE_ISR_ULTRASONIC_FALLING_EDGE);
+}
@@ -0,0 +1,67 @@
+/*
+ * File Purpose: Registry of sensor zones and the staggered HC-SR04 ping scheduler
+ *
+ * Subroutines:
+ * void zones_start(const ZoneConfig *zones, int count) - Register the zones, set up their pins and start pinging
+ * int zone_count(void) - Number of registered zones
+ * const char *zone_name(int zone) - Name shown on the LCD, "" for ZONE_NONE
+ * int zone_armed(int zone, int mode) - 1 if a trip of the zone counts in the system mode
+ * int zone_type(int zone) - ZoneType of the zone, -1 if there is no such zone
+ * int zone_level(int zone) - Recent activity from 0 (nothing) to ZONE_LEVELS - 1 (at the trip point), for the status line
+ * void zone_set_level(int zone, int level) - Report activity for a zone that isn't pinged, owner's thread only
+ * int zone_add_pulse(int zone, uint32_t width_us) - Filter an echo width for the zone, returns 1 if it tripped
+ * void zones_set_mode(int mode, uint32_t round_gap_ms, int learning) - Pause between ping rounds for the system mode and whether the scene is being learned
+ * void zones_report(void) - Print each zone's filtered distance and the ping rate and refresh interval per mode
+ *
+ * Ultrasonic zones sharing a ping_group fire together and the groups take turns, so sensors
+ * that can hear each other belong in different groups. A group's turn ends as soon as every
+ * echo in it has come back plus a short guard for stray reflections, or after the longest echo
+ * an HC-SR04 produces, so each zone is pinged as often as the group count allows. The owner
+ * spaces rounds out per mode to save power; any reading within ZONE_NEAR_FACTOR of a zone's trip
+ * distance drops the gap for ZONE_BURST_MS so an approach is tracked at the full rate. The 10us
+ * trigger pulse is ended by a one-shot timer instead of a busy wait.
+ *
+ * While learning, each zone's filtered distance trains its background model. Otherwise a zone
+ * trips when the filtered distance deviates from the learned scene, or, until the model has
+ * warmed up, when it is within the zone's trip distance.
+ */
+#ifndef ZONES_H
+#define ZONES_H
+
+#include "mbed.h"
+
+#define ZONE_MAX 14              // Zone numbers must fit the 4 bit field in the snapshot
+#define ZONE_NONE 0xF            // No zone, e.g. nothing has tripped
+#define ZONE_PING_TIMEOUT_US 40000 // HC-SR04 drops echo after ~38ms when nothing is in range
+#define ZONE_PING_GUARD_US 2000  // Quiet time after the last echo before the next group fires
+#define ZONE_TRIGGER_US 10       // HC-SR04 trigger pulse width
+#define ZONE_NEAR_FACTOR 2       // Readings within this many trip distances start a burst
+#define ZONE_BURST_MS 3000       // How long a near reading keeps rounds back to back
+#define ZONE_MODES 4             // System modes statistics are kept for
+#define ZONE_LEVELS 4            // Activity levels, 0 is idle
+#define ZONE_LEVEL_HOLD_MS 2000  // A level older than this reads as 0
+
+enum ZoneType { ZONE_ULTRASONIC, ZONE_MICROPHONE };
+
+struct ZoneConfig {
+  const char *name;   // Up to 10 characters so it fits after "Zone: "
+  uint8_t type;       // ZoneType
+  uint8_t ping_group; // Ultrasonic zones in the same group ping at the same time
+  PinName trigger;    // Ultrasonic trigger output, NC for other types
+  PinName echo;       // Ultrasonic echo input, NC for other types
+  uint16_t trip_mm;   // Ultrasonic trip distance
+  uint8_t arm_mask;   // Bit per system mode (1 << mode) in which a trip counts
+};
+
+void zones_start(const ZoneConfig *zones, int count);
+int zone_count(void);
+const char *zone_name(int zone);
+int zone_armed(int zone, int mode);
+int zone_type(int zone);
+int zone_level(int zone);
+void zone_set_level(int zone, int level);
+int zone_add_pulse(int zone, uint32_t width_us);
+void zones_set_mode(int mode, uint32_t round_gap_ms, int learning);
+void zones_report(void);
+
+#endif